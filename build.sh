@@ -3,7 +3,7 @@
 INCLUDES="-I deps -I src -I ."
 CFLAGS="-D_GNU_SOURCE -D_XOPEN_SOURCE=700 -D_BSD_SOURCE -std=c11 -Werror -Wall -Wno-missing-field-initializers -Wno-unused-command-line-argument -Wno-missing-braces "
 #CFLAGS="-std=c11 -Werror -Wall"
-LINKFLAGS="-Ideps/chaste -lexanic -lm "
+LINKFLAGS="-Ideps/chaste -lexanic -lm -lpthread "
 
 SRC="camio_cat.c"
 cake $SRC \
@@ -11,7 +11,7 @@ cake $SRC \
     --append-LINKFLAGS="$LINKFLAGS" \
     --no-git-root\
     --no-git-parent\
-    --begintests tests/test_num_parser.c --endtests\
+    --begintests tests/test_num_parser.c tests/test_escape.c tests/test_addr_parser.c tests/test_rotate.c tests/test_pcap_ts.c --endtests\
     $@
 
 
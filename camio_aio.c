@@ -0,0 +1,433 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ asynchronous file I/O, common to the streams that read and write regular files
+ *
+ * io_uring is driven with raw system calls, so there is no dependency on liburing.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "camio_aio.h"
+#include "camio_errors.h"
+#include "camio_util.h"
+
+
+void camio_aio_get_opts(const camio_descr_t* descr, camio_aio_opts_t* opts){
+    opts->aio   = camio_descr_get_opt_bool(descr, "aio", 0);
+    opts->depth = camio_descr_get_opt_uint(descr, "aio_depth", CAMIO_AIO_DEFAULT_DEPTH);
+    if(opts->depth < 2){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "aio_depth (%lu) must be at least 2\n", opts->depth);
+    }
+}
+
+
+/* ****************************************************
+ * io_uring
+ */
+
+static int uring_init(camio_aio_t* aio){
+    struct io_uring_params params;
+    bzero(&params, sizeof(params));
+
+    aio->ring_fd = syscall(__NR_io_uring_setup, (unsigned)aio->depth, &params);
+    if(aio->ring_fd < 0){
+        return -1; //Old kernel, or io_uring has been disabled
+    }
+
+    aio->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    aio->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP){
+        aio->sq_map_size = MAX(aio->sq_map_size, aio->cq_map_size);
+    }
+
+    aio->sq_map = mmap(NULL, aio->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring_fd, IORING_OFF_SQ_RING);
+    if(aio->sq_map == MAP_FAILED){
+        eprintf_exit(CAMIO_ERR_MMAP, "Could not map io_uring submission queue. Error=%s\n", strerror(errno));
+    }
+
+    aio->cq_map = aio->sq_map;
+    if(!(params.features & IORING_FEAT_SINGLE_MMAP)){
+        aio->cq_map = mmap(NULL, aio->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring_fd, IORING_OFF_CQ_RING);
+        if(aio->cq_map == MAP_FAILED){
+            eprintf_exit(CAMIO_ERR_MMAP, "Could not map io_uring completion queue. Error=%s\n", strerror(errno));
+        }
+    }
+
+    aio->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    aio->sqes = mmap(NULL, aio->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring_fd, IORING_OFF_SQES);
+    if(aio->sqes == MAP_FAILED){
+        eprintf_exit(CAMIO_ERR_MMAP, "Could not map io_uring submission entries. Error=%s\n", strerror(errno));
+    }
+
+    aio->sq_head  = (volatile uint32_t*)(aio->sq_map + params.sq_off.head);
+    aio->sq_tail  = (volatile uint32_t*)(aio->sq_map + params.sq_off.tail);
+    aio->sq_array = (volatile uint32_t*)(aio->sq_map + params.sq_off.array);
+    aio->sq_mask  = *(uint32_t*)(aio->sq_map + params.sq_off.ring_mask);
+    aio->cq_head  = (volatile uint32_t*)(aio->cq_map + params.cq_off.head);
+    aio->cq_tail  = (volatile uint32_t*)(aio->cq_map + params.cq_off.tail);
+    aio->cqes     = (struct io_uring_cqe*)(aio->cq_map + params.cq_off.cqes);
+    aio->cq_mask  = *(uint32_t*)(aio->cq_map + params.cq_off.ring_mask);
+
+    //Fixed buffers save the kernel mapping them in on every I/O, but they count against the
+    //locked memory limit. Plain vectored I/O works fine without them
+    struct iovec iovs[aio->depth];
+    uint64_t i = 0;
+    for(; i < aio->depth; i++){
+        iovs[i].iov_base = aio->slots[i].buff;
+        iovs[i].iov_len  = aio->buff_size;
+    }
+    aio->fixed = syscall(__NR_io_uring_register, aio->ring_fd, IORING_REGISTER_BUFFERS, iovs, (unsigned)aio->depth) == 0;
+
+    aio->uring = 1;
+    return 0;
+}
+
+
+static void uring_destroy(camio_aio_t* aio){
+    munmap(aio->sqes, aio->sqes_size);
+    if(aio->cq_map != aio->sq_map){
+        munmap(aio->cq_map, aio->cq_map_size);
+    }
+    munmap(aio->sq_map, aio->sq_map_size);
+    close(aio->ring_fd);
+}
+
+
+static void uring_submit(camio_aio_t* aio, uint64_t index){
+    camio_aio_slot_t* slot = &aio->slots[index];
+
+    //We never have more than depth entries outstanding, so there is always room
+    const uint32_t tail = *aio->sq_tail;
+    const uint32_t entry = tail & aio->sq_mask;
+    struct io_uring_sqe* sqe = &aio->sqes[entry];
+    bzero(sqe, sizeof(*sqe));
+
+    sqe->fd        = aio->fd;
+    sqe->off       = slot->offset;
+    sqe->user_data = index;
+    if(aio->fixed){
+        sqe->opcode    = aio->is_write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->addr      = (uint64_t)(uintptr_t)slot->buff;
+        sqe->len       = slot->len;
+        sqe->buf_index = index;
+    }
+    else{
+        slot->iov.iov_base = slot->buff;
+        slot->iov.iov_len  = slot->len;
+        sqe->opcode    = aio->is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->addr      = (uint64_t)(uintptr_t)&slot->iov;
+        sqe->len       = 1;
+    }
+
+    aio->sq_array[entry] = entry;
+    __atomic_store_n(aio->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    while(syscall(__NR_io_uring_enter, aio->ring_fd, 1, 0, 0, NULL, 0) < 0){
+        if(errno != EINTR && errno != EAGAIN && errno != EBUSY){
+            eprintf_exit(CAMIO_ERR_FILE_WRITE, "Could not submit to io_uring. Error=%s\n", strerror(errno));
+        }
+    }
+}
+
+
+//Mark every completion that's arrived, waiting for at least one first if asked to
+static void uring_reap(camio_aio_t* aio, int wait){
+    uint32_t head = *aio->cq_head;
+    if(wait && head == __atomic_load_n(aio->cq_tail, __ATOMIC_ACQUIRE)){
+        if(syscall(__NR_io_uring_enter, aio->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR){
+            eprintf_exit(CAMIO_ERR_FILE_READ, "Could not wait on io_uring. Error=%s\n", strerror(errno));
+        }
+    }
+
+    const uint32_t tail = __atomic_load_n(aio->cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++){
+        const struct io_uring_cqe* cqe = &aio->cqes[head & aio->cq_mask];
+        camio_aio_slot_t* slot = &aio->slots[cqe->user_data];
+        slot->result = cqe->res;
+        slot->state  = CAMIO_AIO_SLOT_DONE;
+    }
+    __atomic_store_n(aio->cq_head, head, __ATOMIC_RELEASE);
+}
+
+
+/* ****************************************************
+ * Helper thread, for when there is no io_uring
+ */
+
+static void* thread_run(void* arg){
+    camio_aio_t* aio = arg;
+    uint64_t index = 0;
+
+    pthread_mutex_lock(&aio->lock);
+    while(1){
+        camio_aio_slot_t* slot = &aio->slots[index];
+        while(!aio->stop && slot->state != CAMIO_AIO_SLOT_SUBMITTED){
+            pthread_cond_wait(&aio->cond, &aio->lock);
+        }
+        if(aio->stop){
+            break;
+        }
+        pthread_mutex_unlock(&aio->lock);
+
+        ssize_t result = aio->is_write ?
+                pwrite(aio->fd, slot->buff, slot->len, slot->offset) :
+                pread(aio->fd, slot->buff, slot->len, slot->offset);
+        result = result < 0 ? -errno : result;
+
+        pthread_mutex_lock(&aio->lock);
+        slot->result = result;
+        slot->state  = CAMIO_AIO_SLOT_DONE;
+        pthread_cond_broadcast(&aio->cond);
+
+        index = (index + 1) % aio->depth;
+    }
+    pthread_mutex_unlock(&aio->lock);
+
+    return NULL;
+}
+
+
+static void thread_init(camio_aio_t* aio){
+    aio->stop = 0;
+    pthread_mutex_init(&aio->lock, NULL);
+    pthread_cond_init(&aio->cond, NULL);
+    const int err = pthread_create(&aio->thread, NULL, thread_run, aio);
+    if(err){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not start aio helper thread. Error=%s\n", strerror(err));
+    }
+}
+
+
+static void thread_destroy(camio_aio_t* aio){
+    pthread_mutex_lock(&aio->lock);
+    aio->stop = 1;
+    pthread_cond_broadcast(&aio->cond);
+    pthread_mutex_unlock(&aio->lock);
+
+    pthread_join(aio->thread, NULL);
+    pthread_cond_destroy(&aio->cond);
+    pthread_mutex_destroy(&aio->lock);
+}
+
+
+/* ****************************************************
+ * Common
+ */
+
+static void submit(camio_aio_t* aio, uint64_t index, size_t len){
+    camio_aio_slot_t* slot = &aio->slots[index];
+    slot->len    = len;
+    slot->offset = aio->offset;
+    slot->result = 0;
+    aio->offset += len;
+
+    if(aio->uring){
+        slot->state = CAMIO_AIO_SLOT_SUBMITTED;
+        uring_submit(aio, index);
+        return;
+    }
+
+    pthread_mutex_lock(&aio->lock);
+    slot->state = CAMIO_AIO_SLOT_SUBMITTED;
+    pthread_cond_broadcast(&aio->cond);
+    pthread_mutex_unlock(&aio->lock);
+}
+
+
+//Has the I/O on this slot finished?
+static int is_done(camio_aio_t* aio, uint64_t index){
+    camio_aio_slot_t* slot = &aio->slots[index];
+    if(aio->uring){
+        if(slot->state != CAMIO_AIO_SLOT_DONE){
+            uring_reap(aio, 0);
+        }
+        return slot->state == CAMIO_AIO_SLOT_DONE;
+    }
+
+    pthread_mutex_lock(&aio->lock);
+    const int done = slot->state == CAMIO_AIO_SLOT_DONE;
+    pthread_mutex_unlock(&aio->lock);
+    return done;
+}
+
+
+//Wait for the I/O on this slot to finish and check how it went. Short transfers are finished off
+//synchronously, so a slot is always either complete or ends at the end of the file
+static void wait_slot(camio_aio_t* aio, uint64_t index){
+    camio_aio_slot_t* slot = &aio->slots[index];
+
+    if(aio->uring){
+        while(slot->state != CAMIO_AIO_SLOT_DONE){
+            uring_reap(aio, 1);
+        }
+    }
+    else{
+        pthread_mutex_lock(&aio->lock);
+        while(slot->state != CAMIO_AIO_SLOT_DONE){
+            pthread_cond_wait(&aio->cond, &aio->lock);
+        }
+        pthread_mutex_unlock(&aio->lock);
+    }
+
+    while(slot->result >= 0 && (size_t)slot->result < slot->len){
+        const ssize_t result = aio->is_write ?
+                pwrite(aio->fd, slot->buff + slot->result, slot->len - slot->result, slot->offset + slot->result) :
+                pread(aio->fd, slot->buff + slot->result, slot->len - slot->result, slot->offset + slot->result);
+        if(result < 0 && errno == EINTR){
+            continue;
+        }
+        if(result < 0){
+            slot->result = -errno;
+            break;
+        }
+        if(result == 0){
+            slot->result = aio->is_write ? -EIO : slot->result; //Reads stop at the end of the file
+            break;
+        }
+        slot->result += result;
+    }
+
+    if(slot->result < 0){
+        eprintf_exit(aio->is_write ? CAMIO_ERR_FILE_WRITE : CAMIO_ERR_FILE_READ, "Asynchronous %s failed. Error=%s\n",
+                aio->is_write ? "write" : "read", strerror((int)-slot->result));
+    }
+}
+
+
+void camio_aio_init(camio_aio_t* aio, int fd, int is_write, uint64_t depth, size_t buff_size, uint64_t offset){
+    aio->fd        = fd;
+    aio->is_write  = is_write;
+    aio->depth     = depth;
+    aio->buff_size = (buff_size + CAMIO_AIO_ALIGN - 1) & ~(size_t)(CAMIO_AIO_ALIGN - 1);
+    aio->next      = 0;
+    aio->offset    = offset;
+    aio->consumed  = 0;
+    aio->eof       = 0;
+    aio->uring     = 0;
+    aio->fixed     = 0;
+    aio->ring_fd   = -1;
+
+    if(posix_memalign((void**)&aio->buffers, CAMIO_AIO_ALIGN, aio->buff_size * depth)){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not allocate %lu aio buffers of %lu bytes\n", depth, aio->buff_size);
+    }
+    aio->slots = calloc(depth, sizeof(camio_aio_slot_t));
+    if(!aio->slots){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not allocate aio slots\n");
+    }
+
+    uint64_t i = 0;
+    for(; i < depth; i++){
+        aio->slots[i].buff  = aio->buffers + i * aio->buff_size;
+        aio->slots[i].state = CAMIO_AIO_SLOT_FREE;
+    }
+
+    if(uring_init(aio) < 0){
+        thread_init(aio);
+    }
+
+    if(!is_write){
+        for(i = 0; i < depth; i++){
+            submit(aio, i, aio->buff_size);
+        }
+    }
+}
+
+
+void camio_aio_drain(camio_aio_t* aio){
+    uint64_t i = 0;
+    for(; i < aio->depth; i++){
+        if(aio->slots[i].state != CAMIO_AIO_SLOT_FREE){
+            //Reads may be waiting on a file that's gone away, we don't care how they turn out
+            if(aio->is_write){
+                wait_slot(aio, i);
+            }
+            else if(aio->uring){
+                while(aio->slots[i].state != CAMIO_AIO_SLOT_DONE){
+                    uring_reap(aio, 1);
+                }
+            }
+            aio->slots[i].state = CAMIO_AIO_SLOT_FREE;
+        }
+    }
+}
+
+
+void camio_aio_destroy(camio_aio_t* aio){
+    camio_aio_drain(aio);
+
+    if(aio->uring){
+        uring_destroy(aio);
+    }
+    else{
+        thread_destroy(aio);
+    }
+
+    if(aio->is_write){
+        lseek(aio->fd, aio->offset, SEEK_SET);
+    }
+
+    free(aio->slots);
+    free(aio->buffers);
+    aio->slots   = NULL;
+    aio->buffers = NULL;
+}
+
+
+uint8_t* camio_aio_write_buffer(camio_aio_t* aio){
+    camio_aio_slot_t* slot = &aio->slots[aio->next];
+    if(slot->state != CAMIO_AIO_SLOT_FREE){
+        wait_slot(aio, aio->next);
+        slot->state = CAMIO_AIO_SLOT_FREE;
+    }
+
+    return slot->buff;
+}
+
+
+void camio_aio_write_submit(camio_aio_t* aio, size_t len){
+    submit(aio, aio->next, len);
+    aio->next = (aio->next + 1) % aio->depth;
+}
+
+
+int64_t camio_aio_read(camio_aio_t* aio, uint8_t* out, size_t len, int blocking){
+    if(aio->eof){
+        return 0;
+    }
+
+    //Only check on the slot the first time we get to it, it's finished after that
+    camio_aio_slot_t* slot = &aio->slots[aio->next];
+    if(aio->consumed == 0){
+        if(!blocking && !is_done(aio, aio->next)){
+            return -1;
+        }
+        wait_slot(aio, aio->next);
+    }
+
+    const size_t avail = slot->result - aio->consumed;
+    len = MIN(len, avail);
+    memcpy(out, slot->buff + aio->consumed, len);
+    aio->consumed += len;
+
+    //Used this one up, send it off for the next part of the file
+    if(aio->consumed == (size_t)slot->result){
+        if((size_t)slot->result < aio->buff_size){
+            aio->eof = 1; //Partly full, so that's the end of the file
+            return len;
+        }
+
+        aio->consumed = 0;
+        submit(aio, aio->next, aio->buff_size);
+        aio->next = (aio->next + 1) % aio->depth;
+    }
+
+    return len;
+}
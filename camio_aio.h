@@ -0,0 +1,118 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ asynchronous file I/O, common to the streams that read and write regular files
+ *
+ * A file is read or written through a queue of fixed size buffers, used round robin. Readers get
+ * the whole queue submitted at open time and resubmitted as each buffer is consumed, so the disk
+ * stays ahead of the consumer. Writers fill one buffer while the others are being written out, and
+ * only wait when they come back around to a buffer that is still in flight.
+ *
+ * The I/O is done with io_uring where the kernel has it, using buffers registered with the ring
+ * (fixed buffers) if it lets us. Otherwise a helper thread does plain pread()/pwrite() calls.
+ *
+ * Options:
+ * aio=1        Use asynchronous I/O. Only regular files can, anything else is read and written
+ *              synchronously as before
+ * aio_depth=N  Number of buffers in the queue, at least 2. Defaults to 8
+ *
+ */
+
+#ifndef CAMIO_AIO_H_
+#define CAMIO_AIO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "camio_descr.h"
+
+//Option names, for the valid option lists of streams that use camio_aio
+#define CAMIO_AIO_OPTS "aio", "aio_depth"
+
+#define CAMIO_AIO_DEFAULT_DEPTH 8
+#define CAMIO_AIO_READ_SIZE (256 * 1024)        //256kB per read
+#define CAMIO_AIO_ALIGN 4096                    //Buffers are page aligned
+
+#define CAMIO_AIO_SLOT_FREE      0
+#define CAMIO_AIO_SLOT_SUBMITTED 1
+#define CAMIO_AIO_SLOT_DONE      2
+
+typedef struct {
+    int aio;
+    uint64_t depth;
+} camio_aio_opts_t;
+
+typedef struct {
+    uint8_t* buff;
+    struct iovec iov;                   //Where the I/O is going, for kernels without fixed buffers
+    uint64_t offset;                    //File offset of the I/O
+    size_t len;
+    int64_t result;                     //Bytes transferred, or -errno
+    int state;                          //CAMIO_AIO_SLOT_*
+} camio_aio_slot_t;
+
+typedef struct {
+    int fd;
+    int is_write;
+    uint64_t depth;
+    size_t buff_size;
+    uint8_t* buffers;                   //depth * buff_size bytes, carved up between the slots
+    camio_aio_slot_t* slots;
+    uint64_t next;                      //Slot being filled (writes) or consumed (reads)
+    uint64_t offset;                    //File offset of the next submission
+    size_t consumed;                    //Reads, bytes of the next slot already handed out
+    int eof;                            //Reads, the file ended in a slot we've consumed
+
+    //io_uring, if we have it
+    int uring;
+    int ring_fd;
+    int fixed;                          //Buffers are registered with the ring
+    uint8_t* sq_map;
+    size_t sq_map_size;
+    uint8_t* cq_map;
+    size_t cq_map_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    volatile uint32_t* sq_head;
+    volatile uint32_t* sq_tail;
+    volatile uint32_t* sq_array;
+    uint32_t sq_mask;
+    volatile uint32_t* cq_head;
+    volatile uint32_t* cq_tail;
+    struct io_uring_cqe* cqes;
+    uint32_t cq_mask;
+
+    //Otherwise a helper thread, which works through the slots in order
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int stop;
+} camio_aio_t;
+
+
+void camio_aio_get_opts(const camio_descr_t* descr, camio_aio_opts_t* opts);
+
+//Set up asynchronous I/O on fd, with depth buffers of buff_size bytes starting at file offset.
+//Readers have reads for all of the buffers submitted straight away
+void camio_aio_init(camio_aio_t* aio, int fd, int is_write, uint64_t depth, size_t buff_size, uint64_t offset);
+
+//Wait for everything in flight to finish and free it all. Writers leave the file offset of fd at
+//the end of what they wrote
+void camio_aio_destroy(camio_aio_t* aio);
+
+//Wait for everything in flight to finish. Writers can then change fd and offset, eg to start on a
+//new file
+void camio_aio_drain(camio_aio_t* aio);
+
+//Writers. Get the buffer to fill next, waiting for it if it's still being written out, then submit
+//len bytes of it to be written at the end of the file
+uint8_t* camio_aio_write_buffer(camio_aio_t* aio);
+void camio_aio_write_submit(camio_aio_t* aio, size_t len);
+
+//Readers. Copy up to len bytes of the file out. Returns the number of bytes, 0 at the end of the
+//file, or -1 if not blocking and the next buffer hasn't been read yet
+int64_t camio_aio_read(camio_aio_t* aio, uint8_t* out, size_t len, int blocking);
+
+#endif /* CAMIO_AIO_H_ */
@@ -14,6 +14,8 @@
 
 #include "camio_descr.h"
 #include "camio_errors.h"
+#include "parsing/numeric_parser.h"
+#include "parsing/bool_parser.h"
 
 
 ///eg "udp:127.0.0.1,opt1=1,opt2=4"
@@ -154,3 +156,64 @@ void camio_descr_destroy(camio_descr_t* opts){
     if(opts->query) free(opts->query);
     camio_descr_free(opts->opt_head);
 }
+
+
+const char* camio_descr_get_opt(const camio_descr_t* descr, const char* name){
+    struct camio_opt_t* opt = descr->opt_head;
+    for(; opt; opt = opt->next){
+        if(strcmp(opt->name, name) == 0){
+            return opt->value;
+        }
+    }
+
+    return NULL;
+}
+
+
+//Unsigned numbers are read by the numeric parser, so they may have a K/M/G (powers of 10) or
+//Ki/Mi/Gi (powers of 2) suffix
+uint64_t camio_descr_get_opt_uint(const camio_descr_t* descr, const char* name, uint64_t def){
+    const char* value = camio_descr_get_opt(descr, name);
+    if(!value){
+        return def;
+    }
+
+    num_result_t num_result = parse_number(value, 0);
+    if(num_result.type != CAMIO_UINT64){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option \"%s\" expected an unsigned number but \"%s\" found\n", name, value);
+    }
+
+    return num_result.val_uint;
+}
+
+
+int camio_descr_get_opt_bool(const camio_descr_t* descr, const char* name, int def){
+    const char* value = camio_descr_get_opt(descr, name);
+    if(!value){
+        return def;
+    }
+
+    num_result_t num_result = parse_bool(value, strlen(value), 0);
+    if(num_result.type != CAMIO_INT64){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Unknown option value supplied \"%s\" for \"%s\". Valid values are \"1\" or \"0\"\n", value, name);
+    }
+
+    return (int)num_result.val_int;
+}
+
+
+void camio_descr_check_opts(const camio_descr_t* descr, const char* const* valid){
+    struct camio_opt_t* opt = descr->opt_head;
+    for(; opt; opt = opt->next){
+        size_t i = 0;
+        for(; valid[i]; i++){
+            if(strcmp(opt->name, valid[i]) == 0){
+                break;
+            }
+        }
+
+        if(!valid[i]){
+            eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Unknown option supplied \"%s\"\n", opt->name);
+        }
+    }
+}
@@ -32,5 +32,13 @@ int camio_descr_parse(const char* description, camio_descr_t* out_descr);
 void camio_descr_destroy(camio_descr_t* out_descr);
 void camio_descr_construct(camio_descr_t* descr);
 
+//Option helpers. Options that are not supplied take the default value, bad values exit with an error.
+//Unsigned numbers may have a K/M/G suffix (1000, 1000^2, 1000^3) or a Ki/Mi/Gi suffix (1024,
+//1024^2, 1024^3), eg size=4Mi
+const char* camio_descr_get_opt(const camio_descr_t* descr, const char* name);           //Returns NULL if not supplied
+uint64_t camio_descr_get_opt_uint(const camio_descr_t* descr, const char* name, uint64_t def);
+int camio_descr_get_opt_bool(const camio_descr_t* descr, const char* name, int def);
+void camio_descr_check_opts(const camio_descr_t* descr, const char* const* valid);       //valid is a NULL terminated list of option names
+
 
 #endif /* CAMIO_OPTS_H_ */
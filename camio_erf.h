@@ -0,0 +1,83 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ ERF record helpers, for the streams that convert ERF records (as the DAG and ExaNIC
+ * istreams hand them out) to and from other formats
+ *
+ * An ERF record is a dag_record_t header, then any extension headers (8 bytes each, while the top
+ * bit of the type is set on the record and then on each one), then the payload. Ethernet payloads
+ * have 2 bytes of offset/padding in front of the frame. The timestamp is little endian 32.32 fixed
+ * point seconds, rlen (the whole record, with padding) and wlen (the packet on the wire) are big
+ * endian.
+ *
+ */
+
+#ifndef CAMIO_ERF_H_
+#define CAMIO_ERF_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+
+#include "dag/dagapi.h"
+
+#define CAMIO_ERF_HDR_SIZE      16                  //dag_record_t up to the payload
+#define CAMIO_ERF_EXT_HDR_SIZE  8
+#define CAMIO_ERF_ETH_PAD       2                   //offset and pad bytes in front of Ethernet frames
+#define CAMIO_ERF_EXT_MORE      0x80                //In the type, and the first byte of each extension header
+#define CAMIO_ERF_ALIGN         8                   //Records are padded out to a multiple of this
+#define CAMIO_ERF_MAX_RLEN      0xFFF8              //Longest aligned record that rlen can describe
+
+
+static inline int camio_erf_is_ethernet(const dag_record_t* erf){
+    switch(erf->type & ~CAMIO_ERF_EXT_MORE){
+        case TYPE_ETH:
+        case TYPE_COLOR_ETH:
+        case TYPE_DSM_COLOR_ETH:
+            return 1;
+    }
+    return 0;
+}
+
+
+//Offset of the payload (the frame itself, for Ethernet) from the start of the record, or 0 if the
+//extension headers run past len
+static inline size_t camio_erf_payload_offset(const dag_record_t* erf, size_t len){
+    size_t offset = CAMIO_ERF_HDR_SIZE;
+    if(erf->type & CAMIO_ERF_EXT_MORE){
+        const uint8_t* ext = (const uint8_t*)erf + offset;
+        do{
+            offset += CAMIO_ERF_EXT_HDR_SIZE;
+            if(offset > len){
+                return 0;
+            }
+        } while(ext[offset - CAMIO_ERF_HDR_SIZE - CAMIO_ERF_EXT_HDR_SIZE] & CAMIO_ERF_EXT_MORE);
+    }
+
+    if(camio_erf_is_ethernet(erf)){
+        offset += CAMIO_ERF_ETH_PAD;
+    }
+    return offset <= len ? offset : 0;
+}
+
+
+//Timestamp in units of 10^-exp seconds since offset seconds
+static inline uint64_t camio_erf_ts_to_units(uint64_t ts, uint8_t exp, uint64_t offset){
+    uint64_t scale = 1;
+    uint8_t i = 0;
+    for(; i < exp; i++){
+        scale *= 10;
+    }
+
+    const uint64_t secs = (ts >> 32) - offset;
+    const uint64_t frac = ((unsigned __int128)(ts & 0xFFFFFFFFULL) * scale) >> 32;
+    return secs * scale + frac;
+}
+
+
+//And back again, from a time in seconds and nanoseconds
+static inline uint64_t camio_erf_ts_from_timespec(uint64_t secs, uint64_t nsecs){
+    return (secs << 32) + (((unsigned __int128)nsecs << 32) / 1000000000ULL);
+}
+
+#endif /* CAMIO_ERF_H_ */
@@ -35,6 +35,8 @@ const char* camio_error_to_str(uint64_t camio_err){
         case CAMIO_ERR_UNKNOWN_SELECTOR: return "unknown selector";
         case CAMIO_ERR_UNKNOWN_CLOCK:    return "unknown clock";
         case CAMIO_ERR_NOT_AN_ERF:       return "not an ERF";
+        case CAMIO_ERR_NOT_A_RING:       return "not a ring";
+        case CAMIO_ERR_NOT_A_PCAP:       return "not a pcap";
         default:                        return "UNKNOWN ERROR CODE";
     }
 }
@@ -46,6 +46,8 @@
 #define CAMIO_ERR_UNKNOWN_SELECTOR   0x16
 #define CAMIO_ERR_UNKNOWN_CLOCK      0x17
 #define CAMIO_ERR_NOT_AN_ERF         0x18
+#define CAMIO_ERR_NOT_A_RING         0x19
+#define CAMIO_ERR_NOT_A_PCAP         0x1A
 //REMEMBER to update camio_error_to_str as well.
 
 void _eprintf_exit(int err_type, int error_no, int line_no, const char* file, const char *format, ...);
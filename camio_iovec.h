@@ -0,0 +1,19 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ vectored I/O descriptor, used by the batched read/write interfaces
+ *
+ */
+
+#ifndef CAMIO_IOVEC_H_
+#define CAMIO_IOVEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    uint8_t* buff;  //Pointer to the start of the data
+    size_t len;     //Number of bytes at buff
+} camio_iovec_t;
+
+#endif /* CAMIO_IOVEC_H_ */
@@ -0,0 +1,18 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ per-record metadata, handed out alongside records by the istreams that have it
+ *
+ */
+
+#ifndef CAMIO_META_H_
+#define CAMIO_META_H_
+
+#include <stdint.h>
+
+typedef struct {
+    uint64_t sw_ts;     //When the kernel received the record, in ns since 1970. 0 if unknown
+    uint64_t hw_ts;     //When the NIC received it, in ns on the NIC's clock (since 1970, if it's synced). 0 if unknown
+} camio_meta_t;
+
+#endif /* CAMIO_META_H_ */
@@ -0,0 +1,81 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ memory mapping options, common to the streams that map files
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+
+#include "camio_mmap.h"
+#include "camio_errors.h"
+#include "camio_util.h"
+
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC 0x958458f6
+#endif
+
+
+void camio_mmap_get_opts(const camio_descr_t* descr, camio_mmap_opts_t* opts){
+    opts->huge     = camio_descr_get_opt_bool(descr, "huge", 0);
+    opts->populate = camio_descr_get_opt_bool(descr, "populate", 0);
+    opts->lock     = camio_descr_get_opt_bool(descr, "lock", 0);
+}
+
+
+size_t camio_mmap_round(int fd, size_t len){
+    struct statfs st;
+    if(fstatfs(fd, &st) < 0 || (unsigned long)st.f_type != HUGETLBFS_MAGIC){
+        return len;
+    }
+
+    const size_t page = st.f_bsize; //The huge page size of the mount
+    return (len + page - 1) / page * page;
+}
+
+
+//Fault in the whole mapping after the fact, so that it gets whatever page size was asked for
+static void populate(volatile uint8_t* map, size_t len, int prot){
+#ifdef MADV_POPULATE_WRITE
+    if(madvise((void*)map, len, prot & PROT_WRITE ? MADV_POPULATE_WRITE : MADV_POPULATE_READ) == 0){
+        return;
+    }
+#endif
+
+    //Older kernel, touch every page instead
+    size_t i = 0;
+    for(; i < len; i += 4096){
+        (void)map[i];
+    }
+}
+
+
+void* camio_mmap(size_t len, int prot, int fd, const camio_mmap_opts_t* opts, const char* filename){
+    //Hugetlbfs files get huge pages regardless, anything else has to ask for transparent ones before it's faulted in
+    const int thp = opts->huge && camio_mmap_round(fd, 1) == 1;
+
+    const int flags = MAP_SHARED | (opts->populate && !thp ? MAP_POPULATE : 0);
+    void* map = mmap(NULL, len, prot, flags, fd, 0);
+    if(unlikely(map == MAP_FAILED)){
+        eprintf_exit(CAMIO_ERR_MMAP, "Could not memory map file \"%s\". Error=%s\n", filename, strerror(errno));
+    }
+
+    if(thp){
+        if(madvise(map, len, MADV_HUGEPAGE) < 0){
+            wprintf(CAMIO_ERR_MMAP, "Could not get huge pages for \"%s\", put it on a hugetlbfs mount instead. Error=%s\n", filename, strerror(errno));
+        }
+        if(opts->populate){
+            populate(map, len, prot);
+        }
+    }
+
+    if(opts->lock && mlock(map, len) < 0){
+        wprintf(CAMIO_ERR_MMAP, "Could not lock \"%s\" into memory, check ulimit -l. Error=%s\n", filename, strerror(errno));
+    }
+
+    return map;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ memory mapping options, common to the streams that map files
+ *
+ * huge=1     Back the mapping with huge pages. Files on a hugetlbfs mount always are, otherwise
+ *            transparent huge pages are requested (eg for rings on tmpfs).
+ * populate=1 Pre-fault the whole mapping at open time, rather than on first touch.
+ * lock=1     Lock the mapping into memory so it can't be paged out.
+ *
+ */
+
+#ifndef CAMIO_MMAP_H_
+#define CAMIO_MMAP_H_
+
+#include <stddef.h>
+
+#include "camio_descr.h"
+
+//Option names, for the valid option lists of streams that use camio_mmap()
+#define CAMIO_MMAP_OPTS "huge", "populate", "lock"
+
+typedef struct {
+    int huge;
+    int populate;
+    int lock;
+} camio_mmap_opts_t;
+
+void camio_mmap_get_opts(const camio_descr_t* descr, camio_mmap_opts_t* opts);
+
+//Round len up to a whole number of pages for the file system fd is on. Only hugetlbfs cares
+size_t camio_mmap_round(int fd, size_t len);
+
+//Map len bytes of fd (MAP_SHARED) with the options given. Exits on failure, but huge pages and
+//locking are best effort and only warn if they can't be had
+void* camio_mmap(size_t len, int prot, int fd, const camio_mmap_opts_t* opts, const char* filename);
+
+#endif /* CAMIO_MMAP_H_ */
@@ -0,0 +1,53 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ pcap file format, common to the pcap istream and ostream
+ *
+ * A pcap file is a file header followed by records, each a record header followed by the captured
+ * bytes of one packet. Nanosecond files are the same, except for the magic number and the record
+ * header carrying nanoseconds rather than microseconds. Everything is in the byte order of the
+ * machine that wrote the file, which the magic number tells us.
+ *
+ */
+
+#ifndef CAMIO_PCAP_H_
+#define CAMIO_PCAP_H_
+
+#include <stdint.h>
+
+#define CAMIO_PCAP_MAGIC            0xA1B2C3D4  //Microsecond timestamps
+#define CAMIO_PCAP_MAGIC_NSEC       0xA1B23C4D  //Nanosecond timestamps
+#define CAMIO_PCAP_MAGIC_SWAPPED    0xD4C3B2A1  //Same again, written on a machine of the other byte order
+#define CAMIO_PCAP_MAGIC_NSEC_SWAPPED 0x4D3CB2A1
+
+#define CAMIO_PCAP_VERSION_MAJOR    2
+#define CAMIO_PCAP_VERSION_MINOR    4
+
+#define CAMIO_PCAP_LINKTYPE_ETHERNET 1
+#define CAMIO_PCAP_DEFAULT_SNAPLEN  65535
+#define CAMIO_PCAP_MAX_CAPLEN       (256 * 1024 * 1024) //Anything bigger than this is a corrupt file
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;                   //Always 0 in practice
+    uint32_t sigfigs;                   //Always 0 in practice
+    uint32_t snaplen;                   //Most bytes captured of any packet
+    uint32_t linktype;                  //CAMIO_PCAP_LINKTYPE_*
+} camio_pcap_file_hdr_t;
+
+typedef struct {
+    uint32_t ts_sec;
+    uint32_t ts_frac;                   //Microseconds, or nanoseconds for nanosecond files
+    uint32_t caplen;                    //Bytes of the packet that follow
+    uint32_t len;                       //Length of the packet on the wire
+} camio_pcap_rec_hdr_t;
+
+
+//Convert a record's timestamp to nanoseconds since the epoch. nano says what kind of file it's from
+static inline uint64_t camio_pcap_ts_to_ns(const camio_pcap_rec_hdr_t* rec_hdr, int nano){
+    return (uint64_t)rec_hdr->ts_sec * 1000000000ULL + (nano ? rec_hdr->ts_frac : rec_hdr->ts_frac * 1000ULL);
+}
+
+#endif /* CAMIO_PCAP_H_ */
@@ -0,0 +1,112 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ pcapng file format, common to the pcapng istream and ostream
+ *
+ * A pcapng file is a sequence of blocks, each with a type and a total length at the front and the
+ * same length again at the back. A Section Header Block starts the file (and each later section),
+ * then Interface Description Blocks describe the interfaces packets were captured on, numbered in
+ * the order they appear in the section. Packets come in Enhanced Packet Blocks, which name their
+ * interface and carry a timestamp in that interface's units (if_tsresol, microseconds by default)
+ * relative to its if_tsoffset. Everything is in the byte order of the machine that wrote the file.
+ *
+ */
+
+#ifndef CAMIO_PCAPNG_H_
+#define CAMIO_PCAPNG_H_
+
+#include <stdint.h>
+
+#include "camio_pcap.h"                 //Link types and snap lengths are the same
+
+#define CAMIO_PCAPNG_BLOCK_SHB      0x0A0D0D0A  //Section Header Block
+#define CAMIO_PCAPNG_BLOCK_IDB      0x00000001  //Interface Description Block
+#define CAMIO_PCAPNG_BLOCK_SPB      0x00000003  //Simple Packet Block
+#define CAMIO_PCAPNG_BLOCK_EPB      0x00000006  //Enhanced Packet Block
+
+#define CAMIO_PCAPNG_BOM            0x1A2B3C4D  //Byte order magic
+#define CAMIO_PCAPNG_BOM_SWAPPED    0x4D3C2B1A
+#define CAMIO_PCAPNG_VERSION_MAJOR  1
+#define CAMIO_PCAPNG_VERSION_MINOR  0
+
+//Options, which follow the fixed part of a block, padded to 4 bytes each and ended by OPT_END
+#define CAMIO_PCAPNG_OPT_END        0
+#define CAMIO_PCAPNG_OPT_IF_NAME    2
+#define CAMIO_PCAPNG_OPT_IF_TSRESOL 9           //1 byte. Top bit clear is 10^-n seconds, set is 2^-n
+#define CAMIO_PCAPNG_OPT_IF_TSOFFSET 14         //8 bytes, seconds added to every timestamp
+
+#define CAMIO_PCAPNG_TSRESOL_US     6
+#define CAMIO_PCAPNG_TSRESOL_NS     9
+#define CAMIO_PCAPNG_TSRESOL_PS     12
+#define CAMIO_PCAPNG_TSRESOL_BINARY 0x80
+
+#define CAMIO_PCAPNG_PAD(len) (((len) + 3) & ~3ULL)
+
+typedef struct {
+    uint32_t type;
+    uint32_t total_len;                 //Whole block, including this header and the trailing length
+} camio_pcapng_block_hdr_t;
+
+typedef struct {
+    camio_pcapng_block_hdr_t hdr;
+    uint32_t bom;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int64_t section_len;                //-1 when not known
+} __attribute__((packed)) camio_pcapng_shb_t;
+
+typedef struct {
+    camio_pcapng_block_hdr_t hdr;
+    uint16_t linktype;
+    uint16_t reserved;
+    uint32_t snaplen;
+} camio_pcapng_idb_t;
+
+typedef struct {
+    camio_pcapng_block_hdr_t hdr;
+    uint32_t if_id;
+    uint32_t ts_high;
+    uint32_t ts_low;
+    uint32_t caplen;
+    uint32_t len;
+} camio_pcapng_epb_t;
+
+typedef struct {
+    camio_pcapng_block_hdr_t hdr;
+    uint32_t len;                       //Captured bytes are min(len, snaplen)
+} camio_pcapng_spb_t;
+
+typedef struct {
+    uint16_t code;
+    uint16_t len;                       //Not including padding
+} camio_pcapng_opt_t;
+
+//What we know about each interface in a section
+typedef struct {
+    uint16_t linktype;
+    uint32_t snaplen;
+    uint8_t tsresol;                    //As in if_tsresol
+    int64_t tsoffset;                   //Seconds
+} camio_pcapng_if_t;
+
+
+//Convert a packet timestamp on interface iface to nanoseconds since the epoch
+static inline uint64_t camio_pcapng_ts_to_ns(const camio_pcapng_if_t* iface, uint64_t ts){
+    const uint8_t exp = iface->tsresol & ~CAMIO_PCAPNG_TSRESOL_BINARY;
+    unsigned __int128 ns = 0;
+    if(iface->tsresol & CAMIO_PCAPNG_TSRESOL_BINARY){
+        ns = ((unsigned __int128)ts * 1000000000ULL) >> exp;
+    }
+    else{
+        uint64_t scale = 1;
+        uint8_t i = 0;
+        for(; i < (exp > 9 ? exp - 9 : 9 - exp); i++){
+            scale *= 10;
+        }
+        ns = exp > 9 ? ts / scale : (unsigned __int128)ts * scale;
+    }
+
+    return (uint64_t)ns + iface->tsoffset * 1000000000LL;
+}
+
+#endif /* CAMIO_PCAPNG_H_ */
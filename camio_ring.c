@@ -0,0 +1,329 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ shared memory ring, common to the ring istream and ostream
+ *
+ */
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "camio_ring.h"
+#include "camio_errors.h"
+#include "camio_util.h"
+
+
+static void check_geometry(const char* filename, uint64_t type, uint64_t ring_size, uint64_t slot_size){
+    if(type == CAMIO_RING_TYPE_VAR){
+        if(ring_size < 4096 || ring_size % CAMIO_VRING_ALIGN){
+            eprintf_exit(CAMIO_ERR_NOT_A_RING, "Ring \"%s\" size (%lu) must be a multiple of %u and at least 4096 bytes\n", filename, ring_size, CAMIO_VRING_ALIGN);
+        }
+        return;
+    }
+
+    if(slot_size < 64 || slot_size % sizeof(uint64_t)){
+        eprintf_exit(CAMIO_ERR_NOT_A_RING, "Ring \"%s\" slot size (%lu) must be a multiple of 8 and at least 64 bytes\n", filename, slot_size);
+    }
+
+    if(ring_size % slot_size || ring_size / slot_size < 2){
+        eprintf_exit(CAMIO_ERR_NOT_A_RING, "Ring \"%s\" size (%lu) must be a multiple of the slot size (%lu) and hold at least 2 slots\n", filename, ring_size, slot_size);
+    }
+}
+
+
+//Wait for the creator to finish writing the header, then read it
+static void read_header(int fd, const char* filename, camio_ring_hdr_t* hdr){
+    uint64_t waited = 0;
+    while(1){
+        ssize_t bytes = pread(fd, hdr, sizeof(camio_ring_hdr_t), 0);
+        if(bytes < 0){
+            eprintf_exit(CAMIO_ERR_FILE_READ, "Could not read ring header from \"%s\". Error=%s\n", filename, strerror(errno));
+        }
+
+        if(bytes == sizeof(camio_ring_hdr_t) && hdr->magic == CAMIO_RING_MAGIC){
+            break;
+        }
+
+        if(waited >= CAMIO_RING_OPEN_TIMEOUT_US){
+            eprintf_exit(CAMIO_ERR_NOT_A_RING, "File \"%s\" is not a ring, or it was never finished being created\n", filename);
+        }
+        usleep(1000);
+        waited += 1000;
+    }
+
+    if(hdr->version != CAMIO_RING_VERSION){
+        eprintf_exit(CAMIO_ERR_NOT_A_RING, "Ring \"%s\" is version %lu, expected version %u\n", filename, hdr->version, CAMIO_RING_VERSION);
+    }
+}
+
+
+void camio_ring_open(camio_ring_t* ring, const camio_descr_t* descr, uint64_t type, int writable){
+    if(unlikely(!descr->query)){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
+    }
+    const char* filename = descr->query;
+
+    //Zero means "whatever the ring already is", or the default if we're creating it
+    const uint64_t opt_ring_size = camio_descr_get_opt_uint(descr, "size", 0);
+    const uint64_t opt_slot_size = camio_descr_get_opt_uint(descr, "slot", 0);
+
+    camio_mmap_get_opts(descr, &ring->mmap_opts);
+
+    ring->created = 0;
+    ring->type    = type;
+    ring->fd = open(filename, O_RDWR | O_CREAT | O_EXCL, (mode_t)(0666));
+    if(ring->fd >= 0){
+        ring->created   = 1;
+        ring->ring_size = opt_ring_size ? opt_ring_size : CAMIO_RING_DEFAULT_SIZE;
+        ring->slot_size = type == CAMIO_RING_TYPE_VAR ? 0 : (opt_slot_size ? opt_slot_size : CAMIO_RING_DEFAULT_SLOT_SIZE);
+        check_geometry(filename, type, ring->ring_size, ring->slot_size);
+
+        //New space is zero filled, so all the sync counts start at 0. Hugetlbfs needs whole pages
+        if(ftruncate(ring->fd, camio_mmap_round(ring->fd, CAMIO_RING_HDR_SIZE + ring->ring_size)) < 0){
+            eprintf_exit(CAMIO_ERR_FILE_LSEEK, "Could not resize file for shared region \"%s\". Error=%s\n", filename, strerror(errno));
+        }
+    }
+    else{
+        if(errno != EEXIST){
+            eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\". Error=%s\n", filename, strerror(errno));
+        }
+
+        ring->fd = open(filename, writable ? O_RDWR : O_RDONLY);
+        if(unlikely(ring->fd < 0)){
+            eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\". Error=%s\n", filename, strerror(errno));
+        }
+
+        camio_ring_hdr_t hdr;
+        read_header(ring->fd, filename, &hdr);
+        if(hdr.type != type){
+            eprintf_exit(CAMIO_ERR_NOT_A_RING, "Ring \"%s\" is a %s ring, expected a %s ring\n", filename,
+                    hdr.type == CAMIO_RING_TYPE_VAR ? "variable" : "slotted", type == CAMIO_RING_TYPE_VAR ? "variable" : "slotted");
+        }
+        if( (opt_ring_size && opt_ring_size != hdr.ring_size) || (opt_slot_size && opt_slot_size != hdr.slot_size) ){
+            eprintf_exit(CAMIO_ERR_NOT_A_RING, "Ring \"%s\" already exists with size=%lu,slot=%lu which does not match the options supplied\n", filename, hdr.ring_size, hdr.slot_size);
+        }
+        ring->ring_size = hdr.ring_size;
+        ring->slot_size = hdr.slot_size;
+        check_geometry(filename, type, ring->ring_size, ring->slot_size);
+
+        struct stat st;
+        if(fstat(ring->fd, &st) < 0 || (uint64_t)st.st_size < CAMIO_RING_HDR_SIZE + ring->ring_size){
+            eprintf_exit(CAMIO_ERR_NOT_A_RING, "Ring \"%s\" is smaller than its header says it should be\n", filename);
+        }
+    }
+
+    const int prot = writable || ring->created ? PROT_READ | PROT_WRITE : PROT_READ;
+    ring->map_size = camio_mmap_round(ring->fd, CAMIO_RING_HDR_SIZE + ring->ring_size);
+    ring->map = camio_mmap(ring->map_size, prot, ring->fd, &ring->mmap_opts, filename);
+
+    ring->hdr        = (volatile camio_ring_hdr_t*)ring->map;
+    ring->slots      = ring->map + CAMIO_RING_HDR_SIZE;
+    ring->slot_count = ring->slot_size ? ring->ring_size / ring->slot_size : 0;
+
+    if(ring->created){
+        ring->hdr->version   = CAMIO_RING_VERSION;
+        ring->hdr->type      = type;
+        ring->hdr->ring_size = ring->ring_size;
+        ring->hdr->slot_size = ring->slot_size;
+        __sync_synchronize(); //Everything else must be visible before the magic is
+        ring->hdr->magic     = CAMIO_RING_MAGIC;
+    }
+}
+
+
+void camio_ring_close(camio_ring_t* ring){
+    munmap((void*)ring->map, ring->map_size);
+    close(ring->fd);
+    ring->map   = NULL;
+    ring->hdr   = NULL;
+    ring->slots = NULL;
+    ring->fd    = -1;
+}
+
+
+//Take a reader out of the blocker and waiter counts. Each count is only dropped by whoever clears
+//the flag, so this is safe to race with the writer's sweep
+static void drop_counts(camio_ring_t* ring, volatile camio_ring_reader_t* entry){
+    if(__sync_lock_test_and_set(&entry->waiting, 0)){
+        __sync_fetch_and_sub(&ring->hdr->waiters, 1);
+    }
+    if(__sync_lock_test_and_set(&entry->blocking, 0)){
+        __sync_fetch_and_sub(&ring->hdr->blockers, 1);
+    }
+}
+
+
+//Try to take over a reader entry, which is currently owned by old_pid
+static int claim_reader(camio_ring_t* ring, int reader, uint64_t old_pid, uint64_t read_seq){
+    volatile camio_ring_reader_t* entry = &ring->hdr->readers[reader];
+    if(!__sync_bool_compare_and_swap(&entry->pid, old_pid, (uint64_t)getpid())){
+        return 0; //Somebody beat us to it
+    }
+
+    drop_counts(ring, entry); //A dead reader may have left itself counted
+    entry->lost = 0;
+    __atomic_store_n(&entry->read_seq, read_seq, __ATOMIC_RELEASE);
+    return 1;
+}
+
+
+int camio_ring_reader_register(camio_ring_t* ring, uint64_t read_seq){
+    int i = 0;
+    for(; i < CAMIO_RING_MAX_READERS; i++){
+        if(ring->hdr->readers[i].pid == 0 && claim_reader(ring, i, 0, read_seq)){
+            return i;
+        }
+    }
+
+    //Table is full, look for entries belonging to readers that have gone away without releasing them
+    for(i = 0; i < CAMIO_RING_MAX_READERS; i++){
+        const uint64_t pid = ring->hdr->readers[i].pid;
+        if(pid && kill((pid_t)pid, 0) < 0 && errno == ESRCH && claim_reader(ring, i, pid, read_seq)){
+            return i;
+        }
+    }
+
+    eprintf_exit(CAMIO_ERR_STREAMS_OVERRUN, "Ring already has the maximum number of readers (%u)\n", CAMIO_RING_MAX_READERS);
+    return -1;
+}
+
+
+void camio_ring_reader_release(camio_ring_t* ring, int reader){
+    const uint64_t read_seq = ring->hdr->readers[reader].read_seq;
+    __atomic_store_n(&ring->hdr->readers[reader].pid, 0, __ATOMIC_RELEASE);
+
+    //If we were the last reader of a lossless ring, the next one shouldn't redo what we've consumed
+    if((ring->hdr->flags & CAMIO_RING_FLAG_LOSSLESS) && camio_ring_slowest_reader(ring) == UINT64_MAX){
+        uint64_t tail = ring->hdr->read_tail;
+        while(tail < read_seq && !__sync_bool_compare_and_swap(&ring->hdr->read_tail, tail, read_seq)){
+            tail = ring->hdr->read_tail;
+        }
+    }
+}
+
+
+//Free the entry if the reader that owns it has gone away without releasing it. Returns non-zero if
+//the entry changed hands, so the caller should look again
+static int reap_dead_reader(camio_ring_t* ring, int reader){
+    volatile camio_ring_reader_t* entry = &ring->hdr->readers[reader];
+    const uint64_t pid = entry->pid;
+    if(!pid || kill((pid_t)pid, 0) == 0 || errno != ESRCH){
+        return 0;
+    }
+
+    const uint64_t read_seq = entry->read_seq;
+    drop_counts(ring, entry);
+    if(!__sync_bool_compare_and_swap(&entry->pid, pid, 0)){
+        return 1; //Somebody else reclaimed it first
+    }
+
+    //It was the slowest reader, so everything before read_seq has been consumed by everyone. Leave a
+    //note like release() does, in case it was the last one
+    if(ring->hdr->flags & CAMIO_RING_FLAG_LOSSLESS){
+        uint64_t tail = ring->hdr->read_tail;
+        while(tail < read_seq && !__sync_bool_compare_and_swap(&ring->hdr->read_tail, tail, read_seq)){
+            tail = ring->hdr->read_tail;
+        }
+    }
+
+    return 1;
+}
+
+
+uint64_t camio_ring_slowest_reader(camio_ring_t* ring){
+    while(1){
+        uint64_t slowest = UINT64_MAX;
+        int slowest_reader = -1;
+        int i = 0;
+        for(; i < CAMIO_RING_MAX_READERS; i++){
+            volatile camio_ring_reader_t* entry = &ring->hdr->readers[i];
+            if(!entry->pid){
+                continue;
+            }
+
+            const uint64_t read_seq = __atomic_load_n(&entry->read_seq, __ATOMIC_ACQUIRE);
+            if(read_seq < slowest){
+                slowest        = read_seq;
+                slowest_reader = i;
+            }
+        }
+
+        //A reader that crashed would hold everyone back forever. Only the one doing the holding back
+        //is worth a syscall to check on
+        if(slowest_reader < 0 || !reap_dead_reader(ring, slowest_reader)){
+            return slowest;
+        }
+    }
+}
+
+
+void camio_ring_blocker_add(camio_ring_t* ring, int reader){
+    ring->hdr->readers[reader].blocking = 1;
+    __sync_fetch_and_add(&ring->hdr->blockers, 1);
+}
+
+
+void camio_ring_blocker_remove(camio_ring_t* ring, int reader){
+    if(__sync_lock_test_and_set(&ring->hdr->readers[reader].blocking, 0)){
+        __sync_fetch_and_sub(&ring->hdr->blockers, 1);
+    }
+}
+
+
+uint32_t camio_ring_wait_begin(camio_ring_t* ring, int reader){
+    ring->hdr->readers[reader].waiting = 1;
+
+    //This is a full barrier, so the writer either sees us waiting or we see its data when we look again
+    __sync_fetch_and_add(&ring->hdr->waiters, 1);
+    return ring->hdr->wake_seq;
+}
+
+
+void camio_ring_wait_end(camio_ring_t* ring, int reader, uint32_t seen, int sleep){
+    if(sleep){
+        //Not FUTEX_PRIVATE, the writer is probably in another process. If the writer has been
+        //through since wait_begin() wake_seq has changed and this returns straight away
+        if(syscall(SYS_futex, &ring->hdr->wake_seq, FUTEX_WAIT, seen, NULL, NULL, 0) < 0 && errno != EAGAIN && errno != EINTR){
+            eprintf_exit(CAMIO_ERR_FILE_READ, "Could not wait on ring futex. Error=%s\n", strerror(errno));
+        }
+    }
+    if(__sync_lock_test_and_set(&ring->hdr->readers[reader].waiting, 0)){
+        __sync_fetch_and_sub(&ring->hdr->waiters, 1);
+    }
+}
+
+
+//Take readers that died while blocking out of the counts, so that we stop waking them up
+static void sweep_dead_sleepers(camio_ring_t* ring){
+    int i = 0;
+    for(; i < CAMIO_RING_MAX_READERS; i++){
+        volatile camio_ring_reader_t* entry = &ring->hdr->readers[i];
+        const uint64_t pid = entry->pid;
+        if(pid && (entry->waiting || entry->blocking) && kill((pid_t)pid, 0) < 0 && errno == ESRCH){
+            drop_counts(ring, entry);
+        }
+    }
+}
+
+
+void camio_ring_wake_waiters(camio_ring_t* ring){
+    __sync_synchronize(); //The commit must be visible before we look for sleepers
+    if(ring->hdr->waiters){
+        __sync_fetch_and_add(&ring->hdr->wake_seq, 1);
+
+        //Nobody woke up. Readers can be counted just before they sleep, so this is normally a race
+        //we lost, but it's also what a reader that died in its sleep looks like
+        if(syscall(SYS_futex, &ring->hdr->wake_seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0) == 0){
+            sweep_dead_sleepers(ring);
+        }
+    }
+}
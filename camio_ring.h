@@ -0,0 +1,162 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ shared memory ring, common to the ring istream and ostream
+ *
+ * The ring file starts with a header page describing the ring geometry, followed by ring_size
+ * bytes of data. There are two kinds of ring:
+ *
+ * - Slotted rings (ring:) are split into fixed size slots. Each slot ends with two 64bit words,
+ *   the length of the data and a sync count. A slot is committed when the writer updates the
+ *   sync count.
+ * - Variable rings (vring:) pack records back to back, each with a camio_vring_rec_t header and
+ *   padded to CAMIO_VRING_ALIGN. A record that won't fit before the end of the ring is preceded by
+ *   a padding record that fills the gap. Records are committed when the writer advances
+ *   write_pos in the ring header past them. Empty records are skipped by readers.
+ *
+ * Any number of readers (up to CAMIO_RING_MAX_READERS) can share a slotted ring. Each one claims an
+ * entry in the reader table in the header, where it publishes how far it has read and how many
+ * records it has lost to overruns. Readers join at the head of the ring.
+ *
+ * A slotted ring writer in lossless mode won't overwrite a slot until every registered reader has
+ * consumed it. If there are no readers it holds on to whatever hasn't been consumed yet (read_tail)
+ * and readers that join pick up from there, so nothing is dropped while a reader restarts. Readers
+ * that die without releasing their entry are released by the writer when they hold it up.
+ *
+ * Readers normally spin waiting for data. Readers opened with block=1 go to sleep on a futex in the
+ * header instead, after spinning for a while. The writer only makes the wake up syscall when it
+ * sees a reader is asleep, so busy rings stay syscall free. Blocking readers of variable rings take
+ * an entry in the reader table too, which records whether they are blocking and asleep. If a wake
+ * up finds nobody to wake, the writer looks for sleepers that died and takes them out of the
+ * counts, so a reader killed in its sleep doesn't cost the writer a syscall on every commit.
+ *
+ */
+
+#ifndef CAMIO_RING_H_
+#define CAMIO_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "camio_descr.h"
+#include "camio_mmap.h"
+
+#define CAMIO_RING_MAGIC 0x474E49524F494D43ULL     //"CMIORING"
+#define CAMIO_RING_VERSION 5
+#define CAMIO_RING_HDR_SIZE (4 * 1024)              //Header is a whole page so the slots stay page aligned
+
+#define CAMIO_RING_DEFAULT_SIZE (4 * 1024 * 1024)   //4MB
+#define CAMIO_RING_DEFAULT_SLOT_SIZE (4 * 1024)     //4K
+#define CAMIO_RING_SLOT_TRAILER (2 * sizeof(uint64_t)) //Length and sync count at the end of each slot
+
+#define CAMIO_RING_OPEN_TIMEOUT_US (1000 * 1000)    //How long to wait for the other side to finish creating the ring
+
+#define CAMIO_RING_TYPE_SLOT 1                      //Fixed size slots with a sync count
+#define CAMIO_RING_TYPE_VAR  2                      //Variable length records
+
+#define CAMIO_RING_FLAG_LOSSLESS 0x1                //The writer waits for readers rather than overwriting
+#define CAMIO_RING_MAX_READERS 32                  //Entries in the reader table, must fit in the header page
+#define CAMIO_RING_BLOCK_SPINS 4096                 //Blocking readers poll this many times before going to sleep
+
+#define CAMIO_VRING_ALIGN 16                        //Records start on this boundary, so there is always room for a header
+#define CAMIO_VRING_REC_PAD 0x1                     //Record flag, skip to the start of the ring
+
+typedef struct {
+    volatile uint64_t pid;              //Process that owns this entry, 0 if it's free
+    volatile uint64_t read_seq;         //Sequence number (sync count) of the next record this reader wants
+    volatile uint64_t lost;             //Records this reader has lost to overruns
+    volatile uint32_t blocking;         //Counted in blockers
+    volatile uint32_t waiting;          //Counted in waiters
+} __attribute__((aligned(64))) camio_ring_reader_t;
+
+typedef struct {
+    volatile uint64_t magic;            //Written last by the creator, once everything else is valid
+    uint64_t version;
+    uint64_t type;                      //CAMIO_RING_TYPE_*
+    uint64_t ring_size;                 //Bytes of data following the header
+    uint64_t slot_size;                 //Bytes per slot, including the trailer. Slotted rings only
+
+    //Writer state, kept on its own cache line
+    volatile uint64_t write_pos __attribute__((aligned(64))); //Variable rings, total bytes committed (not wrapped)
+    volatile uint64_t write_seq;        //Variable rings, sequence number of the next record. Slotted rings, last sync count committed
+    volatile uint64_t flags;            //CAMIO_RING_FLAG_*
+    volatile uint64_t read_tail;        //Lossless slotted rings, oldest sync count that hasn't been consumed
+
+    //Sleeping readers, on their own cache line because readers write to it
+    volatile uint32_t wake_seq __attribute__((aligned(64))); //Futex word, bumped by the writer to wake sleepers
+    volatile uint32_t waiters;          //Readers that are asleep, or about to be
+    volatile uint64_t blockers;         //Readers that might sleep. The writer ignores waiters if there are none
+
+    camio_ring_reader_t readers[CAMIO_RING_MAX_READERS]; //Slotted rings and blocking variable ring readers, one cache line per reader
+} camio_ring_hdr_t;
+
+typedef struct {
+    volatile uint64_t seq;              //Sequence number, starting at 1. Padding records have one too
+    uint32_t len;                       //Bytes of data following the header
+    uint32_t flags;                     //CAMIO_VRING_REC_*
+} camio_vring_rec_t;
+
+typedef struct {
+    int fd;
+    uint64_t type;
+    int created;                        //Did we create the ring file?
+    volatile uint8_t* map;              //Start of the mapping (the header)
+    size_t map_size;
+    volatile camio_ring_hdr_t* hdr;
+    volatile uint8_t* slots;            //Start of the data, the first slot for slotted rings
+    uint64_t ring_size;
+    uint64_t slot_size;
+    uint64_t slot_count;
+    camio_mmap_opts_t mmap_opts;        //huge=, populate=, lock= options
+} camio_ring_t;
+
+
+//Open (or create) the ring file named in the description and map it. The size= and slot= options
+//set the geometry when creating (eg size=64Mi,slot=9Ki), otherwise it is read from the header. If they are supplied and
+//the ring already exists, they must match what's there, as must the type. The camio_mmap options
+//are applied to the mapping, so streams should accept CAMIO_MMAP_OPTS too.
+void camio_ring_open(camio_ring_t* ring, const camio_descr_t* descr, uint64_t type, int writable);
+void camio_ring_close(camio_ring_t* ring);
+
+//Claim an entry in the reader table, starting it at read_seq. Entries left behind by readers that
+//died are reclaimed if the table is full, taking them out of the blocker and waiter counts. Returns
+//the entry index
+int camio_ring_reader_register(camio_ring_t* ring, uint64_t read_seq);
+void camio_ring_reader_release(camio_ring_t* ring, int reader);
+
+//The lowest read_seq of all registered readers, or UINT64_MAX if there are none. If the slowest
+//reader has died without releasing its entry, the entry is released and the search goes on
+uint64_t camio_ring_slowest_reader(camio_ring_t* ring);
+
+//Reader side of the sleep/wake protocol, for the reader table entry reader. Call wait_begin(), check
+//for data again, then call wait_end() with sleep set if there still isn't any
+void camio_ring_blocker_add(camio_ring_t* ring, int reader);
+void camio_ring_blocker_remove(camio_ring_t* ring, int reader);
+uint32_t camio_ring_wait_begin(camio_ring_t* ring, int reader);
+void camio_ring_wait_end(camio_ring_t* ring, int reader, uint32_t seen, int sleep);
+
+//Writer side, call after every commit
+void camio_ring_wake_waiters(camio_ring_t* ring);
+static inline void camio_ring_wake(camio_ring_t* ring){
+    if(__builtin_expect(ring->hdr->blockers != 0, 0)){
+        camio_ring_wake_waiters(ring);
+    }
+}
+
+static inline volatile uint8_t* camio_ring_slot(const camio_ring_t* ring, uint64_t index){
+    return ring->slots + index * ring->slot_size;
+}
+
+static inline volatile uint64_t* camio_ring_slot_len(const camio_ring_t* ring, volatile uint8_t* slot){
+    return (volatile uint64_t*)(slot + ring->slot_size - 2 * sizeof(uint64_t));
+}
+
+static inline volatile uint64_t* camio_ring_slot_sync(const camio_ring_t* ring, volatile uint8_t* slot){
+    return (volatile uint64_t*)(slot + ring->slot_size - 1 * sizeof(uint64_t));
+}
+
+static inline uint64_t camio_vring_rec_size(uint64_t len){
+    return (sizeof(camio_vring_rec_t) + len + CAMIO_VRING_ALIGN - 1) & ~(uint64_t)(CAMIO_VRING_ALIGN - 1);
+}
+
+#endif /* CAMIO_RING_H_ */
@@ -0,0 +1,87 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ kernel and hardware receive timestamps (SO_TIMESTAMPING), common to the socket streams
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+
+#include "camio_timestamp.h"
+#include "camio_errors.h"
+#include "camio_util.h"
+
+
+//Make sure the NIC stamps every packet it receives. Anything else it was doing (eg PTP event
+//packets only) is widened rather than replaced, and transmit stamping is left alone
+static void enable_hw(int sock_fd, const char* iface){
+    struct hwtstamp_config config;
+    memset(&config, 0, sizeof(config));
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(struct ifreq));
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ-1);
+    ifr.ifr_data = (void*)&config;
+    if(ioctl(sock_fd, SIOCGHWTSTAMP, &ifr) == 0 && config.rx_filter == HWTSTAMP_FILTER_ALL){
+        return;
+    }
+
+    config.flags     = 0;
+    config.rx_filter = HWTSTAMP_FILTER_ALL;
+    if(ioctl(sock_fd, SIOCSHWTSTAMP, &ifr) < 0){
+        wprintf(CAMIO_ERR_IOCTL, "Could not turn on hardware timestamps for \"%s\", hardware times will be 0 unless it's done elsewhere. Error = %s\n", iface, strerror(errno));
+    }
+}
+
+
+int camio_timestamp_open(int sock_fd, const camio_descr_t* descr, const char* iface){
+    const char* ts = camio_descr_get_opt(descr, "ts");
+    if(!ts){
+        return 0;
+    }
+
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if(strcmp(ts, "hw") == 0){
+        flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+        if(iface){
+            enable_hw(sock_fd, iface);
+        }
+    }
+    else if(strcmp(ts, "sw") != 0){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option \"ts\" expected sw or hw but \"%s\" found\n", ts);
+    }
+
+    if(setsockopt(sock_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0){
+        eprintf_exit(CAMIO_ERR_SOCK_OPT,"Receive timestamps are not supported. Error = %s\n",strerror(errno));
+    }
+
+    return 1;
+}
+
+
+static inline uint64_t to_ns(const struct timespec* ts){
+    return ts->tv_sec * 1000 * 1000 * 1000ULL + ts->tv_nsec;
+}
+
+
+int camio_timestamp_get(struct msghdr* hdr, camio_meta_t* meta){
+    memset(meta, 0, sizeof(camio_meta_t));
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
+    for(; cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)){
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPING){
+            struct scm_timestamping stamps;
+            memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+            meta->sw_ts = to_ns(&stamps.ts[0]);
+            meta->hw_ts = to_ns(&stamps.ts[2]); //ts[1] is deprecated
+            return 1;
+        }
+    }
+
+    return 0;
+}
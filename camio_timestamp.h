@@ -0,0 +1,36 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ kernel and hardware receive timestamps (SO_TIMESTAMPING), common to the socket streams
+ *
+ * ts=sw    Have the kernel stamp each record as it arrives in the network stack
+ * ts=hw    Have the NIC stamp each record as it arrives, as well as the kernel. The NIC's receive
+ *          stamping is turned on for all packets if it isn't already, which needs CAP_NET_ADMIN.
+ *          NICs that can't stamp leave the hardware time as 0
+ *
+ */
+
+#ifndef CAMIO_TIMESTAMP_H_
+#define CAMIO_TIMESTAMP_H_
+
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+
+#include "camio_descr.h"
+#include "camio_meta.h"
+
+//Option names, for the valid option lists of streams that use camio_timestamp_open()
+#define CAMIO_TIMESTAMP_OPTS "ts"
+
+//Room for the timestamps in a message's control data
+#define CAMIO_TIMESTAMP_CTRL_SIZE CMSG_SPACE(sizeof(struct scm_timestamping))
+
+//Turn on receive timestamps for sock_fd if the options ask for them. iface is the interface that
+//hardware stamping is turned on for, or NULL to leave that to someone else. Returns non-zero if
+//timestamps were turned on
+int camio_timestamp_open(int sock_fd, const camio_descr_t* descr, const char* iface);
+
+//Fill in meta from the control data of a received message. Returns non-zero if there were any
+int camio_timestamp_get(struct msghdr* hdr, camio_meta_t* meta);
+
+#endif /* CAMIO_TIMESTAMP_H_ */
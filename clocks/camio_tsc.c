@@ -0,0 +1,54 @@
+//#LINKFLAGS=-lrt
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ time stamp counter, for cheap timing in tight loops
+ *
+ */
+
+#include <time.h>
+
+#include "camio_tsc.h"
+
+#define CAMIO_TSC_CALIBRATE_NS (10 * 1000 * 1000ULL) //10ms is plenty to get within a fraction of a percent
+
+static double cycles_per_ns = 0;
+
+static inline uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ULL + ts.tv_nsec;
+}
+
+
+double camio_tsc_cycles_per_ns(void){
+    if(cycles_per_ns){
+        return cycles_per_ns;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    const uint64_t start_ns  = now_ns();
+    const uint64_t start_tsc = camio_tsc_read();
+    uint64_t end_ns = start_ns;
+    while(end_ns - start_ns < CAMIO_TSC_CALIBRATE_NS){
+        end_ns = now_ns();
+    }
+    const uint64_t end_tsc = camio_tsc_read();
+
+    cycles_per_ns = (double)(end_tsc - start_tsc) / (double)(end_ns - start_ns);
+#else
+    cycles_per_ns = 1.0;
+#endif
+
+    return cycles_per_ns;
+}
+
+
+uint64_t camio_tsc_ns_to_cycles(uint64_t ns){
+    return (uint64_t)(ns * camio_tsc_cycles_per_ns());
+}
+
+
+uint64_t camio_tsc_cycles_to_ns(uint64_t cycles){
+    return (uint64_t)(cycles / camio_tsc_cycles_per_ns());
+}
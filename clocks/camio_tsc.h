@@ -0,0 +1,31 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ time stamp counter, for cheap timing in tight loops
+ *
+ */
+
+#ifndef CAMIO_TSC_H_
+#define CAMIO_TSC_H_
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t camio_tsc_read(void){
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    //No TSC, fall back to the monotonic clock in ns
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ULL + ts.tv_nsec;
+#endif
+}
+
+double camio_tsc_cycles_per_ns(void);             //Calibrated against the monotonic clock on first use
+uint64_t camio_tsc_ns_to_cycles(uint64_t ns);
+uint64_t camio_tsc_cycles_to_ns(uint64_t cycles);
+
+#endif /* CAMIO_TSC_H_ */
@@ -9,12 +9,18 @@
 
 #include "camio_istream.h"
 #include "../camio_errors.h"
+#include "../camio_util.h"
+#include "../camio_erf.h"
 
 #include "camio_istream_log.h"
 #include "camio_istream_raw.h"
 #include "camio_istream_udp.h"
 #include "camio_istream_ring.h"
+#include "camio_istream_vring.h"
 #include "camio_istream_pcap.h"
+#include "camio_istream_pcapng.h"
+#include "camio_istream_erf.h"
+#include "camio_istream_replay.h"
 #include "camio_istream_periodic_timeout.h"
 #include "camio_istream_periodic_timeout_fast.h"
 #include "camio_istream_blob.h"
@@ -45,6 +51,9 @@ camio_istream_t* camio_istream_new(const char* description, void* parameters){
     else if(strcmp(descr.protocol,"ring") == 0 ){
         result = camio_istream_ring_new(&descr,parameters);
     }
+    else if(strcmp(descr.protocol,"vring") == 0 ){
+        result = camio_istream_vring_new(&descr,parameters);
+    }
     else if(strcmp(descr.protocol,"udp") == 0 ){
         result = camio_istream_udp_new(&descr,parameters);
     }
@@ -57,10 +66,18 @@ camio_istream_t* camio_istream_new(const char* description, void* parameters){
     else if(strcmp(descr.protocol,"blob") == 0 ){
         result = camio_istream_blob_new(&descr,parameters);
     }
-
-//    else if(strcmp(descr.protocol,"pcap") == 0 ){
-//        result = camio_istream_pcap_new(&descr,NULL);
-//    }
+    else if(strcmp(descr.protocol,"pcap") == 0 ){
+        result = camio_istream_pcap_new(&descr,parameters);
+    }
+    else if(strcmp(descr.protocol,"pcapng") == 0 ){
+        result = camio_istream_pcapng_new(&descr,parameters);
+    }
+    else if(strcmp(descr.protocol,"erf") == 0 ){
+        result = camio_istream_erf_new(&descr,parameters);
+    }
+    else if(strcmp(descr.protocol,"replay") == 0 ){
+        result = camio_istream_replay_new(&descr,parameters);
+    }
 //#ifdef HAVE_DAG_
     else if(strcmp(descr.protocol,"dag") == 0 ){
         result = camio_istream_dag_new(&descr,parameters);
@@ -82,3 +99,40 @@ camio_istream_t* camio_istream_new(const char* description, void* parameters){
 }
 
 
+
+//Streams that reuse a single buffer can only hand out one item per batch
+int64_t camio_istream_start_read_batch_generic(camio_istream_t* this, camio_iovec_t* out, size_t max){
+    if(unlikely(!max)){
+        return 0;
+    }
+
+    out[0].len = this->start_read(this, &out[0].buff);
+    return out[0].len ? 1 : 0;
+}
+
+
+int64_t camio_istream_end_read_batch_generic(camio_istream_t* this, size_t count){
+    if(unlikely(!count)){
+        return 0;
+    }
+
+    return this->end_read(this, NULL);
+}
+
+
+int64_t camio_istream_read_meta_none(camio_istream_t* this, const uint8_t* buff, camio_meta_t* meta){
+    memset(meta, 0, sizeof(camio_meta_t));
+    return 0;
+}
+
+
+//The capture card stamped the record as it arrived
+int64_t camio_istream_read_meta_erf(camio_istream_t* this, const uint8_t* buff, camio_meta_t* meta){
+    memset(meta, 0, sizeof(camio_meta_t));
+    if(unlikely(!buff)){
+        return 0;
+    }
+
+    meta->hw_ts = camio_erf_ts_to_units(((const dag_record_t*)buff)->ts, 9, 0);
+    return 1;
+}
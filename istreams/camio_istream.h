@@ -11,6 +11,8 @@
 #include <unistd.h>
 
 #include "../camio_descr.h"
+#include "../camio_iovec.h"
+#include "../camio_meta.h"
 
 struct camio_istream;
 typedef struct camio_istream camio_istream_t;
@@ -22,6 +24,9 @@ struct camio_istream{
      int64_t (*ready)(camio_istream_t* this);                         //Returns non-zero if a call to start_read will be non-blocking
      int64_t (*start_read)(camio_istream_t* this, uint8_t** out_bytes);  //Returns the number of bytes available to read, this can be 0. If bytes available is non-zero, out_bytes has a pointer to the start of the bytes to read
      int64_t (*end_read)(camio_istream_t* this, uint8_t* free_buff);     //Returns 0 if the contents of out_bytes have NOT changed since the call to start_read. For buffers this may fail, if this is the case, data read in start_read maybe corrupt.
+     int64_t (*start_read_batch)(camio_istream_t* this, camio_iovec_t* out, size_t max); //Returns the number of items (up to max) available to read, blocking like start_read until there is at least one
+     int64_t (*end_read_batch)(camio_istream_t* this, size_t count);     //Release the first count items returned by start_read_batch. Returns 0 if none of them changed since start_read_batch
+     int64_t (*read_meta)(camio_istream_t* this, const uint8_t* buff, camio_meta_t* meta); //Fill in meta for a record from start_read or start_read_batch that hasn't been released yet, buff is its start. Returns 0 if the stream has none for it, and meta is zeroed
      void(*delete)(camio_istream_t* this);                        //Closes the stream and deletes the memory used
      int64_t fd;                                                     //Expose the file descriptor to the outside world, useful for selectors
      void* priv;
@@ -29,4 +34,12 @@ struct camio_istream{
 
 camio_istream_t* camio_istream_new(const char* description,  void* parameters);
 
+//Generic batch fallbacks for streams that can only have one read outstanding at a time
+int64_t camio_istream_start_read_batch_generic(camio_istream_t* this, camio_iovec_t* out, size_t max);
+int64_t camio_istream_end_read_batch_generic(camio_istream_t* this, size_t count);
+
+//Generic metadata for streams that don't have any, and for streams whose records are ERF records
+int64_t camio_istream_read_meta_none(camio_istream_t* this, const uint8_t* buff, camio_meta_t* meta);
+int64_t camio_istream_read_meta_erf(camio_istream_t* this, const uint8_t* buff, camio_meta_t* meta);
+
 #endif /* CAMIO_ISTREAM_H_ */
@@ -14,6 +14,7 @@
 #include <sys/stat.h>
 
 #include "camio_istream_blob.h"
+#include "../camio_mmap.h"
 #include "../camio_errors.h"
 #include "../camio_util.h"
 
@@ -21,9 +22,8 @@
 int64_t camio_istream_blob_open(camio_istream_t* this, const camio_descr_t* descr ){
     camio_istream_blob_t* priv = this->priv;
 
-    if(unlikely((size_t)descr->opt_head)){
-        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option(s) supplied, but none expected\n");
-    }
+    const char* valid_opts[] = { CAMIO_MMAP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
 
     if(unlikely(!descr->query)){
         eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
@@ -42,10 +42,9 @@ int64_t camio_istream_blob_open(camio_istream_t* this, const camio_descr_t* desc
     if(priv->blob_size)
     {
         //Map the whole thing into memory
-        priv->blob = mmap( NULL, priv->blob_size, PROT_READ, MAP_SHARED, this->fd, 0);
-        if(unlikely(priv->blob == MAP_FAILED)){
-            eprintf_exit(CAMIO_ERR_MMAP, "Could not memory map blob file \"%s\". Error=%s\n", descr->query, strerror(errno));
-        }
+        camio_mmap_opts_t mmap_opts;
+        camio_mmap_get_opts(descr, &mmap_opts);
+        priv->blob = camio_mmap(priv->blob_size, PROT_READ, this->fd, &mmap_opts, descr->query);
 
         priv->is_closed = 0;
     }
@@ -137,6 +136,9 @@ camio_istream_t* camio_istream_blob_construct(camio_istream_blob_t* priv, const
     priv->istream.close         = camio_istream_blob_close;
     priv->istream.start_read    = camio_istream_blob_start_read;
     priv->istream.end_read      = camio_istream_blob_end_read;
+    priv->istream.start_read_batch = camio_istream_start_read_batch_generic;
+    priv->istream.end_read_batch   = camio_istream_end_read_batch_generic;
+    priv->istream.read_meta     = camio_istream_read_meta_none;
     priv->istream.ready         = camio_istream_blob_ready;
     priv->istream.delete        = camio_istream_blob_delete;
     priv->istream.fd            = -1;
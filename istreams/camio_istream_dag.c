@@ -73,6 +73,18 @@ void camio_istream_dag_close(camio_istream_t* this){
 
 
 
+//Is there a whole record between bottom and top?
+static inline size_t record_waiting(camio_istream_dag_t* priv, uint8_t* record){
+    const size_t avail = priv->top - record;
+    if(avail < dag_record_size){
+        return 0;
+    }
+
+    const size_t rlen = ntohs(((dag_record_t*)record)->rlen);
+    return avail >= rlen ? rlen : 0;
+}
+
+
 static int64_t prepare_next(camio_istream_t* this){
     camio_istream_dag_t* priv = this->priv;
 
@@ -81,21 +93,29 @@ static int64_t prepare_next(camio_istream_t* this){
         return priv->data_size;
     }
 
-    //Is there new data?
-    dag_record_t* data = (dag_record_t*)dag_rx_stream_next_record(this->fd, priv->dag_stream);
-    if( likely((size_t)data)){
-        //Is this an ERF? Or did something wierd happen?
-        if ( unlikely(data->type == 0)){
-            wprintf(CAMIO_ERR_NOT_AN_ERF, "Not ERF payload \n");
+    //Is there new data? Free the records we've finished with and ask the card for more
+    if(!record_waiting(priv, priv->bottom)){
+        priv->top = dag_advance_stream(this->fd, priv->dag_stream, &priv->bottom);
+        if(unlikely(!priv->top)){
+            eprintf_exit(CAMIO_ERR_FILE_READ, "Could not advance dag stream \"%lu\". Error=%s\n", priv->dag_stream, strerror(errno));
+        }
+
+        if(!record_waiting(priv, priv->bottom)){
             return 0;
         }
+    }
 
-        priv->dag_data = data;
-        priv->data_size = ntohs(data->rlen);
-        return priv->data_size;
+    dag_record_t* data = (dag_record_t*)priv->bottom;
+
+    //Is this an ERF? Or did something wierd happen?
+    if ( unlikely(data->type == 0)){
+        wprintf(CAMIO_ERR_NOT_AN_ERF, "Not ERF payload \n");
+        return 0;
     }
 
-    return 0;
+    priv->dag_data = data;
+    priv->data_size = ntohs(data->rlen);
+    return priv->data_size;
 }
 
 int64_t camio_istream_dag_ready(camio_istream_t* this){
@@ -139,6 +159,55 @@ int64_t camio_istream_dag_start_read(camio_istream_t* this, uint8_t** out){
 
 int64_t camio_istream_dag_end_read(camio_istream_t* this, uint8_t* free_buff){
     camio_istream_dag_t* priv = this->priv;
+    priv->bottom += priv->data_size; //The space is only given back to the card on the next advance
+    priv->data_size = 0;
+    priv->dag_data = NULL;
+    return 0;
+}
+
+
+//Walk all of the complete records that are already in the stream buffer
+int64_t camio_istream_dag_start_read_batch(camio_istream_t* this, camio_iovec_t* out, size_t max){
+    camio_istream_dag_t* priv = this->priv;
+
+    if(unlikely(priv->is_closed || !max)){
+        return 0;
+    }
+
+    //Called read without calling ready, they must want to block/spin waiting for data
+    if(unlikely(!priv->data_size)){
+        while(!prepare_next(this)){
+            __asm__ __volatile__("pause"); //Tell the CPU we're spinning
+        }
+    }
+
+    uint8_t* record = priv->bottom;
+    size_t rlen     = priv->data_size;
+    size_t count    = 0;
+    for(; count < max && rlen; count++){
+        if(unlikely(((dag_record_t*)record)->type == 0)){
+            break; //Leave it for prepare_next to complain about
+        }
+
+        out[count].buff = record;
+        out[count].len  = rlen;
+
+        record += rlen;
+        rlen    = record_waiting(priv, record);
+    }
+
+    return count;
+}
+
+
+int64_t camio_istream_dag_end_read_batch(camio_istream_t* this, size_t count){
+    camio_istream_dag_t* priv = this->priv;
+
+    size_t i = 0;
+    for(; i < count; i++){
+        priv->bottom += ntohs(((dag_record_t*)priv->bottom)->rlen);
+    }
+
     priv->data_size = 0;
     priv->dag_data = NULL;
     return 0;
@@ -165,6 +234,8 @@ camio_istream_t* camio_istream_dag_construct(camio_istream_dag_t* priv, const ca
     priv->dag_stream        = 0;
     priv->dag_data          = NULL;
     priv->data_size			= 0;
+    priv->bottom            = NULL;
+    priv->top               = NULL;
     priv->params            = params;
 
     //Populate the function members
@@ -173,6 +244,9 @@ camio_istream_t* camio_istream_dag_construct(camio_istream_dag_t* priv, const ca
     priv->istream.close         = camio_istream_dag_close;
     priv->istream.start_read    = camio_istream_dag_start_read;
     priv->istream.end_read      = camio_istream_dag_end_read;
+    priv->istream.start_read_batch = camio_istream_dag_start_read_batch;
+    priv->istream.end_read_batch   = camio_istream_dag_end_read_batch;
+    priv->istream.read_meta     = camio_istream_read_meta_erf;
     priv->istream.ready         = camio_istream_dag_ready;
     priv->istream.delete        = camio_istream_dag_delete;
     priv->istream.fd            = -1;
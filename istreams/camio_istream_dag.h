@@ -25,6 +25,8 @@ typedef struct {
     int dag_stream;
     void* dag_data;
     size_t data_size;
+    uint8_t* bottom;                    //Start of the unread records in the stream buffer
+    uint8_t* top;                       //End of the records the card has delivered so far
     camio_istream_t istream;
     camio_istream_dag_params_t* params;  //Parameters passed in from the outside
 
@@ -0,0 +1,189 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ ERF file input stream
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "camio_istream_erf.h"
+#include "../camio_mmap.h"
+#include "../camio_errors.h"
+#include "../camio_util.h"
+
+#include "../dag/dagapi.h"
+#include "../dag/dagerf.h"
+
+
+int64_t camio_istream_erf_open(camio_istream_t* this, const camio_descr_t* descr ){
+    camio_istream_erf_t* priv = this->priv;
+
+    const char* valid_opts[] = { CAMIO_MMAP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+
+    if(unlikely(!descr->query)){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
+    }
+
+    this->fd = open(descr->query, O_RDONLY);
+    if(unlikely(this->fd < 0)){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\". Error=%s\n", descr->query, strerror(errno));
+    }
+
+    struct stat st;
+    if(fstat(this->fd, &st) < 0){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not stat file \"%s\". Error=%s\n", descr->query, strerror(errno));
+    }
+    priv->file_size = st.st_size;
+    priv->offset    = 0;
+
+    if(priv->file_size){
+        camio_mmap_opts_t mmap_opts;
+        camio_mmap_get_opts(descr, &mmap_opts);
+        priv->file = camio_mmap(priv->file_size, PROT_READ, this->fd, &mmap_opts, descr->query);
+    }
+
+    priv->is_closed = 0;
+    return CAMIO_ERR_NONE;
+}
+
+
+void camio_istream_erf_close(camio_istream_t* this){
+    camio_istream_erf_t* priv = this->priv;
+    if(priv->is_closed){
+        return;
+    }
+    if(priv->file){
+        munmap((void*)priv->file, priv->file_size);
+    }
+    close(this->fd);
+    priv->file      = NULL;
+    priv->is_closed = 1;
+}
+
+
+//Take the next record out of the file, returns its length or 0 at the end of the file
+static inline size_t next_record(camio_istream_erf_t* priv, uint8_t** out){
+    while(likely(!priv->is_closed && priv->offset + dag_record_size <= priv->file_size)){
+        uint8_t* record = priv->file + priv->offset;
+        const size_t rlen = dagerf_get_length(record);
+        if(unlikely(!dagerf_is_known_type(record) || rlen < dag_record_size)){
+            eprintf_exit(CAMIO_ERR_NOT_AN_ERF, "Corrupt ERF record at offset %lu (type=%u, rlen=%lu)\n", priv->offset, record[8], rlen);
+        }
+        if(unlikely(priv->offset + rlen > priv->file_size)){
+            wprintf(CAMIO_ERR_FILE_READ, "ERF file ends part way through a record, ignoring the last %lu bytes\n", priv->file_size - priv->offset);
+            priv->offset = priv->file_size;
+            return 0;
+        }
+
+        priv->offset += rlen;
+
+        //The card pads its stream out with these, there's nothing in them
+        if(likely(((dag_record_t*)record)->type != TYPE_PAD)){
+            *out = record;
+            return rlen;
+        }
+    }
+
+    if(unlikely(!priv->is_closed && priv->offset < priv->file_size)){
+        wprintf(CAMIO_ERR_FILE_READ, "ERF file ends part way through a record, ignoring the last %lu bytes\n", priv->file_size - priv->offset);
+        priv->offset = priv->file_size;
+    }
+    return 0;
+}
+
+
+int64_t camio_istream_erf_ready(camio_istream_t* this){
+    return 1; //Reading from memory never blocks, at the end of the file reads just return nothing
+}
+
+
+int64_t camio_istream_erf_start_read(camio_istream_t* this, uint8_t** out){
+    camio_istream_erf_t* priv = this->priv;
+    *out = NULL;
+    return next_record(priv, out);
+}
+
+
+int64_t camio_istream_erf_end_read(camio_istream_t* this, uint8_t* free_buff){
+    return 0; //Always true for memory I/O
+}
+
+
+//The whole file is mapped, so as many records as are wanted can be handed out at once
+int64_t camio_istream_erf_start_read_batch(camio_istream_t* this, camio_iovec_t* out, size_t max){
+    camio_istream_erf_t* priv = this->priv;
+
+    size_t i = 0;
+    for(; i < max; i++){
+        out[i].len = next_record(priv, &out[i].buff);
+        if(!out[i].len){
+            break;
+        }
+    }
+
+    return i;
+}
+
+
+int64_t camio_istream_erf_end_read_batch(camio_istream_t* this, size_t count){
+    return 0; //Always true for memory I/O
+}
+
+
+void camio_istream_erf_delete(camio_istream_t* this){
+    this->close(this);
+    camio_istream_erf_t* priv = this->priv;
+    free(priv);
+}
+
+/* ****************************************************
+ * Construction
+ */
+
+camio_istream_t* camio_istream_erf_construct(camio_istream_erf_t* priv, const camio_descr_t* descr, camio_istream_erf_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"erf stream supplied is null\n");
+    }
+
+    //Initialize the local variables
+    priv->is_closed         = 1;
+    priv->file              = NULL;
+    priv->file_size         = 0;
+    priv->offset            = 0;
+    priv->params            = params;
+
+    //Populate the function members
+    priv->istream.priv          = priv; //Lets us access private members
+    priv->istream.open          = camio_istream_erf_open;
+    priv->istream.close         = camio_istream_erf_close;
+    priv->istream.start_read    = camio_istream_erf_start_read;
+    priv->istream.end_read      = camio_istream_erf_end_read;
+    priv->istream.start_read_batch = camio_istream_erf_start_read_batch;
+    priv->istream.end_read_batch   = camio_istream_erf_end_read_batch;
+    priv->istream.read_meta     = camio_istream_read_meta_erf;
+    priv->istream.ready         = camio_istream_erf_ready;
+    priv->istream.delete        = camio_istream_erf_delete;
+    priv->istream.fd            = -1;
+
+    //Call open, because its the obvious thing to do now...
+    priv->istream.open(&priv->istream, descr);
+
+    //Return the generic istream interface for the outside world to use
+    return &priv->istream;
+
+}
+
+camio_istream_t* camio_istream_erf_new( const camio_descr_t* descr, camio_istream_erf_params_t* params){
+    camio_istream_erf_t* priv = malloc(sizeof(camio_istream_erf_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for erf istream creation\n");
+    }
+    return camio_istream_erf_construct(priv, descr, params);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ ERF file input stream
+ *
+ * Reads a file of ERF records, as the DAG and ExaNIC istreams hand them out, so that anything
+ * built on those can be run from a capture file without the hardware. The whole file is mapped into
+ * memory and each read hands out a pointer to one record straight from the mapping. Records are
+ * checked as they are walked, padding records are skipped.
+ *
+ * Options:
+ * The mmap options (see camio_mmap.h)
+ *
+ */
+
+#ifndef CAMIO_ISTREAM_ERF_H_
+#define CAMIO_ISTREAM_ERF_H_
+
+#include "camio_istream.h"
+
+/********************************************************************
+ *                  PRIVATE DEFS
+ ********************************************************************/
+
+typedef struct {
+    //No params at this stage
+} camio_istream_erf_params_t;
+
+typedef struct {
+    camio_istream_t istream;
+    int is_closed;                      //Has close be called?
+    uint8_t* file;                      //Pointer to the head of the mapped file
+    size_t file_size;                   //Size of the mapping
+    uint64_t offset;                    //Offset of the next record in the file
+    camio_istream_erf_params_t* params;  //Parameters passed in from the outside
+
+} camio_istream_erf_t;
+
+
+
+/********************************************************************
+ *                  PUBLIC DEFS
+ ********************************************************************/
+
+camio_istream_t* camio_istream_erf_new( const camio_descr_t* opts,  camio_istream_erf_params_t* params);
+
+
+#endif /* CAMIO_ISTREAM_ERF_H_ */
@@ -31,6 +31,7 @@
 #include "../camio_errors.h"
 #include "../camio_util.h"
 #include "../clocks/camio_time.h"
+#include "../camio_erf.h"
 
 #include "camio/dag/dagapi.h"
 
@@ -150,17 +151,21 @@ static int64_t prepare_next(camio_istream_t* this){
 
         ssize_t result = exanic_receive_frame(priv->exanic_rx[p], ether_head, DATA_BUFF- ether_head_offset,  &timestamp_lo);
         if(result > 0){
-            const uint64_t timestamp = exanic_timestamp_to_counter(priv->exanic, timestamp_lo);
-            erf->ts    = timestamp; //HACK! Note this shoudld be in fixed point format..
-            erf->type  = 0; //Hack? Maybe should have something here?
+            const uint64_t counter = exanic_timestamp_to_counter(priv->exanic, timestamp_lo);
+            struct timespec timestamp;
+            exanic_counter_to_timespec(priv->exanic, counter, &timestamp);
+            erf->ts    = camio_erf_ts_from_timespec(timestamp.tv_sec, timestamp.tv_nsec);
+            erf->type  = TYPE_ETH;
+            memset(&erf->flags, 0, sizeof(erf->flags));
             erf->flags.iface = p; //Low bits are the port number
-            erf->flags.reserved = 1; //Tell the reciever this is an unusual timestamp
             erf->rlen  = htons(ether_head_offset +  result);
             erf->lctr  = 0;
             erf->wlen  = htons((uint16_t)result);
+            erf->rec.eth.offset = 0;
+            erf->rec.eth.pad    = 0;
 
             priv->port = p + 1;
-            priv->data_size = result;
+            priv->data_size = ether_head_offset + result; //The whole record, like the DAG istream
             //printf("Got data of size =%li on port =%i\n",priv->data_size,p);
             return priv->data_size;
         }
@@ -242,6 +247,9 @@ camio_istream_t* camio_istream_exa_construct(camio_istream_exa_t* priv, const ca
     priv->istream.close         = camio_istream_exa_close;
     priv->istream.start_read    = camio_istream_exa_start_read;
     priv->istream.end_read      = camio_istream_exa_end_read;
+    priv->istream.start_read_batch = camio_istream_start_read_batch_generic;
+    priv->istream.end_read_batch   = camio_istream_end_read_batch_generic;
+    priv->istream.read_meta     = camio_istream_read_meta_erf;
     priv->istream.ready         = camio_istream_exa_ready;
     priv->istream.delete        = camio_istream_exa_delete;
     priv->istream.fd            = -1;
@@ -3,24 +3,36 @@
  *
  * Fe2+ log (newline separated) input stream
  *
+ * With mmap=1 a regular file is mapped whole and lines are handed out as pointers straight into
+ * the mapping, with no copying. Otherwise data is read() into a line buffer. With aio=1 the reads
+ * are done asynchronously, ahead of the lines being consumed (see camio_aio.h).
+ *
  */
 #include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
 #include "camio_istream_log.h"
 #include "../camio_errors.h"
+#include "../camio_util.h"
+#include "../parsing/escape.h"
 
 #define CAMIO_ISTREAM_ISTREAM_LOG_BUFF_INIT 4096
 
 int64_t camio_istream_log_open(camio_istream_t* this, const camio_descr_t* descr ){
     camio_istream_log_t* priv = this->priv;
 
-    if(descr->opt_head){
-        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option(s) supplied, but none expected\n");
-    }
+    const char* valid_opts[] = { "escape", "mmap", CAMIO_MMAP_OPTS, CAMIO_AIO_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+    priv->escape = camio_descr_get_opt_bool(descr, "escape", 0);
 
     priv->line_buffer = malloc(CAMIO_ISTREAM_ISTREAM_LOG_BUFF_INIT);
     if(!priv->line_buffer){
@@ -48,6 +60,40 @@ int64_t camio_istream_log_open(camio_istream_t* this, const camio_descr_t* descr
         printf("\"%s\"",descr->query);
         eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\"\n", descr->query);
     }
+
+    struct stat st;
+    if(fstat(this->fd, &st) < 0){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not stat file \"%s\". Error=%s\n", descr->query, strerror(errno));
+    }
+    priv->is_regular = S_ISREG(st.st_mode);
+
+    if(camio_descr_get_opt_bool(descr, "mmap", 0)){
+        if(!priv->is_regular){
+            eprintf_exit(CAMIO_ERR_MMAP, "Cannot use mmap=1 with \"%s\", it is not a regular file\n", descr->query);
+        }
+
+        priv->map_size = st.st_size;
+        if(priv->map_size){
+            camio_mmap_opts_t mmap_opts;
+            camio_mmap_get_opts(descr, &mmap_opts);
+            priv->map = camio_mmap(priv->map_size, PROT_READ, this->fd, &mmap_opts, descr->query);
+            madvise(priv->map, priv->map_size, MADV_SEQUENTIAL);
+        }
+        priv->map_offset = 0;
+        priv->is_mapped  = 1;
+    }
+    else{
+        camio_aio_opts_t aio_opts;
+        camio_aio_get_opts(descr, &aio_opts);
+        if(aio_opts.aio){
+            if(!priv->is_regular){
+                eprintf_exit(CAMIO_ERR_FILE_OPEN, "Cannot use aio=1 with \"%s\", it is not a regular file\n", descr->query);
+            }
+            camio_aio_init(&priv->aio, this->fd, 0, aio_opts.depth, CAMIO_AIO_READ_SIZE, 0);
+            priv->is_async = 1;
+        }
+    }
+
     priv->is_closed = 0;
     return CAMIO_ERR_NONE;
 }
@@ -55,6 +101,14 @@ int64_t camio_istream_log_open(camio_istream_t* this, const camio_descr_t* descr
 
 void camio_istream_log_close(camio_istream_t* this){
     camio_istream_log_t* priv = this->priv;
+    if(priv->map){
+        munmap(priv->map, priv->map_size);
+        priv->map = NULL;
+    }
+    if(priv->is_async){
+        camio_aio_destroy(&priv->aio);
+        priv->is_async = 0;
+    }
     close(this->fd);
     priv->is_closed = 1;
 }
@@ -81,12 +135,26 @@ static inline void set_fd_blocking(int fd, int blocking){
 
 static int64_t read_to_buff(camio_istream_log_t* priv, uint8_t* new_data_ptr, int blocking){
 
-    //Set the file blocking mode as requested
-    set_fd_blocking(priv->istream.fd,blocking);
+    //Set the file blocking mode as requested. Only when it changes, and never for regular files
+    //which don't have one
+    if(!priv->is_regular && priv->fd_blocking != blocking){
+        set_fd_blocking(priv->istream.fd,blocking);
+        priv->fd_blocking = blocking;
+    }
 
     //Read the data
     size_t amount = (priv->line_buffer + priv->line_buffer_size -1) - new_data_ptr;
-    int bytes = read(priv->istream.fd,new_data_ptr,amount);
+    int64_t bytes = 0;
+    if(priv->is_async){
+        //Comes out of data the disk has already read ahead for us
+        bytes = camio_aio_read(&priv->aio, new_data_ptr, amount, blocking);
+        if(bytes < 0){
+            return 0; //Not there yet, and we don't want to wait
+        }
+    }
+    else{
+        bytes = read(priv->istream.fd,new_data_ptr,amount);
+    }
 
     //Was there some error
     if(bytes < 0){
@@ -110,64 +178,102 @@ static int64_t read_to_buff(camio_istream_log_t* priv, uint8_t* new_data_ptr, in
 }
 
 
-int ascii_hex_to_int(uint8_t a){
-    switch(a){
-        case '0': return 0x0;
-        case '1': return 0x1;
-        case '2': return 0x2;
-        case '3': return 0x3;
-        case '4': return 0x4;
-        case '5': return 0x5;
-        case '6': return 0x6;
-        case '7': return 0x7;
-        case '8': return 0x8;
-        case '9': return 0x9;
-        case 'a': return 0xa;
-        case 'b': return 0xb;
-        case 'c': return 0xc;
-        case 'd': return 0xd;
-        case 'e': return 0xe;
-        case 'f': return 0xf;
-        case 'A': return 0xA;
-        case 'B': return 0xB;
-        case 'C': return 0xC;
-        case 'D': return 0xD;
-        case 'E': return 0xE;
-        case 'F': return 0xF;
-        default:
-            return -1;
+//Line ending scanners. Each returns the offset of the first '\n' or '\r' in buff, or len if there isn't one
+static size_t scan_eol_scalar(const uint8_t* buff, size_t len){
+    size_t i = 0;
+    for(; i < len; i++){
+        if(buff[i] == '\n' || buff[i] == '\r'){
+            return i;
+        }
     }
+    return len;
 }
 
-size_t unescape(uint8_t* buffer, size_t size){
-    size_t result = size;
-    size_t read = 0;
-    size_t write = 0;
-    for(;read < size -3; read++, write++){
-        //Look for escaped characters
-        //check for the pattern \x1A
+#ifdef __x86_64__
+static size_t scan_eol_sse2(const uint8_t* buff, size_t len){
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+
+    size_t i = 0;
+    for(; i + sizeof(__m128i) <= len; i += sizeof(__m128i)){
+        const __m128i data = _mm_loadu_si128((const __m128i*)(buff + i));
+        const uint32_t mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(data, nl), _mm_cmpeq_epi8(data, cr)));
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+    }
 
-        int lower = ascii_hex_to_int(buffer[read+2]);
-        int upper = ascii_hex_to_int(buffer[read+3]);
+    return i + scan_eol_scalar(buff + i, len - i);
+}
 
-        if((buffer[read+0] == '\\') &&
-           (buffer[read+1] == 'x' || buffer[read+1] == 'X') &&
-           (lower > -1)  &&
-           (upper > -1) ){
-            buffer[write] = upper << 4 & lower;
-            read += 3; //Jump read to the next valid char
-            result -= 3; //Shrink the size of the buffer
-         }
+__attribute__((target("avx2")))
+static size_t scan_eol_avx2(const uint8_t* buff, size_t len){
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+
+    size_t i = 0;
+    for(; i + sizeof(__m256i) <= len; i += sizeof(__m256i)){
+        const __m256i data = _mm256_loadu_si256((const __m256i*)(buff + i));
+        const uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(data, nl), _mm256_cmpeq_epi8(data, cr)));
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
     }
 
-    return result;
+    return i + scan_eol_sse2(buff + i, len - i);
+}
+#endif
+
+//Picked once at construction time, depending on what the CPU can do
+static size_t (*scan_eol)(const uint8_t* buff, size_t len) = scan_eol_scalar;
+
+static void init_scan_eol(void){
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    scan_eol = __builtin_cpu_supports("avx2") ? scan_eol_avx2 : scan_eol_sse2;
+#endif
 }
 
 
+//A line ending was found at offset eol in data. Work out how long the line is, including the line
+//ending, which may be \r\n
+static inline int64_t found_line(camio_istream_log_t* priv, const uint8_t* data, size_t eol, size_t count){
+    size_t eol_size = 1;
+    if(data[eol] == '\r' && eol + 1 < count && data[eol + 1] == '\n'){ //Handle windows style line feeds
+        eol_size = 2;
+    }
+
+    priv->read_size = eol + eol_size;
+    priv->line_size = eol;
+    return priv->read_size;
+}
+
 
+static int64_t prepare_next_mapped(camio_istream_log_t* priv){
+    const size_t remaining = priv->map_size - priv->map_offset;
+    if(!remaining){
+        priv->istream.close(&priv->istream);
+        return 0;
+    }
+
+    const uint8_t* data = priv->map + priv->map_offset;
+    const size_t eol = scan_eol(data, remaining);
+    if(eol == remaining){
+        //Last line, with no line ending
+        priv->read_size = remaining;
+        priv->line_size = remaining;
+        return remaining;
+    }
+
+    return found_line(priv, data, eol, remaining);
+}
 
 
 static int64_t prepare_next(camio_istream_log_t* priv, int blocking){
+    if(priv->is_mapped){
+        return prepare_next_mapped(priv);
+    }
+
     if(!priv->line_buffer_count){
         priv->data_head_ptr = priv->line_buffer;
         int bytes = read_to_buff(priv,priv->data_head_ptr, blocking);
@@ -178,24 +284,13 @@ static int64_t prepare_next(camio_istream_log_t* priv, int blocking){
     }
 
     while(1){
-        //Unescape the whole buffer first
-        if(priv->escape){
-            priv->line_buffer_count = unescape(priv->data_head_ptr, priv->line_buffer_count);
-        }
-
-        size_t i = 0;
-        for(;i < priv->line_buffer_count; i++){
-
-            //Search for a newline in the file
-            if(priv->data_head_ptr[i] == '\n' || priv->data_head_ptr[i] == '\r'){
-                if(priv->data_head_ptr[i+1] == '\n'){ //Handle windows style line feeds
-                    i++;
-                }
-                i++; //Add 1 to include the line feed
-                priv->read_size = i;
-                return i; //Found a new line, return the line size
-            }
+        //Search for a newline, skipping what we've already searched
+        const size_t eol = priv->scan_offset + scan_eol(priv->data_head_ptr + priv->scan_offset, priv->line_buffer_count - priv->scan_offset);
+        const int split_crlf = eol + 1 == priv->line_buffer_count && priv->data_head_ptr[eol] == '\r'; //Might be a \n next
+        if(eol < priv->line_buffer_count && !split_crlf){
+            return found_line(priv, priv->data_head_ptr, eol, priv->line_buffer_count);
         }
+        priv->scan_offset = eol < priv->line_buffer_count ? eol : priv->line_buffer_count;
 
         //We didn't find a newline, read some more data and try again
         //--------------------------------------------------------------
@@ -263,13 +358,38 @@ int64_t camio_istream_log_start_read(camio_istream_t* this, uint8_t** out){
         }
     }
 
-    *out = priv->data_head_ptr;
-    size_t result = priv->read_size -1; //Strip off the newline
-
-    priv->data_head_ptr     += priv->read_size; //Advance the pointer to the next byte at end of the value just read
-    priv->line_buffer_count -= priv->read_size; //Forget about the bytes just read
+    size_t result = priv->line_size; //Strip off the newline
+    if(priv->is_mapped){
+        *out = priv->map + priv->map_offset;
+        priv->map_offset += priv->read_size;
+    }
+    else{
+        *out = priv->data_head_ptr;
+        priv->data_head_ptr     += priv->read_size; //Advance the pointer to the next byte at end of the value just read
+        priv->line_buffer_count -= priv->read_size; //Forget about the bytes just read
+        priv->scan_offset        = 0;
+    }
     priv->read_size          = 0; //Reset the read size for next time
 
+    //Escaped data never contains a raw newline, so lines can be unescaped one at a time
+    if(priv->escape){
+        if(priv->is_mapped){
+            //The mapping is read only, unescape into the line buffer instead
+            if(result > priv->line_buffer_size){
+                priv->line_buffer = realloc(priv->line_buffer, result);
+                if(!priv->line_buffer){
+                    eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not grow line buffer\n");
+                }
+                priv->line_buffer_size = result;
+            }
+            result = unescape_hex(*out, result, priv->line_buffer);
+            *out   = priv->line_buffer;
+        }
+        else{
+            result = unescape_hex(*out, result, *out);
+        }
+    }
+
     return result;
 }
 
@@ -299,15 +419,29 @@ camio_istream_t* camio_istream_log_construct(camio_istream_log_t* priv, const ca
     priv->read_size         = 0;
     priv->line_buffer_size  = 0;
     priv->data_head_ptr     = NULL;
-    priv->escape            = 0; //Off for the moment since this is borked
+    priv->line_size         = 0;
+    priv->scan_offset       = 0;
+    priv->escape            = 0;
+    priv->is_regular        = 0;
+    priv->fd_blocking       = -1;
+    priv->is_mapped         = 0;
+    priv->map               = NULL;
+    priv->map_size          = 0;
+    priv->map_offset        = 0;
+    priv->is_async          = 0;
     priv->params            = params;
 
+    init_scan_eol();
+
     //Populate the function members
     priv->istream.priv          = priv; //Lets us access private members
     priv->istream.open          = camio_istream_log_open;
     priv->istream.close         = camio_istream_log_close;
     priv->istream.start_read    = camio_istream_log_start_read;
     priv->istream.end_read      = camio_istream_log_end_read;
+    priv->istream.start_read_batch = camio_istream_start_read_batch_generic;
+    priv->istream.end_read_batch   = camio_istream_end_read_batch_generic;
+    priv->istream.read_meta     = camio_istream_read_meta_none;
     priv->istream.ready         = camio_istream_log_ready;
     priv->istream.delete        = camio_istream_log_delete;
     priv->istream.fd            = -1;
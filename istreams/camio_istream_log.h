@@ -9,6 +9,8 @@
 #define CAMIO_ISTREAM_LOG_H_
 
 #include "camio_istream.h"
+#include "../camio_mmap.h"
+#include "../camio_aio.h"
 
 #define CAMIO_ISTREAM_LOG_BLOCKING    1
 #define CAMIO_ISTREAM_LOG_NONBLOCKING 0
@@ -31,6 +33,16 @@ typedef struct {
     size_t line_buffer_count;           //Amount of data in the buffer
     size_t read_size;                   //Size of a line that is ready for start_read
     uint8_t* data_head_ptr;             //Place to read data from in by calling start_read
+    size_t line_size;                   //Size of the line that is ready, without the line ending
+    size_t scan_offset;                 //How much of the buffer has already been searched for a line ending
+    int is_regular;                     //Is the fd a regular file? They have no blocking mode
+    int fd_blocking;                    //Blocking mode the fd is currently in, -1 if unknown
+    int is_mapped;                      //mmap=1, lines come straight from the mapping
+    uint8_t* map;                       //The whole file, if mapped
+    size_t map_size;
+    size_t map_offset;                  //Start of the next line in the mapping
+    int is_async;                       //aio=1, the file is read ahead asynchronously
+    camio_aio_t aio;
     camio_istream_log_params_t* params;  //Parameters passed in from the outside
 
 } camio_istream_log_t;
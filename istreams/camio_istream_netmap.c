@@ -324,6 +324,56 @@ int64_t camio_istream_netmap_end_read(camio_istream_t* this,uint8_t* free_buff){
 }
 
 
+//Hand out every filled slot on the ring that the next packet came from
+int64_t camio_istream_netmap_start_read_batch(camio_istream_t* this, camio_iovec_t* out, size_t max){
+    camio_istream_netmap_t* priv = this->priv;
+
+    if(unlikely(priv->is_closed || !max)){
+        return 0;
+    }
+
+    //Called read without calling ready, they must want to block/spin waiting for data .. ok
+    if(unlikely(!priv->packet_size)){
+        while(!prepare_next(this)){}
+    }
+
+    struct netmap_ring* ring = priv->ring;
+    const size_t count = MIN(max, nm_ring_space(ring));
+    uint32_t cur = ring->cur;
+
+    size_t i = 0;
+    for(; i < count; i++){
+        out[i].buff = (uint8_t*)NETMAP_BUF(ring, ring->slot[cur].buf_idx);
+        out[i].len  = ring->slot[cur].len;
+        cur = nm_ring_next(ring, cur);
+    }
+
+    return count;
+}
+
+
+//Give all of the slots back to the ring with a single head update
+int64_t camio_istream_netmap_end_read_batch(camio_istream_t* this, size_t count){
+    camio_istream_netmap_t* priv = this->priv;
+
+    if(unlikely(!count || !priv->ring)){
+        return 0;
+    }
+
+    struct netmap_ring* ring = priv->ring;
+    uint32_t cur = ring->cur + count;
+    if(cur >= ring->num_slots){
+        cur -= ring->num_slots;
+    }
+
+    ring->cur         = cur;
+    ring->head        = cur;
+    priv->packet_size = 0;
+    priv->packet      = NULL;
+    return 0;
+}
+
+
 void camio_istream_netmap_delete(camio_istream_t* this){
     this->close(this);
     camio_istream_netmap_t* priv = this->priv;
@@ -362,6 +412,9 @@ camio_istream_t* camio_istream_netmap_construct(camio_istream_netmap_t* priv, co
     priv->istream.close         = camio_istream_netmap_close;
     priv->istream.start_read    = camio_istream_netmap_start_read;
     priv->istream.end_read      = camio_istream_netmap_end_read;
+    priv->istream.start_read_batch = camio_istream_netmap_start_read_batch;
+    priv->istream.end_read_batch   = camio_istream_netmap_end_read_batch;
+    priv->istream.read_meta     = camio_istream_read_meta_none;
     priv->istream.ready         = camio_istream_netmap_ready;
     priv->istream.delete        = camio_istream_netmap_delete;
     priv->istream.fd            = -1;
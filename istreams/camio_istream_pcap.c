@@ -0,0 +1,218 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ pcap file input stream
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "camio_istream_pcap.h"
+#include "../camio_mmap.h"
+#include "../camio_errors.h"
+#include "../camio_util.h"
+
+
+int64_t camio_istream_pcap_open(camio_istream_t* this, const camio_descr_t* descr ){
+    camio_istream_pcap_t* priv = this->priv;
+
+    const char* valid_opts[] = { "hdr", CAMIO_MMAP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+    priv->hdr = camio_descr_get_opt_bool(descr, "hdr", 1);
+
+    if(unlikely(!descr->query)){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
+    }
+
+    this->fd = open(descr->query, O_RDONLY);
+    if(unlikely(this->fd < 0)){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\". Error=%s\n", descr->query, strerror(errno));
+    }
+
+    struct stat st;
+    if(fstat(this->fd, &st) < 0){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not stat file \"%s\". Error=%s\n", descr->query, strerror(errno));
+    }
+    if((size_t)st.st_size < sizeof(camio_pcap_file_hdr_t)){
+        eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "File \"%s\" is too short to be a pcap file\n", descr->query);
+    }
+    priv->file_size = st.st_size;
+
+    camio_mmap_opts_t mmap_opts;
+    camio_mmap_get_opts(descr, &mmap_opts);
+    priv->file = camio_mmap(priv->file_size, PROT_READ, this->fd, &mmap_opts, descr->query);
+
+    const camio_pcap_file_hdr_t* file_hdr = (const camio_pcap_file_hdr_t*)priv->file;
+    switch(file_hdr->magic){
+        case CAMIO_PCAP_MAGIC:      priv->nano = 0; break;
+        case CAMIO_PCAP_MAGIC_NSEC: priv->nano = 1; break;
+        case CAMIO_PCAP_MAGIC_SWAPPED:
+        case CAMIO_PCAP_MAGIC_NSEC_SWAPPED:
+            //Records are handed out in place, so there's no chance to swap them
+            eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "File \"%s\" was written with the other byte order, which is not supported\n", descr->query);
+            break;
+        default:
+            eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "File \"%s\" is not a pcap file (magic=0x%08X)\n", descr->query, file_hdr->magic);
+    }
+
+    priv->offset    = sizeof(camio_pcap_file_hdr_t);
+    priv->is_closed = 0;
+    return CAMIO_ERR_NONE;
+}
+
+
+void camio_istream_pcap_close(camio_istream_t* this){
+    camio_istream_pcap_t* priv = this->priv;
+    if(priv->is_closed){
+        return;
+    }
+    munmap((void*)priv->file, priv->file_size);
+    close(this->fd);
+    priv->file      = NULL;
+    priv->is_closed = 1;
+}
+
+
+//Take the next record out of the file, returns its length or 0 at the end of the file
+static inline size_t next_record(camio_istream_pcap_t* priv, uint8_t** out){
+    const size_t hdr_size = sizeof(camio_pcap_rec_hdr_t);
+    while(likely(!priv->is_closed && priv->offset + hdr_size <= priv->file_size)){
+        const camio_pcap_rec_hdr_t* rec_hdr = (const camio_pcap_rec_hdr_t*)(priv->file + priv->offset);
+        const size_t caplen = rec_hdr->caplen;
+        if(unlikely(caplen > CAMIO_PCAP_MAX_CAPLEN)){
+            eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "Corrupt pcap record at offset %lu (caplen=%lu)\n", priv->offset, caplen);
+        }
+        if(unlikely(priv->offset + hdr_size + caplen > priv->file_size)){
+            wprintf(CAMIO_ERR_FILE_READ, "pcap file ends part way through a record, ignoring the last %lu bytes\n", priv->file_size - priv->offset);
+            priv->offset = priv->file_size;
+            return 0;
+        }
+
+        uint8_t* rec = priv->file + priv->offset;
+        priv->offset += hdr_size + caplen;
+
+        if(priv->hdr){
+            *out = rec;
+            return hdr_size + caplen;
+        }
+
+        //An empty packet would look like the end of the file
+        if(likely(caplen)){
+            *out = rec + hdr_size;
+            return caplen;
+        }
+    }
+
+    return 0;
+}
+
+
+int64_t camio_istream_pcap_ready(camio_istream_t* this){
+    return 1; //Reading from memory never blocks, at the end of the file reads just return nothing
+}
+
+
+int64_t camio_istream_pcap_start_read(camio_istream_t* this, uint8_t** out){
+    camio_istream_pcap_t* priv = this->priv;
+    *out = NULL;
+    return next_record(priv, out);
+}
+
+
+int64_t camio_istream_pcap_end_read(camio_istream_t* this, uint8_t* free_buff){
+    return 0; //Always true for memory I/O
+}
+
+
+//The whole file is mapped, so as many records as are wanted can be handed out at once
+int64_t camio_istream_pcap_start_read_batch(camio_istream_t* this, camio_iovec_t* out, size_t max){
+    camio_istream_pcap_t* priv = this->priv;
+
+    size_t i = 0;
+    for(; i < max; i++){
+        out[i].len = next_record(priv, &out[i].buff);
+        if(!out[i].len){
+            break;
+        }
+    }
+
+    return i;
+}
+
+
+int64_t camio_istream_pcap_end_read_batch(camio_istream_t* this, size_t count){
+    return 0; //Always true for memory I/O
+}
+
+
+//The record header says when the packet was captured
+int64_t camio_istream_pcap_read_meta(camio_istream_t* this, const uint8_t* buff, camio_meta_t* meta){
+    camio_istream_pcap_t* priv = this->priv;
+    memset(meta, 0, sizeof(camio_meta_t));
+    if(unlikely(!buff || priv->is_closed)){
+        return 0;
+    }
+
+    const uint8_t* rec = priv->hdr ? buff : buff - sizeof(camio_pcap_rec_hdr_t);
+    meta->hw_ts = camio_pcap_ts_to_ns((const camio_pcap_rec_hdr_t*)rec, priv->nano);
+    return 1;
+}
+
+
+void camio_istream_pcap_delete(camio_istream_t* this){
+    this->close(this);
+    camio_istream_pcap_t* priv = this->priv;
+    free(priv);
+}
+
+/* ****************************************************
+ * Construction
+ */
+
+camio_istream_t* camio_istream_pcap_construct(camio_istream_pcap_t* priv, const camio_descr_t* descr, camio_istream_pcap_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"pcap stream supplied is null\n");
+    }
+
+    //Initialize the local variables
+    priv->is_closed         = 1;
+    priv->file              = NULL;
+    priv->file_size         = 0;
+    priv->offset            = 0;
+    priv->hdr               = 1;
+    priv->nano              = 0;
+    priv->params            = params;
+
+    //Populate the function members
+    priv->istream.priv          = priv; //Lets us access private members
+    priv->istream.open          = camio_istream_pcap_open;
+    priv->istream.close         = camio_istream_pcap_close;
+    priv->istream.start_read    = camio_istream_pcap_start_read;
+    priv->istream.end_read      = camio_istream_pcap_end_read;
+    priv->istream.start_read_batch = camio_istream_pcap_start_read_batch;
+    priv->istream.end_read_batch   = camio_istream_pcap_end_read_batch;
+    priv->istream.read_meta     = camio_istream_pcap_read_meta;
+    priv->istream.ready         = camio_istream_pcap_ready;
+    priv->istream.delete        = camio_istream_pcap_delete;
+    priv->istream.fd            = -1;
+
+    //Call open, because its the obvious thing to do now...
+    priv->istream.open(&priv->istream, descr);
+
+    //Return the generic istream interface for the outside world to use
+    return &priv->istream;
+
+}
+
+camio_istream_t* camio_istream_pcap_new( const camio_descr_t* descr, camio_istream_pcap_params_t* params){
+    camio_istream_pcap_t* priv = malloc(sizeof(camio_istream_pcap_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for pcap istream creation\n");
+    }
+    return camio_istream_pcap_construct(priv, descr, params);
+}
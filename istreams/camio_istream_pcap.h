@@ -1,7 +1,17 @@
 /*
  * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
  *
- * Fe2+ pcap socket input stream
+ * Fe2+ pcap file input stream
+ *
+ * The whole file is mapped into memory and each read hands out a pointer straight into the
+ * mapping, so packets are never copied. Both microsecond and nanosecond pcap files can be read,
+ * timestamps are left in whichever the file has. read_meta() gives the capture time in
+ * nanoseconds as the hardware time.
+ *
+ * Options:
+ * hdr=0    Hand out just the packet bytes. By default each read is a whole record, the pcap record
+ *          header (camio_pcap_rec_hdr_t) followed by the packet. Empty packets are skipped
+ * And the mmap options (see camio_mmap.h)
  *
  */
 
@@ -9,6 +19,7 @@
 #define CAMIO_ISTREAM_PCAP_H_
 
 #include "camio_istream.h"
+#include "../camio_pcap.h"
 
 /********************************************************************
  *                  PRIVATE DEFS
@@ -20,11 +31,12 @@ typedef struct {
 
 typedef struct {
     camio_istream_t istream;
-    uint8_t* buffer;
-    size_t buffer_size;
-    size_t bytes_read;
-    int fd;
     int is_closed;                      //Has close be called?
+    uint8_t* file;                      //Pointer to the head of the mapped file
+    size_t file_size;                   //Size of the mapping
+    uint64_t offset;                    //Offset of the next record in the file
+    int hdr;                            //Hand out the record headers along with the packets
+    int nano;                           //Timestamps are in nanoseconds
     camio_istream_pcap_params_t* params;  //Parameters passed in from the outside
 
 } camio_istream_pcap_t;
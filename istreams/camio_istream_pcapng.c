@@ -0,0 +1,353 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ pcapng file input stream
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "camio_istream_pcapng.h"
+#include "../camio_mmap.h"
+#include "../camio_errors.h"
+#include "../camio_util.h"
+
+
+int64_t camio_istream_pcapng_open(camio_istream_t* this, const camio_descr_t* descr ){
+    camio_istream_pcapng_t* priv = this->priv;
+
+    const char* valid_opts[] = { "hdr", CAMIO_MMAP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+    priv->hdr = camio_descr_get_opt_bool(descr, "hdr", 1);
+
+    if(unlikely(!descr->query)){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
+    }
+
+    this->fd = open(descr->query, O_RDONLY);
+    if(unlikely(this->fd < 0)){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\". Error=%s\n", descr->query, strerror(errno));
+    }
+
+    struct stat st;
+    if(fstat(this->fd, &st) < 0){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not stat file \"%s\". Error=%s\n", descr->query, strerror(errno));
+    }
+    if((size_t)st.st_size < sizeof(camio_pcapng_shb_t)){
+        eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "File \"%s\" is too short to be a pcapng file\n", descr->query);
+    }
+    priv->file_size = st.st_size;
+
+    camio_mmap_opts_t mmap_opts;
+    camio_mmap_get_opts(descr, &mmap_opts);
+    priv->file = camio_mmap(priv->file_size, PROT_READ, this->fd, &mmap_opts, descr->query);
+
+    //The section header itself is checked as it's read
+    const camio_pcapng_block_hdr_t* block = (const camio_pcapng_block_hdr_t*)priv->file;
+    if(block->type != CAMIO_PCAPNG_BLOCK_SHB){
+        eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "File \"%s\" is not a pcapng file (first block type=0x%08X)\n", descr->query, block->type);
+    }
+
+    priv->offset    = 0;
+    priv->is_closed = 0;
+    return CAMIO_ERR_NONE;
+}
+
+
+void camio_istream_pcapng_close(camio_istream_t* this){
+    camio_istream_pcapng_t* priv = this->priv;
+    if(priv->is_closed){
+        return;
+    }
+    munmap((void*)priv->file, priv->file_size);
+    close(this->fd);
+    free(priv->ifaces);
+    priv->ifaces    = NULL;
+    priv->if_count  = 0;
+    priv->if_size   = 0;
+    priv->file      = NULL;
+    priv->is_closed = 1;
+}
+
+
+static void read_shb(camio_istream_pcapng_t* priv, const uint8_t* block, uint32_t len){
+    const camio_pcapng_shb_t* shb = (const camio_pcapng_shb_t*)block;
+    if(len < sizeof(camio_pcapng_shb_t) + sizeof(uint32_t)){
+        eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "Corrupt pcapng section header at offset %lu\n", priv->offset);
+    }
+    if(shb->bom == CAMIO_PCAPNG_BOM_SWAPPED){
+        //Blocks are handed out in place, so there's no chance to swap them
+        eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "pcapng section at offset %lu was written with the other byte order, which is not supported\n", priv->offset);
+    }
+    if(shb->bom != CAMIO_PCAPNG_BOM || shb->version_major != CAMIO_PCAPNG_VERSION_MAJOR){
+        eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "Unsupported pcapng section at offset %lu (bom=0x%08X, version=%u)\n", priv->offset, shb->bom, shb->version_major);
+    }
+
+    priv->if_count = 0; //Interfaces are per section
+}
+
+
+static void read_idb(camio_istream_pcapng_t* priv, const uint8_t* block, uint32_t len){
+    const camio_pcapng_idb_t* idb = (const camio_pcapng_idb_t*)block;
+    if(len < sizeof(camio_pcapng_idb_t) + sizeof(uint32_t)){
+        eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "Corrupt pcapng interface description at offset %lu\n", priv->offset);
+    }
+
+    if(priv->if_count == priv->if_size){
+        priv->if_size = priv->if_size ? priv->if_size * 2 : 8;
+        priv->ifaces  = realloc(priv->ifaces, priv->if_size * sizeof(camio_pcapng_if_t));
+        if(!priv->ifaces){
+            eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not allocate pcapng interface table\n");
+        }
+    }
+
+    camio_pcapng_if_t* iface = &priv->ifaces[priv->if_count++];
+    iface->linktype = idb->linktype;
+    iface->snaplen  = idb->snaplen;
+    iface->tsresol  = CAMIO_PCAPNG_TSRESOL_US;
+    iface->tsoffset = 0;
+
+    //Walk the options for the timestamp details
+    const uint8_t* opt_ptr = block + sizeof(camio_pcapng_idb_t);
+    const uint8_t* end     = block + len - sizeof(uint32_t);
+    while(opt_ptr + sizeof(camio_pcapng_opt_t) <= end){
+        const camio_pcapng_opt_t* opt = (const camio_pcapng_opt_t*)opt_ptr;
+        const uint8_t* value = opt_ptr + sizeof(camio_pcapng_opt_t);
+        if(opt->code == CAMIO_PCAPNG_OPT_END || value + opt->len > end){
+            break;
+        }
+
+        if(opt->code == CAMIO_PCAPNG_OPT_IF_TSRESOL && opt->len >= 1){
+            iface->tsresol = value[0];
+        }
+        else if(opt->code == CAMIO_PCAPNG_OPT_IF_TSOFFSET && opt->len >= sizeof(int64_t)){
+            memcpy(&iface->tsoffset, value, sizeof(int64_t));
+        }
+
+        opt_ptr = value + CAMIO_PCAPNG_PAD(opt->len);
+    }
+
+    //Anything finer than this doesn't fit the arithmetic, and isn't a real clock anyway
+    const uint8_t exp = iface->tsresol & ~CAMIO_PCAPNG_TSRESOL_BINARY;
+    if(exp > ((iface->tsresol & CAMIO_PCAPNG_TSRESOL_BINARY) ? 63 : 18)){
+        eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "Unsupported pcapng timestamp resolution 0x%02X at offset %lu\n", iface->tsresol, priv->offset);
+    }
+}
+
+
+//Find the next packet in the file. Returns its length or 0 at the end of the file, or at a new
+//section if stop_at_section is set (so the interfaces for packets already handed out stay valid)
+static inline size_t next_packet(camio_istream_pcapng_t* priv, uint8_t** out, int stop_at_section){
+    const size_t min_len = sizeof(camio_pcapng_block_hdr_t) + sizeof(uint32_t);
+    while(likely(!priv->is_closed && priv->offset + min_len <= priv->file_size)){
+        uint8_t* block = priv->file + priv->offset;
+        const camio_pcapng_block_hdr_t* hdr = (const camio_pcapng_block_hdr_t*)block;
+        const uint32_t len = hdr->total_len;
+        if(unlikely(len < min_len || len % 4)){
+            eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "Corrupt pcapng block at offset %lu (length=%u)\n", priv->offset, len);
+        }
+        if(unlikely(priv->offset + len > priv->file_size)){
+            wprintf(CAMIO_ERR_FILE_READ, "pcapng file ends part way through a block, ignoring the last %lu bytes\n", priv->file_size - priv->offset);
+            priv->offset = priv->file_size;
+            return 0;
+        }
+        if(unlikely(*(const uint32_t*)(block + len - sizeof(uint32_t)) != len)){
+            eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "Corrupt pcapng block at offset %lu (trailing length does not match)\n", priv->offset);
+        }
+
+        uint8_t* packet = NULL;
+        size_t caplen   = 0;
+        switch(hdr->type){
+            case CAMIO_PCAPNG_BLOCK_EPB:{
+                const camio_pcapng_epb_t* epb = (const camio_pcapng_epb_t*)block;
+                if(unlikely(len < sizeof(camio_pcapng_epb_t) + sizeof(uint32_t) + CAMIO_PCAPNG_PAD(epb->caplen))){
+                    eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "Corrupt pcapng packet block at offset %lu\n", priv->offset);
+                }
+                if(unlikely(epb->if_id >= priv->if_count)){
+                    eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "pcapng packet block at offset %lu refers to interface %u, which has not been described\n", priv->offset, epb->if_id);
+                }
+                packet = block + sizeof(camio_pcapng_epb_t);
+                caplen = epb->caplen;
+                break;
+            }
+            case CAMIO_PCAPNG_BLOCK_SPB:{
+                const camio_pcapng_spb_t* spb = (const camio_pcapng_spb_t*)block;
+                if(unlikely(!priv->if_count)){
+                    eprintf_exit(CAMIO_ERR_NOT_A_PCAP, "pcapng simple packet block at offset %lu comes before any interfaces\n", priv->offset);
+                }
+                packet = block + sizeof(camio_pcapng_spb_t);
+                caplen = MIN(spb->len, len - sizeof(camio_pcapng_spb_t) - sizeof(uint32_t));
+                if(priv->ifaces[0].snaplen){
+                    caplen = MIN(caplen, priv->ifaces[0].snaplen);
+                }
+                break;
+            }
+            case CAMIO_PCAPNG_BLOCK_SHB:
+                if(stop_at_section && priv->offset){
+                    return 0;
+                }
+                read_shb(priv, block, len);
+                break;
+            case CAMIO_PCAPNG_BLOCK_IDB:
+                read_idb(priv, block, len);
+                break;
+            default:
+                break; //Statistics, name resolution, custom blocks etc are no use to us
+        }
+
+        priv->offset += len;
+        if(!packet){
+            continue;
+        }
+
+        if(priv->hdr){
+            *out = block;
+            return len;
+        }
+
+        //An empty packet would look like the end of the file
+        if(likely(caplen)){
+            *out = packet;
+            return caplen;
+        }
+    }
+
+    return 0;
+}
+
+
+const camio_pcapng_if_t* camio_istream_pcapng_interface(camio_istream_t* this, uint32_t if_id){
+    camio_istream_pcapng_t* priv = this->priv;
+    if(unlikely(if_id >= priv->if_count)){
+        return NULL;
+    }
+    return &priv->ifaces[if_id];
+}
+
+
+int64_t camio_istream_pcapng_ready(camio_istream_t* this){
+    return 1; //Reading from memory never blocks, at the end of the file reads just return nothing
+}
+
+
+int64_t camio_istream_pcapng_start_read(camio_istream_t* this, uint8_t** out){
+    camio_istream_pcapng_t* priv = this->priv;
+    *out = NULL;
+    return next_packet(priv, out, 0);
+}
+
+
+int64_t camio_istream_pcapng_end_read(camio_istream_t* this, uint8_t* free_buff){
+    return 0; //Always true for memory I/O
+}
+
+
+//The whole file is mapped, so as many packets as are wanted can be handed out at once. A batch
+//stops short at a new section, so that the interfaces of the packets in it don't change under them
+int64_t camio_istream_pcapng_start_read_batch(camio_istream_t* this, camio_iovec_t* out, size_t max){
+    camio_istream_pcapng_t* priv = this->priv;
+
+    size_t i = 0;
+    for(; i < max; i++){
+        out[i].len = next_packet(priv, &out[i].buff, i > 0);
+        if(!out[i].len){
+            break;
+        }
+    }
+
+    return i;
+}
+
+
+int64_t camio_istream_pcapng_end_read_batch(camio_istream_t* this, size_t count){
+    return 0; //Always true for memory I/O
+}
+
+
+//Enhanced Packet Blocks say when the packet was captured, Simple Packet Blocks don't
+int64_t camio_istream_pcapng_read_meta(camio_istream_t* this, const uint8_t* buff, camio_meta_t* meta){
+    camio_istream_pcapng_t* priv = this->priv;
+    memset(meta, 0, sizeof(camio_meta_t));
+    if(unlikely(!buff || priv->is_closed)){
+        return 0;
+    }
+
+    //Without the block header the packet could have come from either kind of block, so only take
+    //it for an EPB if there's a whole, consistent one in front of it
+    const uint8_t* block = priv->hdr ? buff : buff - sizeof(camio_pcapng_epb_t);
+    const camio_pcapng_epb_t* epb = (const camio_pcapng_epb_t*)block;
+    if(block < priv->file || epb->hdr.type != CAMIO_PCAPNG_BLOCK_EPB || epb->if_id >= priv->if_count){
+        return 0;
+    }
+    if(!priv->hdr){
+        const uint32_t len = epb->hdr.total_len;
+        if(len < sizeof(camio_pcapng_epb_t) + sizeof(uint32_t) + CAMIO_PCAPNG_PAD(epb->caplen) || len % 4 ||
+           block + len > priv->file + priv->file_size || *(const uint32_t*)(block + len - sizeof(uint32_t)) != len){
+            return 0;
+        }
+    }
+
+    meta->hw_ts = camio_pcapng_ts_to_ns(&priv->ifaces[epb->if_id], ((uint64_t)epb->ts_high << 32) | epb->ts_low);
+    return 1;
+}
+
+
+void camio_istream_pcapng_delete(camio_istream_t* this){
+    this->close(this);
+    camio_istream_pcapng_t* priv = this->priv;
+    free(priv);
+}
+
+/* ****************************************************
+ * Construction
+ */
+
+camio_istream_t* camio_istream_pcapng_construct(camio_istream_pcapng_t* priv, const camio_descr_t* descr, camio_istream_pcapng_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"pcapng stream supplied is null\n");
+    }
+
+    //Initialize the local variables
+    priv->is_closed         = 1;
+    priv->file              = NULL;
+    priv->file_size         = 0;
+    priv->offset            = 0;
+    priv->hdr               = 1;
+    priv->ifaces            = NULL;
+    priv->if_count          = 0;
+    priv->if_size           = 0;
+    priv->params            = params;
+
+    //Populate the function members
+    priv->istream.priv          = priv; //Lets us access private members
+    priv->istream.open          = camio_istream_pcapng_open;
+    priv->istream.close         = camio_istream_pcapng_close;
+    priv->istream.start_read    = camio_istream_pcapng_start_read;
+    priv->istream.end_read      = camio_istream_pcapng_end_read;
+    priv->istream.start_read_batch = camio_istream_pcapng_start_read_batch;
+    priv->istream.end_read_batch   = camio_istream_pcapng_end_read_batch;
+    priv->istream.read_meta     = camio_istream_pcapng_read_meta;
+    priv->istream.ready         = camio_istream_pcapng_ready;
+    priv->istream.delete        = camio_istream_pcapng_delete;
+    priv->istream.fd            = -1;
+
+    //Call open, because its the obvious thing to do now...
+    priv->istream.open(&priv->istream, descr);
+
+    //Return the generic istream interface for the outside world to use
+    return &priv->istream;
+
+}
+
+camio_istream_t* camio_istream_pcapng_new( const camio_descr_t* descr, camio_istream_pcapng_params_t* params){
+    camio_istream_pcapng_t* priv = malloc(sizeof(camio_istream_pcapng_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for pcapng istream creation\n");
+    }
+    return camio_istream_pcapng_construct(priv, descr, params);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ pcapng file input stream
+ *
+ * The whole file is mapped into memory and each read hands out a pointer straight into the
+ * mapping, so packets are never copied. Enhanced and Simple Packet Blocks are handed out, every
+ * other block is read for what it says about the interfaces, or skipped. Files with several
+ * sections are fine, each one starts a new set of interfaces. read_meta() gives an Enhanced Packet
+ * Block's capture time in nanoseconds as the hardware time, Simple Packet Blocks have none.
+ *
+ * Options:
+ * hdr=0    Hand out just the packet bytes. By default each read is the whole packet block, which
+ *          says which interface the packet came from and (for Enhanced Packet Blocks) when. Use
+ *          camio_istream_pcapng_interface() to find out about the interface and its timestamps.
+ *          Empty packets are skipped
+ * And the mmap options (see camio_mmap.h)
+ *
+ */
+
+#ifndef CAMIO_ISTREAM_PCAPNG_H_
+#define CAMIO_ISTREAM_PCAPNG_H_
+
+#include "camio_istream.h"
+#include "../camio_pcapng.h"
+
+/********************************************************************
+ *                  PRIVATE DEFS
+ ********************************************************************/
+
+typedef struct {
+    //No params at this stage
+} camio_istream_pcapng_params_t;
+
+typedef struct {
+    camio_istream_t istream;
+    int is_closed;                      //Has close be called?
+    uint8_t* file;                      //Pointer to the head of the mapped file
+    size_t file_size;                   //Size of the mapping
+    uint64_t offset;                    //Offset of the next block in the file
+    int hdr;                            //Hand out whole blocks, rather than just the packets
+    camio_pcapng_if_t* ifaces;          //Interfaces of the current section
+    uint64_t if_count;
+    uint64_t if_size;                   //Space in ifaces
+    camio_istream_pcapng_params_t* params;  //Parameters passed in from the outside
+
+} camio_istream_pcapng_t;
+
+
+
+/********************************************************************
+ *                  PUBLIC DEFS
+ ********************************************************************/
+
+camio_istream_t* camio_istream_pcapng_new( const camio_descr_t* opts,  camio_istream_pcapng_params_t* params);
+
+//The interface a packet block handed out by the stream refers to (if_id in Enhanced Packet Blocks,
+//0 for Simple Packet Blocks). Only valid until the next read, which may start a new section
+const camio_pcapng_if_t* camio_istream_pcapng_interface(camio_istream_t* this, uint32_t if_id);
+
+
+#endif /* CAMIO_ISTREAM_PCAPNG_H_ */
@@ -161,6 +161,9 @@ camio_istream_t* camio_istream_periodic_timeout_fast_construct(camio_istream_per
     priv->istream.close         = camio_istream_periodic_timeout_fast_close;
     priv->istream.start_read    = camio_istream_periodic_timeout_fast_start_read;
     priv->istream.end_read      = camio_istream_periodic_timeout_fast_end_read;
+    priv->istream.start_read_batch = camio_istream_start_read_batch_generic;
+    priv->istream.end_read_batch   = camio_istream_end_read_batch_generic;
+    priv->istream.read_meta     = camio_istream_read_meta_none;
     priv->istream.ready         = camio_istream_periodic_timeout_fast_ready;
     priv->istream.delete        = camio_istream_periodic_timeout_fast_delete;
     priv->istream.fd            = -1;
@@ -20,6 +20,7 @@
 
 #include "camio_istream_raw.h"
 #include "../camio_errors.h"
+#include "../camio_util.h"
 
 
 
@@ -28,9 +29,8 @@ int64_t camio_istream_raw_open(camio_istream_t* this, const camio_descr_t* descr
     const char* iface = descr->query;
     int raw_sock_fd;
 
-    if(descr->opt_head){
-        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option(s) supplied, but none expected\n");
-    }
+    const char* valid_opts[] = { CAMIO_TIMESTAMP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
 
     if(!descr->query){
         eprintf_exit(CAMIO_ERR_NULL_PTR, "No interface supplied\n");
@@ -81,6 +81,8 @@ int64_t camio_istream_raw_open(camio_istream_t* this, const camio_descr_t* descr
         eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not set socket option. Error = %s\n",strerror(errno));
     }
 
+    priv->ts = camio_timestamp_open(raw_sock_fd, descr, iface);
+
     this->fd = raw_sock_fd;
     priv->is_closed = 0;
     return 0;
@@ -91,6 +93,7 @@ void camio_istream_raw_close(camio_istream_t* this){
     camio_istream_raw_t* priv = this->priv;
     close(this->fd);
     free(priv->buffer);
+    free(priv->batch_buffer);
 }
 
 static void set_fd_blocking(int fd, int blocking){
@@ -119,7 +122,14 @@ static int prepare_next(camio_istream_raw_t* priv, int blocking){
 
     set_fd_blocking(priv->istream.fd, blocking);
 
-    int bytes = recv(priv->istream.fd,priv->buffer,priv->buffer_size, 0);
+    struct iovec iov = { .iov_base = priv->buffer, .iov_len = priv->buffer_size };
+    struct msghdr hdr = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if(priv->ts){
+        hdr.msg_control    = priv->ctrl;
+        hdr.msg_controllen = sizeof(priv->ctrl);
+    }
+
+    int bytes = recvmsg(priv->istream.fd, &hdr, 0);
     if( bytes < 0){
           if(errno == EWOULDBLOCK || errno == EAGAIN){
               bytes = 0; 
@@ -128,6 +138,7 @@ static int prepare_next(camio_istream_raw_t* priv, int blocking){
           eprintf_exit(CAMIO_ERR_RCV,"Could not receive from socket. Error = %s\n",strerror(errno));
     }
 
+    priv->ctrl_len   = hdr.msg_controllen;
     priv->bytes_read = bytes;
     return bytes;
 
@@ -171,6 +182,101 @@ int64_t camio_istream_raw_end_read(camio_istream_t* this, uint8_t* free_buff){
 }
 
 
+//Only streams that are read in batches pay for the message pool
+static void batch_init(camio_istream_raw_t* priv){
+    priv->batch_buffer = malloc(CAMIO_ISTREAM_RAW_BATCH_MAX * CAMIO_ISTREAM_RAW_BATCH_SLOT_SIZE);
+    if(!priv->batch_buffer){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Failed to allocate batch message buffers\n");
+    }
+
+    size_t i = 0;
+    for(; i < CAMIO_ISTREAM_RAW_BATCH_MAX; i++){
+        priv->batch_iovs[i].iov_base = priv->batch_buffer + i * CAMIO_ISTREAM_RAW_BATCH_SLOT_SIZE;
+        priv->batch_iovs[i].iov_len  = CAMIO_ISTREAM_RAW_BATCH_SLOT_SIZE;
+        memset(&priv->batch_msgs[i], 0, sizeof(struct mmsghdr));
+        priv->batch_msgs[i].msg_hdr.msg_iov    = &priv->batch_iovs[i];
+        priv->batch_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+
+static int64_t camio_istream_raw_start_read_batch(camio_istream_t* this, camio_iovec_t* out, size_t max){
+    camio_istream_raw_t* priv = this->priv;
+    if(unlikely(priv->is_closed || !max)){
+        return 0;
+    }
+
+    if(unlikely(!priv->batch_buffer)){
+        batch_init(priv);
+    }
+
+    //A call to ready() may have left a message waiting, it goes first
+    size_t count = 0;
+    if(priv->bytes_read){
+        out[0].buff      = priv->buffer;
+        out[0].len       = priv->bytes_read;
+        priv->bytes_read = 0;
+        count            = 1;
+    }
+
+    max = MIN(max, CAMIO_ISTREAM_RAW_BATCH_MAX);
+    if(count >= max){
+        return count;
+    }
+
+    //Block for the first message only if there is nothing to hand back yet
+    int flags = MSG_DONTWAIT;
+    if(!count){
+        set_fd_blocking(this->fd, 1);
+        flags = MSG_WAITFORONE;
+    }
+
+    //The kernel shrinks the control space to what it used, so it has to be given back each time
+    size_t i = 0;
+    for(; priv->ts && i < max - count; i++){
+        priv->batch_msgs[i].msg_hdr.msg_control    = priv->batch_ctrl[i];
+        priv->batch_msgs[i].msg_hdr.msg_controllen = CAMIO_TIMESTAMP_CTRL_SIZE;
+    }
+
+    int msgs = recvmmsg(this->fd, priv->batch_msgs, max - count, flags, NULL);
+    if(msgs < 0){
+        if(errno == EWOULDBLOCK || errno == EAGAIN){
+            return count;
+        }
+        eprintf_exit(CAMIO_ERR_RCV,"Could not receive from socket. Error = %s\n",strerror(errno));
+    }
+
+    int j = 0;
+    for(; j < msgs; j++, count++){
+        out[count].buff = priv->batch_iovs[j].iov_base;
+        out[count].len  = priv->batch_msgs[j].msg_len;
+    }
+
+    return count;
+}
+
+
+int64_t camio_istream_raw_end_read_batch(camio_istream_t* this, size_t count){
+    return 0; //Always true for socket I/O, the pool is only reused by the next batch
+}
+
+
+//Timestamps come from the control messages of whichever receive the frame came in on
+int64_t camio_istream_raw_read_meta(camio_istream_t* this, const uint8_t* buff, camio_meta_t* meta){
+    camio_istream_raw_t* priv = this->priv;
+    if(!priv->ts){
+        return camio_istream_read_meta_none(this, buff, meta);
+    }
+
+    if(priv->batch_buffer && buff >= priv->batch_buffer && buff < priv->batch_buffer + CAMIO_ISTREAM_RAW_BATCH_MAX * CAMIO_ISTREAM_RAW_BATCH_SLOT_SIZE){
+        return camio_timestamp_get(&priv->batch_msgs[(buff - priv->batch_buffer) / CAMIO_ISTREAM_RAW_BATCH_SLOT_SIZE].msg_hdr, meta);
+    }
+
+    struct msghdr hdr = { .msg_control = priv->ctrl, .msg_controllen = priv->ctrl_len };
+    return camio_timestamp_get(&hdr, meta);
+}
+
+
 void camio_istream_raw_delete(camio_istream_t* this){
     this->close(this);
     camio_istream_raw_t* priv = this->priv;
@@ -190,6 +296,9 @@ camio_istream_t* camio_istream_raw_construct(camio_istream_raw_t* priv, const ca
     priv->buffer            = NULL;
     priv->buffer_size       = 0;
     priv->bytes_read        = 0;
+    priv->batch_buffer      = NULL;
+    priv->ts                = 0;
+    priv->ctrl_len          = 0;
     priv->params            = params;
 
 
@@ -199,6 +308,9 @@ camio_istream_t* camio_istream_raw_construct(camio_istream_raw_t* priv, const ca
     priv->istream.close         = camio_istream_raw_close;
     priv->istream.start_read    = camio_istream_raw_start_read;
     priv->istream.end_read      = camio_istream_raw_end_read;
+    priv->istream.start_read_batch = camio_istream_raw_start_read_batch;
+    priv->istream.end_read_batch   = camio_istream_raw_end_read_batch;
+    priv->istream.read_meta     = camio_istream_raw_read_meta;
     priv->istream.ready         = camio_istream_raw_ready;
     priv->istream.delete        = camio_istream_raw_delete;
     priv->istream.fd            = -1;
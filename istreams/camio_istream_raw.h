@@ -3,17 +3,29 @@
  *
  * Fe2+ raw socket input stream
  *
+ * raw:iface receives every frame on iface, in promiscuous mode
+ *
+ * Options:
+ * ts=sw|hw     Kernel, or kernel and NIC, receive timestamps for each frame, from read_meta() (see
+ *              camio_timestamp.h)
+ *
  */
 
 #ifndef CAMIO_ISTREAM_RAW_H_
 #define CAMIO_ISTREAM_RAW_H_
 
+#include <sys/socket.h>
+
 #include "camio_istream.h"
+#include "../camio_timestamp.h"
 
 /********************************************************************
  *                  PRIVATE DEFS
  ********************************************************************/
 
+#define CAMIO_ISTREAM_RAW_BATCH_MAX 64                 //Most messages read by a single batch call
+#define CAMIO_ISTREAM_RAW_BATCH_SLOT_SIZE (64 * 1024) //64kB, big enough for offloaded frames
+
 typedef struct {
     //No params at this stage
 } camio_istream_raw_params_t;
@@ -23,6 +35,13 @@ typedef struct {
     uint8_t* buffer;
     size_t buffer_size;
     size_t bytes_read;
+    uint8_t* batch_buffer;              //Pool of per-message buffers for batched reads
+    struct mmsghdr batch_msgs[CAMIO_ISTREAM_RAW_BATCH_MAX];
+    struct iovec batch_iovs[CAMIO_ISTREAM_RAW_BATCH_MAX];
+    int ts;                             //Messages carry receive timestamps
+    uint8_t batch_ctrl[CAMIO_ISTREAM_RAW_BATCH_MAX][CAMIO_TIMESTAMP_CTRL_SIZE]; //Timestamps, one per message in the pool
+    uint8_t ctrl[CAMIO_TIMESTAMP_CTRL_SIZE]; //Timestamps for single receives
+    size_t ctrl_len;
     int is_closed;                      //Has close be called?
     camio_istream_raw_params_t* params;  //Parameters passed in from the outside
 
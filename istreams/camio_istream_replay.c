@@ -0,0 +1,351 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ timed replay input stream
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "camio_istream_replay.h"
+#include "camio_istream_pcap.h"
+#include "camio_istream_pcapng.h"
+#include "../camio_mmap.h"
+#include "../camio_erf.h"
+#include "../camio_errors.h"
+#include "../camio_util.h"
+#include "../clocks/camio_tsc.h"
+
+static const char* const fmt_names[] = { "erf", "pcap", "pcapng" };
+
+
+static camio_istream_replay_fmt_e get_fmt(const camio_descr_t* descr){
+    const char* fmt = camio_descr_get_opt(descr, "fmt");
+    if(!fmt){
+        fmt = strrchr(descr->query, '.');
+        fmt = fmt ? fmt + 1 : "";
+    }
+
+    size_t i = 0;
+    for(; i < sizeof(fmt_names) / sizeof(fmt_names[0]); i++){
+        if(strcmp(fmt, fmt_names[i]) == 0){
+            return (camio_istream_replay_fmt_e)i;
+        }
+    }
+
+    eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Can't replay \"%s\", use fmt=erf|pcap|pcapng to say what it is\n", descr->query);
+    return CAMIO_ISTREAM_REPLAY_ERF;
+}
+
+
+//Returns the speed up, or 0 for as fast as possible
+static double get_speed(const camio_descr_t* descr){
+    const char* speed = camio_descr_get_opt(descr, "speed");
+    if(!speed){
+        return 1;
+    }
+    if(strcmp(speed, "max") == 0){
+        return 0;
+    }
+
+    char* end = NULL;
+    const double result = strtod(speed, &end);
+    if(*end == 'x'){
+        end++;
+    }
+    if(end == speed || *end != '\0' || !(result > 0)){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option \"speed\" expected a positive number or \"max\" but \"%s\" found\n", speed);
+    }
+    return result;
+}
+
+
+//The file istream gets the file and the mmap options, the rest are ours
+static camio_istream_t* open_file(const camio_descr_t* descr, camio_istream_replay_fmt_e fmt){
+    const char* const mmap_opts[] = { CAMIO_MMAP_OPTS };
+    size_t len = strlen(fmt_names[fmt]) + 1 + strlen(descr->query) + 1;
+    size_t i = 0;
+    for(; i < sizeof(mmap_opts) / sizeof(mmap_opts[0]); i++){
+        const char* value = camio_descr_get_opt(descr, mmap_opts[i]);
+        if(value){
+            len += 1 + strlen(mmap_opts[i]) + 1 + strlen(value);
+        }
+    }
+
+    char* file_descr = malloc(len);
+    if(!file_descr){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not allocate file description\n");
+    }
+    char* tail = file_descr + sprintf(file_descr, "%s:%s", fmt_names[fmt], descr->query);
+    for(i = 0; i < sizeof(mmap_opts) / sizeof(mmap_opts[0]); i++){
+        const char* value = camio_descr_get_opt(descr, mmap_opts[i]);
+        if(value){
+            tail += sprintf(tail, ",%s=%s", mmap_opts[i], value);
+        }
+    }
+
+    camio_istream_t* result = camio_istream_new(file_descr, NULL);
+    free(file_descr);
+    return result;
+}
+
+
+int64_t camio_istream_replay_open(camio_istream_t* this, const camio_descr_t* descr ){
+    camio_istream_replay_t* priv = this->priv;
+
+    const char* valid_opts[] = { "fmt", "speed", "spin_ns", CAMIO_MMAP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+
+    if(unlikely(!descr->query)){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
+    }
+
+    priv->fmt = get_fmt(descr);
+    const double speed = get_speed(descr);
+    priv->max_speed = speed == 0;
+    if(!priv->max_speed){
+        priv->cycles_per_ns = camio_tsc_cycles_per_ns() / speed;
+        priv->spin_cycles   = camio_tsc_ns_to_cycles(camio_descr_get_opt_uint(descr, "spin_ns", CAMIO_ISTREAM_REPLAY_SPIN_NS));
+    }
+
+    priv->file = open_file(descr, priv->fmt);
+    this->fd = priv->file->fd;
+
+    priv->is_closed = 0;
+    return CAMIO_ERR_NONE;
+}
+
+
+void camio_istream_replay_close(camio_istream_t* this){
+    camio_istream_replay_t* priv = this->priv;
+    if(priv->is_closed){
+        return;
+    }
+    priv->file->delete(priv->file);
+    priv->file      = NULL;
+    priv->next      = NULL;
+    priv->next_len  = 0;
+    priv->is_closed = 1;
+}
+
+
+//Capture time of a record in ns, returns 0 if it doesn't have one
+static inline int get_ts(camio_istream_replay_t* priv, const uint8_t* rec, size_t len, uint64_t* ns){
+    switch(priv->fmt){
+        case CAMIO_ISTREAM_REPLAY_ERF:{
+            *ns = camio_erf_ts_to_units(((const dag_record_t*)rec)->ts, 9, 0);
+            return 1;
+        }
+        case CAMIO_ISTREAM_REPLAY_PCAP:{
+            const int nano = ((camio_istream_pcap_t*)priv->file->priv)->nano;
+            *ns = camio_pcap_ts_to_ns((const camio_pcap_rec_hdr_t*)rec, nano);
+            return 1;
+        }
+        case CAMIO_ISTREAM_REPLAY_PCAPNG:{
+            const camio_pcapng_epb_t* epb = (const camio_pcapng_epb_t*)rec;
+            if(epb->hdr.type != CAMIO_PCAPNG_BLOCK_EPB){
+                return 0;
+            }
+            const camio_pcapng_if_t* iface = camio_istream_pcapng_interface(priv->file, epb->if_id);
+            if(unlikely(!iface)){
+                return 0;
+            }
+            *ns = camio_pcapng_ts_to_ns(iface, ((uint64_t)epb->ts_high << 32) | epb->ts_low);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+//Read the next record from the file and work out when it's due, if there isn't one waiting already.
+//Returns 0 at the end of the file. The file istreams hand out pointers into a mapping of the whole
+//file, so records can be released straight away and held onto for as long as we like
+static inline int fetch(camio_istream_replay_t* priv){
+    if(priv->next){
+        return 1;
+    }
+
+    uint8_t* rec = NULL;
+    const int64_t len = priv->file->start_read(priv->file, &rec);
+    priv->file->end_read(priv->file, rec);
+    if(!len){
+        return 0;
+    }
+
+    priv->next     = rec;
+    priv->next_len = len;
+    priv->next_due = 0;
+    if(priv->max_speed){
+        return 1;
+    }
+
+    uint64_t ns = 0;
+    if(!get_ts(priv, rec, len, &ns)){
+        return 1;
+    }
+
+    //Everything is timed relative to the first record
+    if(unlikely(!priv->started)){
+        priv->started   = 1;
+        priv->first_ns  = ns;
+        priv->first_tsc = camio_tsc_read();
+    }
+    if(likely(ns > priv->first_ns)){
+        priv->next_due = priv->first_tsc + (uint64_t)((ns - priv->first_ns) * priv->cycles_per_ns);
+    }
+
+    return 1;
+}
+
+
+//Wait until the next record is due. Sleep through most of a long gap, and spin out the rest
+static inline void wait_due(camio_istream_replay_t* priv){
+    uint64_t now = camio_tsc_read();
+    if(now >= priv->next_due){
+        return;
+    }
+
+    if(priv->next_due - now > priv->spin_cycles){
+        const uint64_t sleep_ns = camio_tsc_cycles_to_ns(priv->next_due - now - priv->spin_cycles);
+        const struct timespec ts = { .tv_sec = sleep_ns / (1000 * 1000 * 1000ULL), .tv_nsec = sleep_ns % (1000 * 1000 * 1000ULL) };
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+    }
+
+    while(camio_tsc_read() < priv->next_due){
+        __asm__ __volatile__("pause"); //Tell the CPU we're spinning
+    }
+}
+
+
+//Returns non-zero if the next record is due, or the file is finished
+int64_t camio_istream_replay_ready(camio_istream_t* this){
+    camio_istream_replay_t* priv = this->priv;
+    if(unlikely(priv->is_closed) || !fetch(priv)){
+        return 1;
+    }
+
+    return camio_tsc_read() >= priv->next_due;
+}
+
+
+//Blocks until the next record is due
+int64_t camio_istream_replay_start_read(camio_istream_t* this, uint8_t** out){
+    camio_istream_replay_t* priv = this->priv;
+    *out = NULL;
+
+    if(unlikely(priv->is_closed) || !fetch(priv)){
+        return 0;
+    }
+
+    wait_due(priv);
+    *out = priv->next;
+    return priv->next_len;
+}
+
+
+int64_t camio_istream_replay_end_read(camio_istream_t* this, uint8_t* free_buff){
+    camio_istream_replay_t* priv = this->priv;
+    priv->next     = NULL;
+    priv->next_len = 0;
+    return 0; //Records are never overwritten
+}
+
+
+//Waits for the first record, then hands out as many of those after it as are due already
+int64_t camio_istream_replay_start_read_batch(camio_istream_t* this, camio_iovec_t* out, size_t max){
+    camio_istream_replay_t* priv = this->priv;
+    if(unlikely(priv->is_closed || !max) || !fetch(priv)){
+        return 0;
+    }
+
+    wait_due(priv);
+    size_t i = 0;
+    do{
+        out[i].buff = priv->next;
+        out[i].len  = priv->next_len;
+        priv->next  = NULL;
+        i++;
+    } while(i < max && fetch(priv) && camio_tsc_read() >= priv->next_due);
+
+    return i;
+}
+
+
+int64_t camio_istream_replay_end_read_batch(camio_istream_t* this, size_t count){
+    return 0; //Records are never overwritten
+}
+
+
+//Records come straight from the file istream, so it knows what they carry
+int64_t camio_istream_replay_read_meta(camio_istream_t* this, const uint8_t* buff, camio_meta_t* meta){
+    camio_istream_replay_t* priv = this->priv;
+    if(unlikely(priv->is_closed)){
+        return camio_istream_read_meta_none(this, buff, meta);
+    }
+    return priv->file->read_meta(priv->file, buff, meta);
+}
+
+
+void camio_istream_replay_delete(camio_istream_t* this){
+    this->close(this);
+    camio_istream_replay_t* priv = this->priv;
+    free(priv);
+}
+
+/* ****************************************************
+ * Construction
+ */
+
+camio_istream_t* camio_istream_replay_construct(camio_istream_replay_t* priv, const camio_descr_t* descr, camio_istream_replay_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"replay stream supplied is null\n");
+    }
+
+    //Initialize the local variables
+    priv->is_closed         = 1;
+    priv->file              = NULL;
+    priv->fmt               = CAMIO_ISTREAM_REPLAY_ERF;
+    priv->max_speed         = 0;
+    priv->cycles_per_ns     = 0;
+    priv->spin_cycles       = 0;
+    priv->started           = 0;
+    priv->first_ns          = 0;
+    priv->first_tsc         = 0;
+    priv->next              = NULL;
+    priv->next_len          = 0;
+    priv->next_due          = 0;
+    priv->params            = params;
+
+    //Populate the function members
+    priv->istream.priv          = priv; //Lets us access private members
+    priv->istream.open          = camio_istream_replay_open;
+    priv->istream.close         = camio_istream_replay_close;
+    priv->istream.start_read    = camio_istream_replay_start_read;
+    priv->istream.end_read      = camio_istream_replay_end_read;
+    priv->istream.start_read_batch = camio_istream_replay_start_read_batch;
+    priv->istream.end_read_batch   = camio_istream_replay_end_read_batch;
+    priv->istream.read_meta     = camio_istream_replay_read_meta;
+    priv->istream.ready         = camio_istream_replay_ready;
+    priv->istream.delete        = camio_istream_replay_delete;
+    priv->istream.fd            = -1;
+
+    //Call open, because its the obvious thing to do now...
+    priv->istream.open(&priv->istream, descr);
+
+    //Return the generic istream interface for the outside world to use
+    return &priv->istream;
+
+}
+
+camio_istream_t* camio_istream_replay_new( const camio_descr_t* descr, camio_istream_replay_params_t* params){
+    camio_istream_replay_t* priv = malloc(sizeof(camio_istream_replay_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for replay istream creation\n");
+    }
+    return camio_istream_replay_construct(priv, descr, params);
+}
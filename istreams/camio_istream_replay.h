@@ -0,0 +1,71 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ timed replay input stream
+ *
+ * Replays an ERF, pcap or pcapng capture file, handing out each record when it is due: at its
+ * original time relative to the first record, scaled by the replay speed. The file is read by the
+ * matching file istream, and records are handed out whole, just as that stream hands them out.
+ * Short gaps are spun out on the TSC so records are released to within a fraction of a
+ * microsecond, long ones are slept through first. Records with no timestamp (pcapng Simple Packet
+ * Blocks) and records that go back in time are handed out as soon as they are asked for.
+ *
+ * Options:
+ * fmt=erf|pcap|pcapng  Format of the file, by default taken from the file's extension
+ * speed=N|max          Replay N times faster than real time (N may be fractional, and may be
+ *                      written 10x), or as fast as the file can be read. Defaults to 1
+ * spin_ns=N            Gaps longer than this are slept through, waking up this far ahead to spin
+ *                      out the rest. Defaults to 100us
+ * And the mmap options (see camio_mmap.h), which are passed on to the file istream
+ *
+ */
+
+#ifndef CAMIO_ISTREAM_REPLAY_H_
+#define CAMIO_ISTREAM_REPLAY_H_
+
+#include "camio_istream.h"
+
+#define CAMIO_ISTREAM_REPLAY_SPIN_NS (100 * 1000)     //Default spin budget, 100us covers most sleep overshoot
+
+/********************************************************************
+ *                  PRIVATE DEFS
+ ********************************************************************/
+
+typedef enum {
+    CAMIO_ISTREAM_REPLAY_ERF,
+    CAMIO_ISTREAM_REPLAY_PCAP,
+    CAMIO_ISTREAM_REPLAY_PCAPNG,
+} camio_istream_replay_fmt_e;
+
+typedef struct {
+    //No params at this stage
+} camio_istream_replay_params_t;
+
+typedef struct {
+    camio_istream_t istream;
+    int is_closed;                      //Has close be called?
+    camio_istream_t* file;              //The file istream that records come from
+    camio_istream_replay_fmt_e fmt;     //What the records look like
+    int max_speed;                      //Don't wait at all
+    double cycles_per_ns;               //TSC cycles per ns of capture time, with the speed up
+    uint64_t spin_cycles;               //Gaps shorter than this are spun
+    int started;                        //The first record has been seen
+    uint64_t first_ns;                  //Capture time of the first record
+    uint64_t first_tsc;                 //When the first record was handed out
+    uint8_t* next;                      //Record read from the file, but not handed out yet
+    size_t next_len;
+    uint64_t next_due;                  //TSC value at which to hand it out
+    camio_istream_replay_params_t* params;  //Parameters passed in from the outside
+
+} camio_istream_replay_t;
+
+
+
+/********************************************************************
+ *                  PUBLIC DEFS
+ ********************************************************************/
+
+camio_istream_t* camio_istream_replay_new( const camio_descr_t* opts,  camio_istream_replay_params_t* params);
+
+
+#endif /* CAMIO_ISTREAM_REPLAY_H_ */
@@ -18,59 +18,33 @@
 #include "../camio_util.h"
 
 
-//TODO XXX: These should be passed as options
-#define CAMIO_ISTREAM_RING_SIZE (4 * 1024 * 1024) //4MB
-#define CAMIO_ISTREAM_RING_SLOT_SIZE (4 * 1024)  //4K
-
 int64_t camio_istream_ring_open(camio_istream_t* this, const camio_descr_t* descr ){
     camio_istream_ring_t* priv = this->priv;
-    int ring_fd = -1;
-    volatile uint8_t* ring = NULL;
-
-    if(unlikely((size_t)descr->opt_head)){
-        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option(s) supplied, but none expected\n");
-    }
-
-    if(unlikely(!descr->query)){
-        eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
-    }
-
-    ring_fd = open(descr->query, O_RDONLY);
-    //If that fails, try opening and creating the file
-    if(unlikely(ring_fd < 0)){
-        ring_fd = open(descr->query, O_RDWR | O_CREAT | O_TRUNC , (mode_t)(0666));
-        if(unlikely(ring_fd < 0)){
-            eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\". Error=%s\n", descr->query, strerror(errno));
-        }
-
-        //Resize the file
-        if(lseek(ring_fd, CAMIO_ISTREAM_RING_SIZE -1, SEEK_SET) < 0){
-            eprintf_exit(CAMIO_ERR_FILE_LSEEK, "Could not resize file for shared region \"%s\". Error=%s\n", descr->query, strerror(errno));
-        }
 
-        if(write(ring_fd, "", 1) < 0){
-            eprintf_exit(CAMIO_ERR_FILE_WRITE, "Could not resize file for shared region \"%s\". Error=%s\n", descr->query, strerror(errno));
-        }
+    const char* valid_opts[] = { "size", "slot", "block", CAMIO_MMAP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
 
-        ring = mmap( NULL, CAMIO_ISTREAM_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
-        if(unlikely(ring == MAP_FAILED)){
-            eprintf_exit(CAMIO_ERR_MMAP, "Could not memory map ring file \"%s\". Error=%s\n", descr->query, strerror(errno));
-        }
+    //Readers need write access to publish their position in the reader table
+    camio_ring_open(&priv->ring, descr, CAMIO_RING_TYPE_SLOT, 1);
 
-        //Initialize the ring with 0
-        memset((uint8_t*)ring, 0, CAMIO_ISTREAM_RING_SIZE);
-    }else{
-        ring = mmap( NULL, CAMIO_ISTREAM_RING_SIZE, PROT_READ, MAP_SHARED, ring_fd, 0);
-        if(unlikely(ring == MAP_FAILED)){
-            eprintf_exit(CAMIO_ERR_MMAP, "Could not memory map ring file \"%s\". Error=%s\n", descr->query, strerror(errno));
-        }
+    //Join at the head, anything already in the ring was written before we arrived. Unless the
+    //writer is lossless, in which case it's been keeping everything that hasn't been consumed for us
+    if(priv->ring.hdr->flags & CAMIO_RING_FLAG_LOSSLESS){
+        priv->sync_counter = priv->ring.hdr->read_tail;
     }
+    else{
+        priv->sync_counter = priv->ring.hdr->write_seq + 1;
+    }
+    priv->index = (priv->sync_counter - 1) % priv->ring.slot_count;
+    priv->reader       = camio_ring_reader_register(&priv->ring, priv->sync_counter);
 
+    priv->block = camio_descr_get_opt_bool(descr, "block", 0);
+    if(priv->block){
+        camio_ring_blocker_add(&priv->ring, priv->reader);
+    }
 
-    priv->ring_size = CAMIO_ISTREAM_RING_SIZE;
-    this->fd = ring_fd;
-    priv->ring = ring;
-    priv->curr = ring;
+    this->fd = priv->ring.fd;
+    priv->curr = camio_ring_slot(&priv->ring, priv->index);
     priv->is_closed = 0;
 
     return CAMIO_ERR_NONE;
@@ -79,12 +53,26 @@ int64_t camio_istream_ring_open(camio_istream_t* this, const camio_descr_t* desc
 
 void camio_istream_ring_close(camio_istream_t* this){
     camio_istream_ring_t* priv = this->priv;
-    munmap((void*)priv->ring, priv->ring_size);
-    close(this->fd);
+    if(priv->block){
+        camio_ring_blocker_remove(&priv->ring, priv->reader);
+        priv->block = 0;
+    }
+    if(priv->reader >= 0){
+        camio_ring_reader_release(&priv->ring, priv->reader);
+        priv->reader = -1;
+    }
+    camio_ring_close(&priv->ring);
     priv->is_closed = 1;
 }
 
 
+//The writer has lapped us, everything from the sync count we wanted up to the one that's there now is gone
+static void count_lost(camio_istream_ring_t* priv, uint64_t curr_sync_count){
+    const uint64_t lost = curr_sync_count - priv->sync_counter;
+    priv->lost += lost;
+    priv->ring.hdr->readers[priv->reader].lost = priv->lost;
+    priv->sync_counter = curr_sync_count;
+}
 
 
 static int prepare_next(camio_istream_ring_t* priv){
@@ -95,17 +83,17 @@ static int prepare_next(camio_istream_ring_t* priv){
     }
 
     //Is there new data?
-    register uint64_t curr_sync_count = *((volatile uint64_t*)(priv->curr + CAMIO_ISTREAM_RING_SLOT_SIZE - sizeof(uint64_t)));
+    register uint64_t curr_sync_count = *camio_ring_slot_sync(&priv->ring, priv->curr);
     if( likely(curr_sync_count == priv->sync_counter)){
-        const uint64_t data_len  = *((volatile uint64_t*)(priv->curr + CAMIO_ISTREAM_RING_SLOT_SIZE - 2* sizeof(uint64_t)));
+        const uint64_t data_len  = *camio_ring_slot_len(&priv->ring, priv->curr);
         priv->read_size = data_len;
         return data_len;
     }
 
     if( likely(curr_sync_count > priv->sync_counter)){
-        wprintf(CAMIO_ERR_UNKNOWN_OSTREAM, "Ring overflow. Catching up now. Dropping payloads from %lu to %lu\n", priv->sync_counter, curr_sync_count -1);
-        priv->sync_counter = curr_sync_count;
-        const uint64_t data_len  = *((volatile uint64_t*)(priv->curr + CAMIO_ISTREAM_RING_SLOT_SIZE - 2* sizeof(uint64_t)));
+        wprintf(CAMIO_ERR_BUFFER_OVERRUN, "Ring overflow. Caught up, dropped %lu records from %lu to %lu\n", curr_sync_count - priv->sync_counter, priv->sync_counter, curr_sync_count -1);
+        count_lost(priv, curr_sync_count);
+        const uint64_t data_len  = *camio_ring_slot_len(&priv->ring, priv->curr);
         priv->read_size = data_len;
         return data_len;
     }
@@ -113,6 +101,19 @@ static int prepare_next(camio_istream_ring_t* priv){
     return 0;
 }
 
+//Spin until there's data. Blocking readers go to sleep if it doesn't turn up soon
+static void wait_for_data(camio_istream_ring_t* priv){
+    uint64_t spins = 0;
+    while(!prepare_next(priv)){
+        if(priv->block && ++spins >= CAMIO_RING_BLOCK_SPINS){
+            const uint32_t seen = camio_ring_wait_begin(&priv->ring, priv->reader);
+            camio_ring_wait_end(&priv->ring, priv->reader, seen, !prepare_next(priv));
+            continue;
+        }
+        __asm__ __volatile__("pause"); //Tell the CPU we're spinning
+    }
+}
+
 int64_t camio_istream_ring_ready(camio_istream_t* this){
     camio_istream_ring_t* priv = this->priv;
     if(priv->read_size || priv->is_closed){
@@ -132,9 +133,7 @@ int64_t camio_istream_ring_start_read(camio_istream_t* this, uint8_t** out){
 
     //Called read without calling ready, they must want to block/spin waiting for data
     if(unlikely(!priv->read_size)){
-        while(!prepare_next(priv)){
-            __asm__ __volatile__("pause"); //Tell the CPU we're spinning
-        }
+        wait_for_data(priv);
     }
 
     *out = (uint8_t*)priv->curr;
@@ -146,19 +145,72 @@ int64_t camio_istream_ring_start_read(camio_istream_t* this, uint8_t** out){
 int64_t camio_istream_ring_end_read(camio_istream_t* this, uint8_t* free_buff){
     camio_istream_ring_t* priv = this->priv;
 
-    register uint64_t curr_sync_count = *((volatile uint64_t*)(priv->curr + CAMIO_ISTREAM_RING_SLOT_SIZE - sizeof(uint64_t)));
+    register uint64_t curr_sync_count = *camio_ring_slot_sync(&priv->ring, priv->curr);
     if( unlikely(curr_sync_count != priv->sync_counter)){
         //wprintf(CAMIO_ERR_BUFFER_OVERRUN, "Detected overrun in ring buffer sync count is now=%lu, expected sync count=%lu\n", curr_sync_count, priv->sync_counter);
-        priv->sync_counter = curr_sync_count;
+        count_lost(priv, curr_sync_count);
         priv->read_size = 0;
         return -1;
     }
 
     priv->read_size = 0;
     priv->sync_counter++;
-    priv->index = (priv->index + 1) % (CAMIO_ISTREAM_RING_SIZE / CAMIO_ISTREAM_RING_SLOT_SIZE);
-    priv->curr  = priv->ring + (priv->index * CAMIO_ISTREAM_RING_SLOT_SIZE);
+    priv->index = (priv->index + 1) % priv->ring.slot_count;
+    priv->curr  = camio_ring_slot(&priv->ring, priv->index);
+
+    //Let the writer know how far we've got
+    __atomic_store_n(&priv->ring.hdr->readers[priv->reader].read_seq, priv->sync_counter, __ATOMIC_RELEASE);
+
 
+    return 0;
+}
+
+
+//Hand out every consecutive slot that has been committed, starting at the current one
+int64_t camio_istream_ring_start_read_batch(camio_istream_t* this, camio_iovec_t* out, size_t max){
+    camio_istream_ring_t* priv = this->priv;
+
+    if(unlikely(priv->is_closed || !max)){
+        return 0;
+    }
+
+    //Called read without calling ready, they must want to block/spin waiting for data
+    if(unlikely(!priv->read_size)){
+        wait_for_data(priv);
+    }
+
+    out[0].buff = (uint8_t*)priv->curr;
+    out[0].len  = priv->read_size;
+
+    const uint64_t slots = priv->ring.slot_count;
+    uint64_t index       = priv->index;
+    uint64_t sync_count  = priv->sync_counter;
+    size_t count         = 1;
+    for(; count < max && count < slots; count++){
+        index = (index + 1) % slots;
+        sync_count++;
+
+        volatile uint8_t* slot = camio_ring_slot(&priv->ring, index);
+        if(*camio_ring_slot_sync(&priv->ring, slot) != sync_count){
+            break; //Not written yet
+        }
+
+        out[count].buff = (uint8_t*)slot;
+        out[count].len  = *camio_ring_slot_len(&priv->ring, slot);
+    }
+
+    return count;
+}
+
+
+int64_t camio_istream_ring_end_read_batch(camio_istream_t* this, size_t count){
+    size_t i = 0;
+    for(; i < count; i++){
+        //Once the writer has lapped us the rest of the batch is garbage too, resync from here
+        if(unlikely(camio_istream_ring_end_read(this, NULL))){
+            return -1;
+        }
+    }
 
     return 0;
 }
@@ -181,12 +233,15 @@ camio_istream_t* camio_istream_ring_construct(camio_istream_ring_t* priv, const
 
     //Initialize the local variables
     priv->is_closed         = 1;
-    priv->ring              = NULL;
-    priv->ring_size         = 0;
+    priv->ring.fd           = -1;
+    priv->ring.map          = NULL;
     priv->curr              = NULL;
     priv->read_size         = 0;
     priv->sync_counter      = 1; //We will expect 1 when the first write occurs
     priv->index             = 0;
+    priv->reader            = -1;
+    priv->lost              = 0;
+    priv->block             = 0;
     priv->params            = params;
 
     //Populate the function members
@@ -195,6 +250,9 @@ camio_istream_t* camio_istream_ring_construct(camio_istream_ring_t* priv, const
     priv->istream.close         = camio_istream_ring_close;
     priv->istream.start_read    = camio_istream_ring_start_read;
     priv->istream.end_read      = camio_istream_ring_end_read;
+    priv->istream.start_read_batch = camio_istream_ring_start_read_batch;
+    priv->istream.end_read_batch   = camio_istream_ring_end_read_batch;
+    priv->istream.read_meta     = camio_istream_read_meta_none;
     priv->istream.ready         = camio_istream_ring_ready;
     priv->istream.delete        = camio_istream_ring_delete;
     priv->istream.fd            = -1;
@@ -9,6 +9,7 @@
 #define CAMIO_ISTREAM_RING_H_
 
 #include "camio_istream.h"
+#include "../camio_ring.h"
 
 #define CAMIO_ISTREAM_RING_BLOCKING    1
 #define CAMIO_ISTREAM_RING_NONBLOCKING 0
@@ -25,12 +26,14 @@ typedef struct {
 typedef struct {
     camio_istream_t istream;
     int is_closed;                       //Has close be called?
-    volatile uint8_t* ring;              //Pointer to the head of the ring
-    size_t ring_size;                    //Size of the ring buffer
+    camio_ring_t ring;                   //The shared ring
+    int block;                           //Sleep on the ring futex rather than spinning forever
     volatile uint8_t* curr;              //Current slot in the ring
     size_t read_size;                    //Size of the current read waiting (if any)
     uint64_t sync_counter;               //Synchronization counter
     uint64_t index;                      //Current index into the buffer
+    int reader;                          //Our entry in the ring's reader table
+    uint64_t lost;                       //Records lost because the writer lapped us
     camio_istream_ring_params_t* params;  //Parameters passed in from the outside
 
 } camio_istream_ring_t;
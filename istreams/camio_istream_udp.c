@@ -16,56 +16,185 @@
 #include <netpacket/packet.h>
 #include <net/ethernet.h>
 #include <string.h>
-#include <fcntl.h>
 #include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
 
 #include "camio_istream_udp.h"
 #include "../camio_errors.h"
+#include "../camio_util.h"
+#include "../parsing/addr_parser.h"
 
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+
+static void batch_init(camio_istream_udp_t* priv, size_t count);
+
+
+//Interface index and address for iface, which may be NULL for the kernel's choice
+static void get_iface(int sock_fd, const char* iface, int* index, struct in_addr* addr){
+    *index = 0;
+    addr->s_addr = htonl(INADDR_ANY);
+    if(!iface){
+        return;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(struct ifreq));
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ-1);
+    if (ioctl(sock_fd, SIOCGIFINDEX, &ifr) < 0){
+        eprintf_exit(CAMIO_ERR_IOCTL,"Could not get interface \"%s\". Error = %s\n",iface,strerror(errno));
+    }
+    *index = ifr.ifr_ifindex;
+
+    //Only source specific joins need the address, and an interface without one can still do the rest
+    if (ioctl(sock_fd, SIOCGIFADDR, &ifr) == 0){
+        *addr = ((struct sockaddr_in*)&ifr.ifr_addr)->sin_addr;
+    }
+}
+
+
+//Join the group in priv->addr on iface, from just source if it's given
+static void join_group(camio_istream_udp_t* priv, int sock_fd, const char* iface, const char* source){
+    int if_index = 0;
+    struct in_addr if_addr;
+    get_iface(sock_fd, iface, &if_index, &if_addr);
+
+    if(source){
+        const addr_result_t source_addr = parse_ip(source);
+        if(!source_addr.valid || source_addr.addr.sin_addr.s_addr == htonl(INADDR_ANY)){
+            eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option \"source\" expected an IP address but \"%s\" found\n", source);
+        }
+        if(iface && if_addr.s_addr == htonl(INADDR_ANY)){
+            eprintf_exit(CAMIO_ERR_IOCTL, "Interface \"%s\" has no address to join from\n", iface);
+        }
+
+        struct ip_mreq_source mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.imr_multiaddr  = priv->addr.sin_addr;
+        mreq.imr_interface  = if_addr;
+        mreq.imr_sourceaddr = source_addr.addr.sin_addr;
+        if(setsockopt(sock_fd, IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP, &mreq, sizeof(mreq)) < 0){
+            eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not join group %s from %s. Error = %s\n",inet_ntoa(priv->addr.sin_addr),source,strerror(errno));
+        }
+        return;
+    }
+
+    struct ip_mreqn mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.imr_multiaddr = priv->addr.sin_addr;
+    mreq.imr_ifindex   = if_index;
+    if(setsockopt(sock_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0){
+        eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not join group %s. Error = %s\n",inet_ntoa(priv->addr.sin_addr),strerror(errno));
+    }
+}
+
+
+//Every socket in the port's reuseport group runs the same program, which picks socket (key % shards),
+//counting in the order that they were bound. The program sees the datagram with its payload at
+//offset 0, so the headers are reached through SKF_NET_OFF
+static void steer_shards(int sock_fd, size_t shards, const char* steer){
+    //By flow: the source address folded together with both ports, which any device can do
+    struct sock_filter flow[] = {
+        BPF_STMT(BPF_LDX | BPF_B   | BPF_MSH, SKF_NET_OFF),         //X = IP header length
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_IND, SKF_NET_OFF),         //A = source port << 16 | dest port
+        BPF_STMT(BPF_MISC| BPF_TAX,           0),
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_NET_OFF + 12),    //A = source address
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X,   0),
+        BPF_STMT(BPF_MISC| BPF_TAX,           0),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K,   16),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X,   0),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K,   shards),
+        BPF_STMT(BPF_RET | BPF_A,             0),
+    };
+
+    //By the device's receive hash or the receiving CPU, which keep each shard with its receive queue
+    struct sock_filter ancillary[] = {
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_AD_OFF + SKF_AD_RXHASH),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K,   shards),
+        BPF_STMT(BPF_RET | BPF_A,             0),
+    };
+
+    struct sock_fprog prog = { .len = sizeof(flow) / sizeof(flow[0]), .filter = flow };
+    if(steer && strcmp(steer, "hash") == 0){
+        prog.len    = sizeof(ancillary) / sizeof(ancillary[0]);
+        prog.filter = ancillary;
+    }
+    else if(steer && strcmp(steer, "cpu") == 0){
+        ancillary[0].k = SKF_AD_OFF + SKF_AD_CPU;
+        prog.len       = sizeof(ancillary) / sizeof(ancillary[0]);
+        prog.filter    = ancillary;
+    }
+    else if(steer && strcmp(steer, "flow") != 0){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option \"steer\" expected flow, hash or cpu but \"%s\" found\n", steer);
+    }
+
+    if(setsockopt(sock_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0){
+        eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not attach shard steering program. Error = %s\n",strerror(errno));
+    }
+}
 
 
 int64_t camio_istream_udp_open(camio_istream_t* this, const camio_descr_t* descr ){
     camio_istream_udp_t* priv = this->priv;
-    char ip_addr[17]; //IP addr is worst case, 16 bytes long (255.255.255.255)
-    char udp_port[6]; //UDP port is wost case, 5 bytes long (65536)
     int udp_sock_fd;
 
-    if(descr->opt_head){
-         eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option(s) supplied, but none expected\n");
-     }
+    const char* valid_opts[] = { "batch", "slot", "gro", "iface", "source", "reuseport", "shards", "steer", CAMIO_TIMESTAMP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+    priv->batch           = camio_descr_get_opt_uint(descr, "batch", 0);
+    priv->batch_slot_size = camio_descr_get_opt_uint(descr, "slot", CAMIO_ISTREAM_UDP_BATCH_SLOT_SIZE);
+    if(priv->batch > CAMIO_ISTREAM_UDP_BATCH_LIMIT){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Batch size %lu is more than the most (%u) that can be received at once\n", priv->batch, CAMIO_ISTREAM_UDP_BATCH_LIMIT);
+    }
+    if(!priv->batch_slot_size){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Slot size must be greater than 0\n");
+    }
+    priv->gro = camio_descr_get_opt_bool(descr, "gro", 0);
+    if(priv->gro && priv->batch_slot_size < CAMIO_ISTREAM_UDP_BATCH_SLOT_SIZE){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Slot size must be at least %u to hold coalesced datagrams\n", CAMIO_ISTREAM_UDP_BATCH_SLOT_SIZE);
+    }
+
+    const char* iface  = camio_descr_get_opt(descr, "iface");
+    const char* source = camio_descr_get_opt(descr, "source");
+    const size_t shards  = camio_descr_get_opt_uint(descr, "shards", 0);
+    const int reuseport  = camio_descr_get_opt_bool(descr, "reuseport", 0) || shards;
+    if(camio_descr_get_opt(descr, "steer") && !shards){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option \"steer\" needs shards=N\n");
+    }
 
     if(!descr->query){
         eprintf_exit(CAMIO_ERR_SOCKET, "No address supplied\n");
     }
 
-    const size_t query_len = strlen(descr->query);
-    if(query_len > 22){
-        eprintf_exit(CAMIO_ERR_SOCKET, "IP Address supplied is >22 chars \"%s\"\n", descr->query);
+    const addr_result_t addr = parse_ip_port(descr->query);
+    if(!addr.valid){
+        eprintf_exit(CAMIO_ERR_SOCKET, "Expected an address like ip:port or *:port but \"%s\" found\n", descr->query);
     }
+    priv->addr = addr.addr;
 
-    //Find the IP:port
-    size_t i = 0;
-    for(; i < query_len; i++ ){
-        if(descr->query[i] == ':'){
-            memcpy(ip_addr,descr->query,i);
-            ip_addr[i] = '\0';
-            memcpy(udp_port,&descr->query[i+1],query_len - i -1);
-            udp_port[query_len - i -1] = '\0';
-            break;
-        }
+    const int multicast = IN_MULTICAST(ntohl(priv->addr.sin_addr.s_addr));
+    if(source && !multicast){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option \"source\" only applies to multicast groups, not \"%s\"\n", descr->query);
     }
 
 
-    if(query_len > 22){
-        eprintf_exit(CAMIO_ERR_SOCKET, "IP Address supplied does not have a \":\" for the port number \"%s\"\n", descr->query);
+    //Batched streams read everything into the pool, the rest only need it for batched reads
+    if(priv->batch){
+        batch_init(priv, priv->batch);
     }
-
-
-    priv->buffer = malloc(getpagesize() * 1024); //Allocate 4Mb for the buffer
-    if(!priv->buffer){
-        eprintf_exit(CAMIO_ERR_NULL_PTR, "Failed to allocate message buffer\n");
+    else{
+        priv->buffer = malloc(getpagesize() * 1024); //Allocate 4Mb for the buffer
+        if(!priv->buffer){
+            eprintf_exit(CAMIO_ERR_NULL_PTR, "Failed to allocate message buffer\n");
+        }
+        priv->buffer_size = getpagesize() * 1024;
     }
-    priv->buffer_size = getpagesize() * 1024;
 
     /* Open the udp socket MAC/PHY layer output stage */
     udp_sock_fd = socket(AF_INET,SOCK_DGRAM,0);
@@ -73,16 +202,31 @@ int64_t camio_istream_udp_open(camio_istream_t* this, const camio_descr_t* descr
         eprintf_exit(CAMIO_ERR_SOCKET,"Could not open udp socket. Error = %s\n",strerror(errno));
     }
 
-    struct sockaddr_in addr;
-    memset(&addr,0,sizeof(addr));
-    addr.sin_family      = AF_INET;
-    addr.sin_addr.s_addr = inet_addr(ip_addr);
-    addr.sin_port        = htons(strtol(udp_port,NULL,10));
+    //Let other listeners on the same host join the group too
+    int one = 1;
+    if(multicast && setsockopt(udp_sock_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0){
+        eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not set socket option. Error = %s\n",strerror(errno));
+    }
+    if(reuseport && setsockopt(udp_sock_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0){
+        eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not set socket option. Error = %s\n",strerror(errno));
+    }
+    //Unicast streams only take datagrams that arrive on iface, multicast ones join on it instead
+    if(iface && !multicast && setsockopt(udp_sock_fd, SOL_SOCKET, SO_BINDTODEVICE, iface, strlen(iface)) < 0){
+        eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not bind to interface \"%s\". Error = %s\n",iface,strerror(errno));
+    }
+
+    //Binding to the group address keeps out datagrams for other groups on the same port
+    if( bind(udp_sock_fd, (struct sockaddr *)&priv->addr, sizeof(priv->addr)) ){
+         eprintf_exit(CAMIO_ERR_BIND,"Could not bind udp socket to \"%s\". Error = %s\n",descr->query,strerror(errno));
+    }
 
-    printf("%X\n", addr.sin_addr.s_addr);
+    if(multicast){
+        join_group(priv, udp_sock_fd, iface, source);
+    }
 
-    if( bind(udp_sock_fd, (struct sockaddr *)&addr, sizeof(addr)) ){
-         eprintf_exit(CAMIO_ERR_BIND,"Could not bind raw socket. Error = %s\n",strerror(errno));
+    //The program belongs to the port's group, so it's attached once the socket has joined it
+    if(shards){
+        steer_shards(udp_sock_fd, shards, camio_descr_get_opt(descr, "steer"));
     }
 
     int RCVBUFF_SIZE = 512 * 1024 * 1024;
@@ -90,8 +234,14 @@ int64_t camio_istream_udp_open(camio_istream_t* this, const camio_descr_t* descr
         eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not set socket option. Error = %s\n",strerror(errno));
     }
 
+    int gro = 1;
+    if(priv->gro && setsockopt(udp_sock_fd, SOL_UDP, UDP_GRO, &gro, sizeof(gro)) < 0){
+        eprintf_exit(CAMIO_ERR_SOCK_OPT,"UDP GRO is not supported. Error = %s\n",strerror(errno));
+    }
+
+    priv->ts = camio_timestamp_open(udp_sock_fd, descr, iface);
+
 
-    priv->addr = addr;
     this->fd = udp_sock_fd;
     priv->is_closed = 0;
     return CAMIO_ERR_NONE;
@@ -103,44 +253,164 @@ void camio_istream_udp_close(camio_istream_t* this){
     camio_istream_udp_t* priv = this->priv;
     close(this->fd);
     free(priv->buffer);
+    free(priv->batch_buffer);
+    free(priv->batch_msgs);
+    free(priv->batch_iovs);
+    free(priv->batch_ctrl);
 }
 
-static void set_fd_blocking(int fd, int blocking){
-    int flags = fcntl(fd, F_GETFL, 0);
 
-    if (flags == -1){
-        eprintf_exit(CAMIO_ERR_FILE_FLAGS, "Could not get file flags\n");
+static void batch_init(camio_istream_udp_t* priv, size_t count){
+    priv->batch_buffer = malloc(count * priv->batch_slot_size);
+    priv->batch_msgs   = calloc(count, sizeof(struct mmsghdr));
+    priv->batch_iovs   = calloc(count, sizeof(struct iovec));
+    priv->batch_ctrl   = calloc(count, CAMIO_ISTREAM_UDP_CTRL_SIZE);
+    if(!priv->batch_buffer || !priv->batch_msgs || !priv->batch_iovs || !priv->batch_ctrl){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Failed to allocate batch message buffers\n");
     }
 
-    if (blocking){
-        flags &= ~O_NONBLOCK;
+    size_t i = 0;
+    for(; i < count; i++){
+        priv->batch_iovs[i].iov_base = priv->batch_buffer + i * priv->batch_slot_size;
+        priv->batch_iovs[i].iov_len  = priv->batch_slot_size;
+        priv->batch_msgs[i].msg_hdr.msg_iov    = &priv->batch_iovs[i];
+        priv->batch_msgs[i].msg_hdr.msg_iovlen = 1;
     }
-    else{
-        flags |= O_NONBLOCK;
+    priv->batch_count = count;
+}
+
+
+//Receive up to max messages into the pool, which must have all been handed out already. Returns
+//the number received, 0 if none were waiting and flags say not to wait
+static size_t batch_fill(camio_istream_udp_t* priv, size_t max, int flags){
+    priv->queue_next  = 0;
+    priv->queue_count = 0;
+    max = MIN(max, priv->batch_count);
+
+    //The kernel shrinks the control space to what it used, so it has to be given back each time
+    size_t i = 0;
+    for(; (priv->gro || priv->ts) && i < max; i++){
+        priv->batch_msgs[i].msg_hdr.msg_control    = priv->batch_ctrl + i * CAMIO_ISTREAM_UDP_CTRL_SIZE;
+        priv->batch_msgs[i].msg_hdr.msg_controllen = CAMIO_ISTREAM_UDP_CTRL_SIZE;
     }
 
-    if( fcntl(fd, F_SETFL, flags) == -1){
-        eprintf_exit(CAMIO_ERR_FILE_FLAGS, "Could not set file flags\n");
+    int msgs = recvmmsg(priv->istream.fd, priv->batch_msgs, max, flags, NULL);
+    if(msgs < 0){
+        if(errno == EWOULDBLOCK || errno == EAGAIN){
+            return 0;
+        }
+        eprintf_exit(CAMIO_ERR_RCV,"Could not receive from socket. Error = %s\n",strerror(errno));
     }
+
+    priv->queue_count = msgs;
+    return msgs;
 }
 
+
+//Size of the datagrams that the kernel coalesced into a message of len bytes, len if it didn't
+static inline size_t gro_size(camio_istream_udp_t* priv, struct msghdr* hdr, size_t len){
+    if(!priv->gro){
+        return len;
+    }
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
+    for(; cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)){
+        if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO){
+            int seg_size = 0;
+            memcpy(&seg_size, CMSG_DATA(cmsg), sizeof(seg_size));
+            return seg_size > 0 ? (size_t)seg_size : len;
+        }
+    }
+
+    return len;
+}
+
+
+//Hand out the next datagram from a coalesced message
+static inline void next_seg(camio_istream_udp_t* priv, camio_iovec_t* out){
+    out->buff = priv->seg_data;
+    out->len  = MIN(priv->seg_size, priv->seg_left);
+    priv->seg_data += out->len;
+    priv->seg_left -= out->len;
+}
+
+
+//Hand out a message as one record, or start splitting it up if the kernel coalesced it
+static inline void split(camio_istream_udp_t* priv, uint8_t* buff, size_t len, size_t seg_size, camio_iovec_t* out){
+    priv->seg_data = buff;
+    priv->seg_left = len;
+    priv->seg_size = seg_size;
+    next_seg(priv, out);
+}
+
+
+//Hand out up to max records: the rest of a coalesced message first, then messages waiting in the pool
+static inline size_t batch_take(camio_istream_udp_t* priv, camio_iovec_t* out, size_t max){
+    size_t i = 0;
+    while(i < max){
+        if(priv->seg_left){
+            next_seg(priv, &out[i++]);
+            continue;
+        }
+        if(priv->queue_next == priv->queue_count){
+            break;
+        }
+
+        struct mmsghdr* msg = &priv->batch_msgs[priv->queue_next];
+        split(priv, priv->batch_iovs[priv->queue_next].iov_base, msg->msg_len, gro_size(priv, &msg->msg_hdr, msg->msg_len), &out[i++]);
+        priv->queue_next++;
+    }
+    return i;
+}
+
+
+static inline int in_pool(camio_istream_udp_t* priv, const uint8_t* buff){
+    return priv->batch_buffer && buff >= priv->batch_buffer && buff < priv->batch_buffer + priv->batch_count * priv->batch_slot_size;
+}
+
+
 static int prepare_next(camio_istream_udp_t* priv, int blocking){
     if(priv->bytes_read){
         return priv->bytes_read;
     }
 
-    set_fd_blocking(priv->istream.fd, blocking);
+    camio_iovec_t msg;
+    if(priv->batch || priv->seg_left || priv->queue_next < priv->queue_count){
+        if(!priv->seg_left && priv->queue_next == priv->queue_count && !batch_fill(priv, priv->batch, blocking ? MSG_WAITFORONE : MSG_DONTWAIT)){
+            return 0;
+        }
+        if(unlikely(!batch_take(priv, &msg, 1))){
+            return 0;
+        }
+        priv->data       = msg.buff;
+        priv->bytes_read = msg.len;
+        return msg.len;
+    }
 
-    int bytes = recv(priv->istream.fd,priv->buffer,priv->buffer_size, 0);
+    struct iovec iov = { .iov_base = priv->buffer, .iov_len = priv->buffer_size };
+    struct msghdr hdr = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if(priv->gro || priv->ts){
+        hdr.msg_control    = priv->ctrl;
+        hdr.msg_controllen = sizeof(priv->ctrl);
+    }
+
+    int bytes = recvmsg(priv->istream.fd, &hdr, blocking ? 0 : MSG_DONTWAIT);
     if( bytes < 0){
+        if(errno == EWOULDBLOCK || errno == EAGAIN){
+            return 0;
+        }
         eprintf_exit(CAMIO_ERR_RCV,"Could not receive from socket. Error = %s\n",strerror(errno));
     }
 
-    priv->bytes_read = bytes;
-    return bytes;
+    priv->ctrl_len = hdr.msg_controllen;
+    split(priv, priv->buffer, bytes, gro_size(priv, &hdr, bytes), &msg);
+    priv->data       = msg.buff;
+    priv->bytes_read = msg.len;
+    return msg.len;
 
 }
 
+
 int64_t camio_istream_udp_ready(camio_istream_t* this){
     camio_istream_udp_t* priv = this->priv;
     if(priv->bytes_read || priv->is_closed){
@@ -166,7 +436,7 @@ static int64_t camio_istream_udp_start_read(camio_istream_t* this, uint8_t** out
         }
     }
 
-    *out = priv->buffer;
+    *out = priv->data;
     size_t result = priv->bytes_read; //Strip off the newline
     priv->bytes_read = 0;
 
@@ -179,6 +449,63 @@ int64_t camio_istream_udp_end_read(camio_istream_t* this, uint8_t* free_buff){
 }
 
 
+static int64_t camio_istream_udp_start_read_batch(camio_istream_t* this, camio_iovec_t* out, size_t max){
+    camio_istream_udp_t* priv = this->priv;
+    if(unlikely(priv->is_closed || !max)){
+        return 0;
+    }
+
+    //Only streams that are read in batches pay for the message pool
+    if(unlikely(!priv->batch_buffer)){
+        batch_init(priv, CAMIO_ISTREAM_UDP_BATCH_MAX);
+    }
+
+    //A call to ready() may have left a message waiting, it goes first, then anything left over from
+    //the last batch
+    size_t count = 0;
+    if(priv->bytes_read){
+        out[0].buff      = priv->data;
+        out[0].len       = priv->bytes_read;
+        priv->bytes_read = 0;
+        count            = 1;
+    }
+    count += batch_take(priv, out + count, max - count);
+
+    //The pool can't be refilled while any of it is being handed out
+    size_t i = 0;
+    for(; i < count && !in_pool(priv, out[i].buff); i++){}
+    if(count >= max || i < count){
+        return count;
+    }
+
+    //Block for the first message only if there is nothing to hand back yet
+    batch_fill(priv, max - count, count ? MSG_DONTWAIT : MSG_WAITFORONE);
+    count += batch_take(priv, out + count, max - count);
+    return count;
+}
+
+
+int64_t camio_istream_udp_end_read_batch(camio_istream_t* this, size_t count){
+    return 0; //Always true for socket I/O, the pool is only reused by the next batch
+}
+
+
+//Timestamps come from the control messages of whichever receive the record came in on
+int64_t camio_istream_udp_read_meta(camio_istream_t* this, const uint8_t* buff, camio_meta_t* meta){
+    camio_istream_udp_t* priv = this->priv;
+    if(!priv->ts){
+        return camio_istream_read_meta_none(this, buff, meta);
+    }
+
+    if(in_pool(priv, buff)){
+        return camio_timestamp_get(&priv->batch_msgs[(buff - priv->batch_buffer) / priv->batch_slot_size].msg_hdr, meta);
+    }
+
+    struct msghdr hdr = { .msg_control = priv->ctrl, .msg_controllen = priv->ctrl_len };
+    return camio_timestamp_get(&hdr, meta);
+}
+
+
 void camio_istream_udp_delete(camio_istream_t* this){
     this->close(this);
     camio_istream_udp_t* priv = this->priv;
@@ -197,7 +524,23 @@ camio_istream_t* camio_istream_udp_construct(camio_istream_udp_t* priv, const ca
     priv->is_closed         = 1;
     priv->buffer            = NULL;
     priv->buffer_size       = 0;
+    priv->data              = NULL;
     priv->bytes_read        = 0;
+    priv->batch             = 0;
+    priv->batch_slot_size   = CAMIO_ISTREAM_UDP_BATCH_SLOT_SIZE;
+    priv->batch_count       = 0;
+    priv->batch_buffer      = NULL;
+    priv->batch_msgs        = NULL;
+    priv->batch_iovs        = NULL;
+    priv->queue_next        = 0;
+    priv->queue_count       = 0;
+    priv->gro               = 0;
+    priv->ts                = 0;
+    priv->batch_ctrl        = NULL;
+    priv->ctrl_len          = 0;
+    priv->seg_data          = NULL;
+    priv->seg_left          = 0;
+    priv->seg_size          = 0;
     priv->params            = params;
 
 
@@ -207,6 +550,9 @@ camio_istream_t* camio_istream_udp_construct(camio_istream_udp_t* priv, const ca
     priv->istream.close         = camio_istream_udp_close;
     priv->istream.start_read    = camio_istream_udp_start_read;
     priv->istream.end_read      = camio_istream_udp_end_read;
+    priv->istream.start_read_batch = camio_istream_udp_start_read_batch;
+    priv->istream.end_read_batch   = camio_istream_udp_end_read_batch;
+    priv->istream.read_meta     = camio_istream_udp_read_meta;
     priv->istream.ready         = camio_istream_udp_ready;
     priv->istream.delete        = camio_istream_udp_delete;
     priv->istream.fd            = -1;
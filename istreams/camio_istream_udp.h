@@ -3,19 +3,54 @@
  *
  * Fe2+ udp socket input stream
  *
+ * udp:ip:port binds to a local address, or *:port for all of them. If ip is a multicast group the
+ * stream binds to the group and joins it, so it only sees datagrams sent to that group.
+ *
+ * Options:
+ * iface=name   Join the group on this interface, or for unicast addresses, only take datagrams
+ *              that arrive on it (SO_BINDTODEVICE). By default the kernel picks
+ * source=ip    Source specific multicast, only take the group's datagrams that come from ip
+ * reuseport=1  Share the port with other sockets that also say so (SO_REUSEPORT). The kernel
+ *              spreads datagrams across them by flow
+ * shards=N     Share the port between N sockets (implies reuseport=1), each taking one shard. The
+ *              i'th stream opened on the port gets shard i
+ * steer=flow|hash|cpu  How datagrams are sharded. flow (the default) hashes the source address and
+ *              ports, so each flow always goes to the same shard. hash uses the device's receive
+ *              hash and cpu the CPU that received the datagram, both of which keep each shard with
+ *              its receive queue, but devices that don't hash (like lo) send everything to shard 0
+ * ts=sw|hw     Kernel, or kernel and NIC, receive timestamps for each record, from read_meta() (see
+ *              camio_timestamp.h). Hardware stamping is turned on for iface, if it's given.
+ *              Datagrams coalesced by gro=1 share the first one's timestamps
+ * batch=N  Receive up to N datagrams per system call (recvmmsg) into a pool of per-message buffers,
+ *          and hand them out one at a time, or as batches, from there. By default each read is its
+ *          own recv, and only batched reads use recvmmsg
+ * slot=N   Size of each buffer in the pool, defaults to 64kB which will hold any datagram.
+ *          Datagrams bigger than this are truncated
+ * gro=1    Let the kernel coalesce datagrams from the same flow (UDP_GRO) and receive them
+ *          together. Each one is still handed out as its own record, straight from the coalesced
+ *          buffer. Needs Linux 5.0 or later
+ *
  */
 
 #ifndef CAMIO_ISTREAM_UDP_H_
 #define CAMIO_ISTREAM_UDP_H_
 
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "camio_istream.h"
+#include "../camio_timestamp.h"
 
 /********************************************************************
  *                  PRIVATE DEFS
  ********************************************************************/
 
+#define CAMIO_ISTREAM_UDP_BATCH_MAX 64                 //Messages read by a single batch call, unless batch= says otherwise
+#define CAMIO_ISTREAM_UDP_BATCH_LIMIT 1024             //The kernel won't take more than this (UIO_MAXIOV) per call
+#define CAMIO_ISTREAM_UDP_BATCH_SLOT_SIZE (64 * 1024) //64kB, big enough for any UDP datagram
+#define CAMIO_ISTREAM_UDP_CTRL_SIZE (CMSG_SPACE(sizeof(int)) + CAMIO_TIMESTAMP_CTRL_SIZE) //Room for the UDP_GRO segment size and timestamps
+
 typedef struct {
     //No params at this stage
 } camio_istream_udp_params_t;
@@ -24,9 +59,26 @@ typedef struct {
     camio_istream_t istream;
     uint8_t* buffer;
     size_t buffer_size;
+    uint8_t* data;                      //Message waiting to be read, left by ready()
     size_t bytes_read;
+    size_t batch;                       //Messages per recvmmsg for every read, or 0 to recv one at a time
+    size_t batch_slot_size;             //Size of each buffer in the pool
+    size_t batch_count;                 //Number of buffers in the pool
+    uint8_t* batch_buffer;              //Pool of per-message buffers for batched reads
+    struct mmsghdr* batch_msgs;
+    struct iovec* batch_iovs;
+    size_t queue_next;                  //Next message in the pool to hand out
+    size_t queue_count;                 //Messages in the pool from the last recvmmsg
+    int gro;                            //Messages may be several datagrams, coalesced by the kernel
+    int ts;                             //Messages carry receive timestamps
+    uint8_t* batch_ctrl;                //Control messages, one per message in the pool
+    uint8_t ctrl[CAMIO_ISTREAM_UDP_CTRL_SIZE]; //Control messages for single receives
+    size_t ctrl_len;
+    uint8_t* seg_data;                  //Rest of a coalesced message, still to be split up
+    size_t seg_left;
+    size_t seg_size;                    //Size of each datagram in it, the last may be shorter
     int is_closed;                      //Has close be called?
-    struct sockaddr_in addr;            //Source address/port
+    struct sockaddr_in addr;            //Local address/port or group that the socket is bound to
     camio_istream_udp_params_t* params;  //Parameters passed in from the outside
 
 } camio_istream_udp_t;
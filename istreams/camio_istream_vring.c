@@ -0,0 +1,259 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ variable length record ring input stream
+ *
+ * The writer publishes how far it has written in the ring header. Anything between our read
+ * position and that is ready to read. If the writer gets more than a whole ring ahead of us, we
+ * have been lapped and skip forward to where the writer is now. The sequence numbers in the record
+ * headers tell us exactly how many records were lost.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "camio_istream_vring.h"
+#include "../camio_errors.h"
+#include "../camio_util.h"
+
+
+int64_t camio_istream_vring_open(camio_istream_t* this, const camio_descr_t* descr ){
+    camio_istream_vring_t* priv = this->priv;
+
+    const char* valid_opts[] = { "size", "block", CAMIO_MMAP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+
+    //Blocking readers need write access to the header to tell the writer they are asleep
+    priv->block = camio_descr_get_opt_bool(descr, "block", 0);
+    camio_ring_open(&priv->ring, descr, CAMIO_RING_TYPE_VAR, priv->block);
+
+    //If the writer has already wrapped, the start of the ring is gone, so join at the head
+    const uint64_t head = __atomic_load_n(&priv->ring.hdr->write_pos, __ATOMIC_ACQUIRE);
+    if(head > priv->ring.ring_size){
+        priv->read_pos     = head;
+        priv->expected_seq = 0;
+    }
+
+    //Blocking readers are in the reader table, so the writer can tell if they die asleep
+    if(priv->block){
+        priv->reader = camio_ring_reader_register(&priv->ring, 0);
+        camio_ring_blocker_add(&priv->ring, priv->reader);
+    }
+
+    this->fd = priv->ring.fd;
+    priv->is_closed = 0;
+
+    return CAMIO_ERR_NONE;
+}
+
+
+void camio_istream_vring_close(camio_istream_t* this){
+    camio_istream_vring_t* priv = this->priv;
+    if(priv->block){
+        camio_ring_blocker_remove(&priv->ring, priv->reader);
+        camio_ring_reader_release(&priv->ring, priv->reader);
+        priv->reader = -1;
+        priv->block  = 0;
+    }
+    camio_ring_close(&priv->ring);
+    priv->is_closed = 1;
+}
+
+
+static inline uint64_t get_head(camio_istream_vring_t* priv){
+    return __atomic_load_n(&priv->ring.hdr->write_pos, __ATOMIC_ACQUIRE);
+}
+
+
+//The writer has lapped us, skip forward to where it is now
+static void resync(camio_istream_vring_t* priv, uint64_t head){
+    if(priv->expected_seq){
+        priv->lost_from = priv->expected_seq;
+    }
+    priv->expected_seq = 0;
+    priv->read_pos     = head;
+    priv->read_size    = 0;
+}
+
+
+static int prepare_next(camio_istream_vring_t* priv){
+
+    //Simple case, there's already data waiting
+    if(unlikely(priv->read_size)){
+        return priv->read_size;
+    }
+
+    while(1){
+        //Is there new data?
+        uint64_t head = get_head(priv);
+        if(likely(head == priv->read_pos)){
+            return 0;
+        }
+
+        if(unlikely(head - priv->read_pos > priv->ring.ring_size)){
+            resync(priv, head);
+            continue;
+        }
+
+        const uint64_t offset = priv->read_pos % priv->ring.ring_size;
+        volatile camio_vring_rec_t* rec = (volatile camio_vring_rec_t*)(priv->ring.slots + offset);
+        const uint64_t seq   = rec->seq;
+        const uint64_t len   = rec->len;
+        const uint32_t flags = rec->flags;
+
+        //If the writer lapped us while we were reading the header, it's garbage
+        head = get_head(priv);
+        if(unlikely(head - priv->read_pos > priv->ring.ring_size ||
+                    offset + sizeof(camio_vring_rec_t) + len > priv->ring.ring_size ||
+                    (priv->expected_seq && seq != priv->expected_seq))){
+            resync(priv, head);
+            continue;
+        }
+
+        //Padding records share the sequence number of the record after them
+        if(flags & CAMIO_VRING_REC_PAD){
+            priv->read_pos    += sizeof(camio_vring_rec_t) + len;
+            priv->expected_seq = seq;
+            continue;
+        }
+
+        if(unlikely(priv->lost_from)){
+            const uint64_t lost = seq - priv->lost_from;
+            priv->lost += lost;
+            wprintf(CAMIO_ERR_BUFFER_OVERRUN, "Ring overflow. Caught up, dropped %lu records from %lu to %lu\n", lost, priv->lost_from, seq - 1);
+            priv->lost_from = 0;
+        }
+
+        //A read of 0 means there's no data, so empty records can't be handed out. Skip them
+        if(unlikely(!len)){
+            priv->read_pos    += camio_vring_rec_size(0);
+            priv->expected_seq = seq + 1;
+            continue;
+        }
+
+        priv->rec       = rec;
+        priv->read_seq  = seq;
+        priv->read_size = len;
+        return len;
+    }
+}
+
+//Spin until there's data. Blocking readers go to sleep if it doesn't turn up soon
+static void wait_for_data(camio_istream_vring_t* priv){
+    uint64_t spins = 0;
+    while(!prepare_next(priv)){
+        if(priv->block && ++spins >= CAMIO_RING_BLOCK_SPINS){
+            const uint32_t seen = camio_ring_wait_begin(&priv->ring, priv->reader);
+            camio_ring_wait_end(&priv->ring, priv->reader, seen, !prepare_next(priv));
+            continue;
+        }
+        __asm__ __volatile__("pause"); //Tell the CPU we're spinning
+    }
+}
+
+int64_t camio_istream_vring_ready(camio_istream_t* this){
+    camio_istream_vring_t* priv = this->priv;
+    if(priv->read_size || priv->is_closed){
+        return 1;
+    }
+
+    return prepare_next(priv);
+}
+
+int64_t camio_istream_vring_start_read(camio_istream_t* this, uint8_t** out){
+    camio_istream_vring_t* priv = this->priv;
+    *out = NULL;
+
+    if(unlikely(priv->is_closed)){
+        return 0;
+    }
+
+    //Called read without calling ready, they must want to block/spin waiting for data
+    if(unlikely(!priv->read_size)){
+        wait_for_data(priv);
+    }
+
+    *out = (uint8_t*)priv->rec + sizeof(camio_vring_rec_t);
+    return priv->read_size;
+}
+
+
+int64_t camio_istream_vring_end_read(camio_istream_t* this, uint8_t* free_buff){
+    camio_istream_vring_t* priv = this->priv;
+
+    const uint64_t head = get_head(priv);
+    if( unlikely(head - priv->read_pos > priv->ring.ring_size || priv->rec->seq != priv->read_seq)){
+        priv->expected_seq = priv->read_seq + 1;
+        resync(priv, head);
+        return -1;
+    }
+
+    priv->read_pos    += camio_vring_rec_size(priv->read_size);
+    priv->expected_seq = priv->read_seq + 1;
+    priv->read_size    = 0;
+
+    return 0;
+}
+
+
+void camio_istream_vring_delete(camio_istream_t* this){
+    this->close(this);
+    camio_istream_vring_t* priv = this->priv;
+    free(priv);
+}
+
+/* ****************************************************
+ * Construction
+ */
+
+camio_istream_t* camio_istream_vring_construct(camio_istream_vring_t* priv, const camio_descr_t* descr,  camio_istream_vring_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"vring stream supplied is null\n");
+    }
+
+    //Initialize the local variables
+    priv->is_closed         = 1;
+    priv->ring.fd           = -1;
+    priv->ring.map          = NULL;
+    priv->read_pos          = 0;
+    priv->expected_seq      = 1; //We will expect 1 when the first write occurs
+    priv->lost_from         = 0;
+    priv->lost              = 0;
+    priv->rec               = NULL;
+    priv->read_seq          = 0;
+    priv->read_size         = 0;
+    priv->block             = 0;
+    priv->reader            = -1;
+    priv->params            = params;
+
+    //Populate the function members
+    priv->istream.priv          = priv; //Lets us access private members
+    priv->istream.open          = camio_istream_vring_open;
+    priv->istream.close         = camio_istream_vring_close;
+    priv->istream.start_read    = camio_istream_vring_start_read;
+    priv->istream.end_read      = camio_istream_vring_end_read;
+    priv->istream.start_read_batch = camio_istream_start_read_batch_generic;
+    priv->istream.end_read_batch   = camio_istream_end_read_batch_generic;
+    priv->istream.read_meta     = camio_istream_read_meta_none;
+    priv->istream.ready         = camio_istream_vring_ready;
+    priv->istream.delete        = camio_istream_vring_delete;
+    priv->istream.fd            = -1;
+
+    //Call open, because its the obvious thing to do now...
+    priv->istream.open(&priv->istream, descr);
+
+    //Return the generic istream interface for the outside world to use
+    return &priv->istream;
+
+}
+
+camio_istream_t* camio_istream_vring_new( const camio_descr_t* descr,  camio_istream_vring_params_t* params){
+    camio_istream_vring_t* priv = malloc(sizeof(camio_istream_vring_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for vring istream creation\n");
+    }
+    return camio_istream_vring_construct(priv, descr,  params);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ variable length record ring input stream
+ *
+ */
+
+#ifndef CAMIO_ISTREAM_VRING_H_
+#define CAMIO_ISTREAM_VRING_H_
+
+#include "camio_istream.h"
+#include "../camio_ring.h"
+
+/********************************************************************
+ *                  PRIVATE DEFS
+ ********************************************************************/
+
+
+typedef struct {
+    //No params yet
+} camio_istream_vring_params_t;
+
+typedef struct {
+    camio_istream_t istream;
+    int is_closed;                       //Has close be called?
+    camio_ring_t ring;                   //The shared ring
+    int block;                           //Sleep on the ring futex rather than spinning forever
+    int reader;                          //Our entry in the ring's reader table, blocking readers only
+    uint64_t read_pos;                   //Position of the next record (not wrapped)
+    uint64_t expected_seq;               //Sequence number we expect next, 0 if we don't know (after a resync)
+    uint64_t lost_from;                  //First sequence number lost in the last resync
+    uint64_t lost;                       //Total records lost to overruns
+    volatile camio_vring_rec_t* rec;     //Current record
+    uint64_t read_seq;                   //Sequence number of the current record
+    size_t read_size;                    //Size of the current read waiting (if any)
+    camio_istream_vring_params_t* params;  //Parameters passed in from the outside
+
+} camio_istream_vring_t;
+
+
+
+
+/********************************************************************
+ *                  PUBLIC DEFS
+ ********************************************************************/
+
+camio_istream_t* camio_istream_vring_new( const camio_descr_t* opts,  camio_istream_vring_params_t* params);
+
+
+#endif /* CAMIO_ISTREAM_VRING_H_ */
@@ -9,12 +9,17 @@
 
 #include "camio_ostream.h"
 #include "../camio_errors.h"
+#include "../camio_util.h"
 
 #include "camio_ostream_log.h"
 #include "camio_ostream_raw.h"
 #include "camio_ostream_udp.h"
 #include "camio_ostream_ring.h"
+#include "camio_ostream_vring.h"
 #include "camio_ostream_blob.h"
+#include "camio_ostream_pcap.h"
+#include "camio_ostream_pcapng.h"
+#include "camio_ostream_erf.h"
 #include "camio_ostream_netmap.h"
 
 
@@ -37,12 +42,24 @@ camio_ostream_t* camio_ostream_new( char* description,  void* parameters){
     else if(strcmp(descr.protocol,"ring") == 0 ){
             result = camio_ostream_ring_new(&descr, parameters);
     }
+    else if(strcmp(descr.protocol,"vring") == 0 ){
+            result = camio_ostream_vring_new(&descr, parameters);
+    }
     else if(strcmp(descr.protocol,"udp") == 0 ){
             result = camio_ostream_udp_new(&descr, parameters);
     }
     else if(strcmp(descr.protocol,"blob") == 0 ){
             result = camio_ostream_blob_new(&descr, parameters);
     }
+    else if(strcmp(descr.protocol,"pcap") == 0 ){
+            result = camio_ostream_pcap_new(&descr, parameters);
+    }
+    else if(strcmp(descr.protocol,"pcapng") == 0 ){
+            result = camio_ostream_pcapng_new(&descr, parameters);
+    }
+    else if(strcmp(descr.protocol,"erf") == 0 ){
+            result = camio_ostream_erf_new(&descr, parameters);
+    }
     else if(strcmp(descr.protocol,"nmap") == 0 ){
             result = camio_ostream_netmap_new(&descr, parameters);
     }
@@ -54,3 +71,25 @@ camio_ostream_t* camio_ostream_new( char* description,  void* parameters){
     return result;
 
 }
+
+
+
+//Streams that reuse a single buffer can only hand out one slot per batch
+int64_t camio_ostream_start_write_batch_generic(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    if(unlikely(!count)){
+        return 0;
+    }
+
+    slots[0].buff = this->start_write(this, slots[0].len);
+    return slots[0].buff ? 1 : 0;
+}
+
+
+int64_t camio_ostream_end_write_batch_generic(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    if(unlikely(!count)){
+        return 0;
+    }
+
+    this->end_write(this, slots[0].len);
+    return 1;
+}
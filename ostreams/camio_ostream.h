@@ -11,6 +11,7 @@
 #include <unistd.h>
 
 #include "../camio_descr.h"
+#include "../camio_iovec.h"
 #include "../selectors/camio_selector.h"
 
 struct camio_ostream;
@@ -22,6 +23,8 @@ struct camio_ostream{
      int (*ready)(camio_ostream_t* this);                                        //Returns non-zero if a call to start_write will be non-blocking
      uint8_t* (*start_write)(camio_ostream_t* this, size_t len );                //Returns a pointer to a space of size len, ready for data
      uint8_t* (*end_write)(camio_ostream_t* this, size_t len);                   //Commit the data to the buffer previously allocated, if the write was "assigned" and write want's to keep the buffer, optionally return a fresh one
+     int64_t (*start_write_batch)(camio_ostream_t* this, camio_iovec_t* slots, size_t count); //Reserve up to count buffers of slots[i].len bytes each, returns the number reserved. Blocks like start_write until there is at least one
+     int64_t (*end_write_batch)(camio_ostream_t* this, camio_iovec_t* slots, size_t count);   //Commit the first count buffers reserved by start_write_batch, slots[i].len must be equal to or less than the length reserved. Returns the number committed
      void(*flush)(camio_ostream_t* this);                                       //Flush any outstanding data
      void(*delete)(camio_ostream_t* this);                                       //Close the stream and free all memory
      int (*can_assign_write)(camio_ostream_t*);                                  //Is this stream capable of taking over another stream buffer
@@ -33,4 +36,8 @@ struct camio_ostream{
 
 camio_ostream_t* camio_ostream_new( char* description,  void* params);
 
+//Generic batch fallbacks for streams that can only have one write outstanding at a time
+int64_t camio_ostream_start_write_batch_generic(camio_ostream_t* this, camio_iovec_t* slots, size_t count);
+int64_t camio_ostream_end_write_batch_generic(camio_ostream_t* this, camio_iovec_t* slots, size_t count);
+
 #endif /* OSTREAM_H_ */
@@ -3,27 +3,32 @@
  *
  * Fe2+ blob (newline separated) output stream
  *
+ * direct=1 writes the file with O_DIRECT, bypassing the page cache, through a rotating set of
+ * aligned buffers written asynchronously (see camio_write_buffer.h).
+ *
  */
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 
 #include "../camio_util.h"
 #include "../camio_errors.h"
 
 #include "camio_ostream_blob.h"
 
-#define CAMIO_OSTREAM_BLOB_INIT_BUFF_SIZE (4 * 1024ULL) //4kB initial buffer, sensible size
-#define CAMIO_OSTREAM_BLOB_INIT_WRITE_SIZE (512 * 1024 * 1024ULL) //512MB per write. This is stupidly large.
+#define CAMIO_OSTREAM_BLOB_INIT_BUFF_SIZE (4 * 1024ULL) //4kB initial buffer, only used for blobs that don't fit in the write buffer
+#define CAMIO_OSTREAM_BLOB_BATCH_MAX 64 //Most buffers written by a single batch call
 
 int camio_ostream_blob_open(camio_ostream_t* this, const camio_descr_t* descr ){
     camio_ostream_blob_t* priv = this->priv;
 
-    if(descr->opt_head){
-        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option(s) supplied, but none expected\n");
-    }
+    const char* valid_opts[] = { "direct", CAMIO_WRITE_BUFFER_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+    const int direct = camio_descr_get_opt_bool(descr, "direct", 0);
 
     if(!descr->query){
         eprintf_exit(CAMIO_ERR_NULL_PTR, "No interface supplied\n");
@@ -35,32 +40,27 @@ int camio_ostream_blob_open(camio_ostream_t* this, const camio_descr_t* descr ){
     }
     priv->buffer_size  = CAMIO_OSTREAM_BLOB_INIT_BUFF_SIZE;
 
-    //If we have a file descriptor from the outside world, then use it!
-    if(priv->params){
-        if(priv->params->fd > -1){
-            this->fd = priv->params->fd;
-            priv->is_closed = 0;
-            return CAMIO_ERR_NONE;
+    //If we have a file descriptor from the outside world, then use it! Otherwise the write buffer
+    //opens the file, so that it can rotate it
+    int fd = -1;
+    if(priv->params && priv->params->fd > -1){
+        fd = priv->params->fd;
+        if(direct && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) < 0){
+            eprintf_exit(CAMIO_ERR_FILE_FLAGS, "Could not set O_DIRECT on supplied fd. Error=%s\n", strerror(errno));
         }
     }
 
-    //Grab a file descriptor and rock on
-    if(!descr->query){
-        eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
-    }
-
-    this->fd = open(descr->query, O_WRONLY | O_CREAT | O_TRUNC, (mode_t)(0666));
-    if(this->fd == -1){
-        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\"\n", descr->query);
-    }
+    this->fd = camio_write_buffer_init(&priv->wbuf, fd, descr, direct ? O_DIRECT : 0);
     priv->is_closed = 0;
     return CAMIO_ERR_NONE;
 }
 
 void camio_ostream_blob_close(camio_ostream_t* this){
     camio_ostream_blob_t* priv = this->priv;
+    camio_write_buffer_destroy(&priv->wbuf);
     close(this->fd);
     free(priv->buffer);
+    priv->buffer = NULL;
     priv->is_closed = 1;
 }
 
@@ -70,6 +70,12 @@ void camio_ostream_blob_close(camio_ostream_t* this){
 uint8_t* camio_ostream_blob_start_write(camio_ostream_t* this, size_t len ){
     camio_ostream_blob_t* priv = this->priv;
 
+    //Build straight into the write buffer if we can
+    priv->in_wbuf = camio_write_buffer_reserve(&priv->wbuf, len);
+    if(likely(priv->in_wbuf != NULL)){
+        return priv->in_wbuf;
+    }
+
     //Grow the buffer if it's not big enough
     if(unlikely(len > priv->buffer_size)){
         priv->buffer = realloc(priv->buffer, len);
@@ -95,33 +101,96 @@ int camio_ostream_blob_ready(camio_ostream_t* this){
 //Len must be equal to or less than len called with start_write
 uint8_t* camio_ostream_blob_end_write(camio_ostream_t* this, size_t len){
     camio_ostream_blob_t* priv = this->priv;
-    size_t total_written = 0;
-    size_t written = 0;
-
-    const uint8_t* buffer = priv->assigned_buffer ? priv->assigned_buffer : priv->buffer;
-    while(likely(total_written < len)){
-    	const size_t left_to_write = len - total_written;
-    	written = write(this->fd,buffer + total_written, MIN(left_to_write, priv->write_size));
-        total_written += written;
-
-        //Grow this stupidly fast, we really don't want to be falling into this case
-        if(unlikely(written >= priv->write_size)){
-        	//Catch the overflow case
-            if(unlikely(priv->write_size * 8 < priv->write_size)){
-            	priv->write_size = ~0;
+
+    if(unlikely(priv->assigned_buffer != NULL)){
+        //Big assigned buffers go straight out from where they are, without a copy
+        struct iovec iov = { .iov_base = priv->assigned_buffer, .iov_len = len };
+        camio_write_buffer_writev(&priv->wbuf, &iov, 1, 1);
+        priv->assigned_buffer    = NULL;
+        priv->assigned_buffer_sz = 0;
+    }
+    else if(likely(priv->in_wbuf != NULL)){
+        camio_write_buffer_commit(&priv->wbuf, len, 1);
+        priv->in_wbuf = NULL;
+    }
+    else{
+        struct iovec iov = { .iov_base = priv->buffer, .iov_len = len };
+        camio_write_buffer_writev(&priv->wbuf, &iov, 1, 1);
+    }
+
+    return NULL;
+}
+
+
+//Carve up to count buffers out of the write buffer, or the output buffer if they won't fit
+int64_t camio_ostream_blob_start_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_blob_t* priv = this->priv;
+    count = MIN(count, CAMIO_OSTREAM_BLOB_BATCH_MAX);
+
+    size_t total = 0;
+    size_t i = 0;
+    for(; i < count; i++){
+        total += slots[i].len;
+    }
+
+    uint8_t* buff = camio_write_buffer_reserve(&priv->wbuf, total);
+    priv->in_wbuf = buff;
+    if(!buff){
+        if(unlikely(total > priv->buffer_size)){
+            priv->buffer = realloc(priv->buffer, total);
+            if(!priv->buffer){
+                eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not grow line buffer\n");
             }
-            else{
-            	priv->write_size *= 8;
+            priv->buffer_size = total;
+        }
+        buff = priv->buffer;
+    }
+
+    for(i = 0; i < count; i++){
+        slots[i].buff = buff;
+        buff += slots[i].len;
+    }
+
+    return count;
+}
+
+
+//Write all of the slots out in one go
+int64_t camio_ostream_blob_end_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_blob_t* priv = this->priv;
+    count = MIN(count, CAMIO_OSTREAM_BLOB_BATCH_MAX);
+
+    size_t i = 0;
+    //Slots may be shorter than reserved, so close up the gaps. Each one only ever moves backwards
+    if(likely(priv->in_wbuf != NULL)){
+        uint8_t* out = priv->in_wbuf;
+        for(; i < count; i++){
+            if(out != slots[i].buff){
+                memmove(out, slots[i].buff, slots[i].len);
             }
+            out += slots[i].len;
         }
+
+        camio_write_buffer_commit(&priv->wbuf, out - priv->in_wbuf, count);
+        priv->in_wbuf = NULL;
+        return count;
     }
 
-    if(likely(priv->assigned_buffer != NULL)){
-        priv->assigned_buffer    = NULL;
-        priv->assigned_buffer_sz = 0;
+    struct iovec iovs[CAMIO_OSTREAM_BLOB_BATCH_MAX];
+    for(; i < count; i++){
+        iovs[i].iov_base = slots[i].buff;
+        iovs[i].iov_len  = slots[i].len;
     }
 
-    return NULL;
+    camio_write_buffer_writev(&priv->wbuf, iovs, count, count);
+    return count;
+}
+
+
+//Write out anything that's waiting in the write buffer
+void camio_ostream_blob_flush(camio_ostream_t* this){
+    camio_ostream_blob_t* priv = this->priv;
+    camio_write_buffer_flush(&priv->wbuf);
 }
 
 
@@ -166,7 +235,8 @@ camio_ostream_t* camio_ostream_blob_construct(camio_ostream_blob_t* priv, const
     priv->buffer                = NULL;
     priv->assigned_buffer       = NULL;
     priv->assigned_buffer_sz    = 0;
-    priv->write_size            = CAMIO_OSTREAM_BLOB_INIT_WRITE_SIZE;
+    priv->in_wbuf               = NULL;
+    priv->wbuf.fd               = -1;
     priv->params                = params;
 
 
@@ -180,6 +250,9 @@ camio_ostream_t* camio_ostream_blob_construct(camio_ostream_blob_t* priv, const
     priv->ostream.delete            = camio_ostream_blob_delete;
     priv->ostream.can_assign_write  = camio_ostream_blob_can_assign_write;
     priv->ostream.assign_write      = camio_ostream_blob_assign_write;
+    priv->ostream.start_write_batch = camio_ostream_blob_start_write_batch;
+    priv->ostream.end_write_batch   = camio_ostream_blob_end_write_batch;
+    priv->ostream.flush             = camio_ostream_blob_flush;
     priv->ostream.fd                = -1;
 
     //Call open, because its the obvious thing to do now...
@@ -0,0 +1,362 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ ERF file output stream
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+
+#include "../camio_util.h"
+#include "../camio_errors.h"
+
+#include "../dag/dagerf.h"
+
+#include "camio_ostream_erf.h"
+
+#define CAMIO_OSTREAM_ERF_INIT_BUFF_SIZE (4 * 1024ULL) //4kB initial buffer, only used for records that don't fit in the write buffer
+#define CAMIO_OSTREAM_ERF_WRAP_HDR  (CAMIO_ERF_HDR_SIZE + CAMIO_ERF_ETH_PAD) //In front of each bare frame
+#define CAMIO_OSTREAM_ERF_WRAP_TAIL (CAMIO_ERF_ALIGN - 1)                    //Most padding after each bare frame
+
+int camio_ostream_erf_open(camio_ostream_t* this, const camio_descr_t* descr ){
+    camio_ostream_erf_t* priv = this->priv;
+
+    const char* valid_opts[] = { "hdr", CAMIO_WRITE_BUFFER_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+    priv->hdr = camio_descr_get_opt_bool(descr, "hdr", 1);
+
+    priv->buffer = malloc(CAMIO_OSTREAM_ERF_INIT_BUFF_SIZE);
+    if(!priv->buffer){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not allocate output buffer\n");
+    }
+    priv->buffer_size  = CAMIO_OSTREAM_ERF_INIT_BUFF_SIZE;
+
+    //If we have a file descriptor from the outside world, then use it! Otherwise the write buffer
+    //opens the file, so that it can rotate it
+    const int fd = priv->params && priv->params->fd > -1 ? priv->params->fd : -1;
+    this->fd = camio_write_buffer_init(&priv->wbuf, fd, descr, 0);
+
+    priv->is_closed = 0;
+    return CAMIO_ERR_NONE;
+}
+
+void camio_ostream_erf_close(camio_ostream_t* this){
+    camio_ostream_erf_t* priv = this->priv;
+    if(priv->is_closed){
+        return;
+    }
+    camio_write_buffer_destroy(&priv->wbuf);
+    close(this->fd);
+    free(priv->buffer);
+    priv->buffer = NULL;
+    priv->is_closed = 1;
+}
+
+
+//Whole records have to be exactly what their header says they are, or the rest of the file can't be
+//walked
+static inline void check_record(const uint8_t* rec, size_t len){
+    if(unlikely(len < dag_record_size || !dagerf_is_known_type((uint8_t*)rec) || len != dagerf_get_length((uint8_t*)rec))){
+        eprintf_exit(CAMIO_ERR_NOT_AN_ERF, "Write of %lu bytes is not an ERF record. Use hdr=0 to write bare frames\n", len);
+    }
+}
+
+
+static const uint8_t zeros[CAMIO_ERF_ALIGN] = { 0 };
+
+//Bytes of a bare frame of len bytes that fit in a record
+static inline size_t wrap_keep(size_t len){
+    return MIN(len, CAMIO_ERF_MAX_RLEN - CAMIO_OSTREAM_ERF_WRAP_HDR);
+}
+
+
+//Fill in the record header for a bare frame of len bytes. Returns the length of the whole record,
+//padding and all
+static inline size_t wrap(uint8_t* rec, size_t len, const struct timespec* now){
+    const size_t keep = wrap_keep(len);
+    const size_t rlen = (CAMIO_OSTREAM_ERF_WRAP_HDR + keep + CAMIO_ERF_ALIGN - 1) & ~(CAMIO_ERF_ALIGN - 1ULL);
+
+    dag_record_t* erf = (dag_record_t*)rec;
+    erf->ts     = camio_erf_ts_from_timespec(now->tv_sec, now->tv_nsec);
+    erf->type   = TYPE_ETH;
+    memset(&erf->flags, 0, sizeof(erf->flags));
+    erf->flags.vlen  = 1;
+    erf->flags.trunc = keep < len;
+    erf->rlen   = htons(rlen);
+    erf->lctr   = 0;
+    erf->wlen   = htons(MIN(len, 0xFFFF));
+    erf->rec.eth.offset = 0;
+    erf->rec.eth.pad    = 0;
+    return rlen;
+}
+
+
+//Space in front of and behind each write, if we're wrapping them
+static inline size_t hdr_space(camio_ostream_erf_t* priv){
+    return priv->hdr ? 0 : CAMIO_OSTREAM_ERF_WRAP_HDR;
+}
+
+static inline size_t tail_space(camio_ostream_erf_t* priv){
+    return priv->hdr ? 0 : CAMIO_OSTREAM_ERF_WRAP_TAIL;
+}
+
+
+static void grow_buffer(camio_ostream_erf_t* priv, size_t len){
+    if(unlikely(len > priv->buffer_size)){
+        priv->buffer = realloc(priv->buffer, len);
+        if(!priv->buffer){
+            eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not grow output buffer\n");
+        }
+        priv->buffer_size = len;
+    }
+}
+
+
+//Returns a pointer to a space of size len, ready for data
+uint8_t* camio_ostream_erf_start_write(camio_ostream_t* this, size_t len ){
+    camio_ostream_erf_t* priv = this->priv;
+    const size_t extra = hdr_space(priv);
+
+    //Build straight into the write buffer if we can
+    priv->in_wbuf = camio_write_buffer_reserve(&priv->wbuf, len + extra + tail_space(priv));
+    if(likely(priv->in_wbuf != NULL)){
+        return priv->in_wbuf + extra;
+    }
+
+    grow_buffer(priv, len + extra + tail_space(priv));
+    return priv->buffer + extra;
+}
+
+//Returns non-zero if a call to start_write will be non-blocking
+int camio_ostream_erf_ready(camio_ostream_t* this){
+    //Not implemented
+    eprintf_exit(CAMIO_ERR_NOT_IMPL, "\n");
+    return 0;
+}
+
+
+//Commit the data that's now in the buffer that was previously allocated
+//Len must be equal to or less than len called with start_write
+uint8_t* camio_ostream_erf_end_write(camio_ostream_t* this, size_t len){
+    camio_ostream_erf_t* priv = this->priv;
+    struct timespec now;
+    if(!priv->hdr){
+        clock_gettime(CLOCK_REALTIME, &now);
+    }
+
+    if(unlikely(priv->assigned_buffer != NULL)){
+        //Assigned buffers go out from where they are, without a copy. Bare frames get their header
+        //and padding from elsewhere. Only the first CAMIO_OSTREAM_ERF_WRAP_HDR bytes of it are sent
+        dag_record_t wrapper;
+        struct iovec iovs[3];
+        int iov_count = 0;
+        size_t keep = len;
+        size_t rlen = len;
+        if(priv->hdr){
+            check_record(priv->assigned_buffer, len);
+        }
+        else{
+            keep = wrap_keep(len);
+            rlen = wrap((uint8_t*)&wrapper, len, &now);
+            iovs[iov_count].iov_base = &wrapper;
+            iovs[iov_count].iov_len  = CAMIO_OSTREAM_ERF_WRAP_HDR;
+            iov_count++;
+        }
+        iovs[iov_count].iov_base = priv->assigned_buffer;
+        iovs[iov_count].iov_len  = keep;
+        iov_count++;
+        if(rlen > hdr_space(priv) + keep){
+            iovs[iov_count].iov_base = (void*)zeros;
+            iovs[iov_count].iov_len  = rlen - hdr_space(priv) - keep;
+            iov_count++;
+        }
+
+        camio_write_buffer_writev(&priv->wbuf, iovs, iov_count, 1);
+        priv->assigned_buffer    = NULL;
+        priv->assigned_buffer_sz = 0;
+        return NULL;
+    }
+
+    uint8_t* rec = priv->in_wbuf ? priv->in_wbuf : priv->buffer;
+    size_t rec_len = len;
+    if(priv->hdr){
+        check_record(rec, len);
+    }
+    else{
+        rec_len = wrap(rec, len, &now);
+        const size_t keep = wrap_keep(len);
+        bzero(rec + CAMIO_OSTREAM_ERF_WRAP_HDR + keep, rec_len - CAMIO_OSTREAM_ERF_WRAP_HDR - keep);
+    }
+
+    if(likely(priv->in_wbuf != NULL)){
+        camio_write_buffer_commit(&priv->wbuf, rec_len, 1);
+        priv->in_wbuf = NULL;
+    }
+    else{
+        struct iovec iov = { .iov_base = rec, .iov_len = rec_len };
+        camio_write_buffer_writev(&priv->wbuf, &iov, 1, 1);
+    }
+
+    return NULL;
+}
+
+
+//Carve up to count records out of the write buffer. If they won't all fit, fall back to one at a time
+int64_t camio_ostream_erf_start_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_erf_t* priv = this->priv;
+    const size_t extra = hdr_space(priv) + tail_space(priv);
+
+    size_t total = 0;
+    size_t i = 0;
+    for(; i < count; i++){
+        total += slots[i].len + extra;
+    }
+
+    uint8_t* buff = camio_write_buffer_reserve(&priv->wbuf, total);
+    priv->in_wbuf = buff;
+    if(!buff){
+        priv->batch_generic = 1;
+        return camio_ostream_start_write_batch_generic(this, slots, count);
+    }
+
+    for(i = 0; i < count; i++){
+        slots[i].buff = buff + hdr_space(priv);
+        buff += slots[i].len + extra;
+    }
+
+    return count;
+}
+
+
+//Write all of the records out in one go
+int64_t camio_ostream_erf_end_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_erf_t* priv = this->priv;
+    if(unlikely(priv->batch_generic)){
+        priv->batch_generic = 0;
+        return camio_ostream_end_write_batch_generic(this, slots, count);
+    }
+
+    struct timespec now;
+    if(!priv->hdr){
+        clock_gettime(CLOCK_REALTIME, &now);
+    }
+
+    //Slots may be shorter than reserved, so close up the gaps. Each one only ever moves backwards,
+    //and a header never reaches past the start of its own slot, nor padding past the end of it
+    uint8_t* out = priv->in_wbuf;
+    size_t i = 0;
+    for(; i < count; i++){
+        if(priv->hdr){
+            check_record(slots[i].buff, slots[i].len);
+            if(out != slots[i].buff){
+                memmove(out, slots[i].buff, slots[i].len);
+            }
+            out += slots[i].len;
+            continue;
+        }
+
+        const size_t rlen = wrap(out, slots[i].len, &now);
+        const size_t keep = wrap_keep(slots[i].len);
+        out += CAMIO_OSTREAM_ERF_WRAP_HDR;
+        if(out != slots[i].buff){
+            memmove(out, slots[i].buff, keep);
+        }
+        bzero(out + keep, rlen - CAMIO_OSTREAM_ERF_WRAP_HDR - keep);
+        out += rlen - CAMIO_OSTREAM_ERF_WRAP_HDR;
+    }
+
+    camio_write_buffer_commit(&priv->wbuf, out - priv->in_wbuf, count);
+    priv->in_wbuf = NULL;
+    return count;
+}
+
+
+//Write out anything that's waiting in the write buffer
+void camio_ostream_erf_flush(camio_ostream_t* this){
+    camio_ostream_erf_t* priv = this->priv;
+    camio_write_buffer_flush(&priv->wbuf);
+}
+
+
+void camio_ostream_erf_delete(camio_ostream_t* ostream){
+    ostream->close(ostream);
+    camio_ostream_erf_t* priv = ostream->priv;
+    free(priv);
+}
+
+//Is this stream capable of taking over another stream buffer
+int camio_ostream_erf_can_assign_write(camio_ostream_t* this){
+    return 1;
+}
+
+//Assign the write buffer to the stream
+int camio_ostream_erf_assign_write(camio_ostream_t* this, uint8_t* buffer, size_t len){
+    camio_ostream_erf_t* priv = this->priv;
+
+    if(unlikely(!buffer)){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"Assigned buffer is null.");
+    }
+
+    priv->assigned_buffer    = buffer;
+    priv->assigned_buffer_sz = len;
+
+    return 0;
+}
+
+
+/* ****************************************************
+ * Construction heavy lifting
+ */
+
+camio_ostream_t* camio_ostream_erf_construct(camio_ostream_erf_t* priv, const camio_descr_t* descr, camio_ostream_erf_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"erf stream supplied is null\n");
+    }
+    //Initialize the local variables
+    priv->is_closed             = 1;
+    priv->hdr                   = 1;
+    priv->buffer_size           = 0;
+    priv->buffer                = NULL;
+    priv->assigned_buffer       = NULL;
+    priv->assigned_buffer_sz    = 0;
+    priv->in_wbuf               = NULL;
+    priv->batch_generic         = 0;
+    priv->wbuf.fd               = -1;
+    priv->params                = params;
+
+
+    //Populate the function members
+    priv->ostream.priv              = priv; //Lets us access private members from public functions
+    priv->ostream.open              = camio_ostream_erf_open;
+    priv->ostream.close             = camio_ostream_erf_close;
+    priv->ostream.start_write       = camio_ostream_erf_start_write;
+    priv->ostream.end_write         = camio_ostream_erf_end_write;
+    priv->ostream.ready             = camio_ostream_erf_ready;
+    priv->ostream.delete            = camio_ostream_erf_delete;
+    priv->ostream.can_assign_write  = camio_ostream_erf_can_assign_write;
+    priv->ostream.assign_write      = camio_ostream_erf_assign_write;
+    priv->ostream.start_write_batch = camio_ostream_erf_start_write_batch;
+    priv->ostream.end_write_batch   = camio_ostream_erf_end_write_batch;
+    priv->ostream.flush             = camio_ostream_erf_flush;
+    priv->ostream.fd                = -1;
+
+    //Call open, because its the obvious thing to do now...
+    priv->ostream.open(&priv->ostream, descr);
+
+    //Return the generic ostream interface for the outside world
+    return &priv->ostream;
+
+}
+
+camio_ostream_t* camio_ostream_erf_new( const camio_descr_t* descr, camio_ostream_erf_params_t* params){
+    camio_ostream_erf_t* priv = malloc(sizeof(camio_ostream_erf_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for ostream erf creation\n");
+    }
+    return camio_ostream_erf_construct(priv, descr, params);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ ERF file output stream
+ *
+ * Writes a file of ERF records that the ERF istream (and the usual DAG tools) can read back.
+ * Records are built straight into the write buffer (see camio_write_buffer.h), so the usual
+ * buffering, aio, direct I/O and rotation options all apply.
+ *
+ * Options:
+ * hdr=0       Each write is a bare Ethernet frame, which is wrapped in a TYPE_ETH record stamped
+ *             with the current time and padded out to 8 bytes. By default each write is a whole
+ *             record, as the DAG, ExaNIC and ERF istreams hand them out, which is checked and then
+ *             written as it is
+ *
+ */
+
+#ifndef CAMIO_OSTREAM_ERF_H_
+#define CAMIO_OSTREAM_ERF_H_
+
+#include "camio_ostream.h"
+#include "camio_write_buffer.h"
+#include "../camio_erf.h"
+
+/********************************************************************
+ *                  PRIVATE DEFS
+ ********************************************************************/
+
+
+typedef struct {
+    int fd; //Allow creator to bypass file open stage and supply their own FD;
+} camio_ostream_erf_params_t;
+
+typedef struct {
+    camio_ostream_t ostream;
+    int is_closed;                          //Has close be called?
+    int hdr;                                //Writes are whole ERF records
+    camio_write_buffer_t wbuf;              //Records are combined here and written out together
+    uint8_t* in_wbuf;                       //Space handed out by start_write in the write buffer, if it fit
+    int batch_generic;                      //The last batch didn't fit in the write buffer
+    uint8_t* buffer;                        //Space to build records that don't fit in the write buffer
+    uint64_t buffer_size;                   //Size of output buffer
+    uint8_t* assigned_buffer;               //Assigned write buffer
+    uint64_t assigned_buffer_sz;            //Assigned write buffer size
+    camio_ostream_erf_params_t* params;     //Parameters from the outside world
+
+} camio_ostream_erf_t;
+
+
+
+/********************************************************************
+ *                  PUBLIC DEFS
+ ********************************************************************/
+
+camio_ostream_t* camio_ostream_erf_new( const camio_descr_t* opts,  camio_ostream_erf_params_t* params);
+
+
+
+#endif /* CAMIO_OSTREAM_ERF_H_ */
@@ -9,33 +9,23 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 
 #include "../camio_util.h"
 #include "../camio_errors.h"
+#include "../parsing/escape.h"
 
 #include "camio_ostream_log.h"
 
-#define CAMIO_OSTREAM_LOG_BUFF_INIT (4 * 1024 * 1024) //4MB
+#define CAMIO_OSTREAM_LOG_BUFF_INIT (4 * 1024) //4kB, only used for lines that don't fit in the write buffer
+#define CAMIO_OSTREAM_LOG_BATCH_MAX 64 //Most lines written by a single batch call
 
 int camio_ostream_log_open(camio_ostream_t* this, const camio_descr_t* descr ){
     camio_ostream_log_t* priv = this->priv;
 
-    if(unlikely((size_t)descr->opt_head)){
-        if(!strcmp("escape",descr->opt_head->name)){
-            if(descr->opt_head->value[0] == '1'){
-                priv->escape = 1;
-            }
-            else if(descr->opt_head->value[0] == '0'){
-                priv->escape = 0;
-            }
-            else{
-                eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Unknown option value supplied \"s\". Valid values are \"1\" or \"0\"\n", descr->opt_head->value);
-            }
-        }
-        else{
-            eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Unknown option supplied \"s\". Valid options for this stream are: \"escape\"\n", descr->opt_head->name);
-        }
-    }
+    const char* valid_opts[] = { "escape", CAMIO_WRITE_BUFFER_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+    priv->escape = camio_descr_get_opt_bool(descr, "escape", 0);
 
     priv->buffer = malloc(CAMIO_OSTREAM_LOG_BUFF_INIT);
     if(!priv->buffer){
@@ -43,30 +33,17 @@ int camio_ostream_log_open(camio_ostream_t* this, const camio_descr_t* descr ){
     }
     priv->buffer_size  = CAMIO_OSTREAM_LOG_BUFF_INIT;
 
-    //If we have a file descriptor from the outside world, then use it!
-    if(priv->params){
-          if(priv->params->fd > -1){
-              this->fd = priv->params->fd;
-              priv->is_closed = 0;
-              return CAMIO_ERR_NONE;
-          }
-      }
-
-    //Grab a file descriptor and rock on
-    if(!descr->query){
-        eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
-    }
-
-    this->fd = open(descr->query, O_WRONLY | O_CREAT | O_TRUNC, (mode_t)(0666));
-    if(this->fd == -1){
-        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\"\n", descr->query);
-    }
+    //If we have a file descriptor from the outside world, then use it! Otherwise the write buffer
+    //opens the file, so that it can rotate it
+    const int fd = priv->params && priv->params->fd > -1 ? priv->params->fd : -1;
+    this->fd = camio_write_buffer_init(&priv->wbuf, fd, descr, 0);
     priv->is_closed = 0;
     return CAMIO_ERR_NONE;
 }
 
 void camio_ostream_log_close(camio_ostream_t* this){
     camio_ostream_log_t* priv = this->priv;
+    camio_write_buffer_destroy(&priv->wbuf);
     close(this->fd);
     priv->is_closed = 1;
 }
@@ -78,6 +55,15 @@ uint8_t* camio_ostream_log_start_write(camio_ostream_t* this, size_t len ){
     camio_ostream_log_t* priv = this->priv;
     len += 1; //Add space for a newline
 
+    //Build the line straight into the write buffer if we can. Escaped lines are built somewhere
+    //else and escaped into the write buffer at the end
+    if(likely(!priv->escape)){
+        priv->in_wbuf = camio_write_buffer_reserve(&priv->wbuf, len);
+        if(likely(priv->in_wbuf != NULL)){
+            return priv->in_wbuf;
+        }
+    }
+
     //Grow the buffer if it's not big enough
     if(len > priv->buffer_size){
         priv->buffer = realloc(priv->buffer, len);
@@ -98,57 +84,168 @@ int camio_ostream_log_ready(camio_ostream_t* this){
 }
 
 
+//Make sure the escape buffer can hold len bytes
+static void grow_escape_buffer(camio_ostream_log_t* priv, size_t len){
+    if(likely(len <= priv->escape_buffer_size)){
+        return;
+    }
+
+    priv->escape_buffer = realloc(priv->escape_buffer, len);
+    if(!priv->escape_buffer){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not grow escape buffer\n");
+    }
+    priv->escape_buffer_size = len;
+}
+
+
+//Escape count lines into the write buffer, or the escape buffer if they won't fit
+static void write_escaped(camio_ostream_log_t* priv, const camio_iovec_t* lines, size_t count){
+    size_t total = 0;
+    size_t i = 0;
+    for(; i < count; i++){
+        total += ESCAPE_HEX_MAX_LEN(lines[i].len) + 1;
+    }
+
+    uint8_t* const start = camio_write_buffer_reserve(&priv->wbuf, total);
+    uint8_t* out = start;
+    if(unlikely(!out)){
+        grow_escape_buffer(priv, total);
+        out = priv->escape_buffer;
+    }
+
+    for(i = 0; i < count; i++){
+        out += escape_hex(lines[i].buff, lines[i].len, out);
+        *out++ = '\n';
+    }
+
+    if(likely(start != NULL)){
+        camio_write_buffer_commit(&priv->wbuf, out - start, count);
+        return;
+    }
+
+    struct iovec iov = { .iov_base = priv->escape_buffer, .iov_len = out - priv->escape_buffer };
+    camio_write_buffer_writev(&priv->wbuf, &iov, 1, count);
+}
+
+
 //Commit the data that's now in the buffer that was previously allocated
 //Len must be equal to or less than len called with start_write
 uint8_t* camio_ostream_log_end_write(camio_ostream_t* this, size_t len){
     camio_ostream_log_t* priv = this->priv;
-    int result = 0;
 
-    if(!priv->escape){ //The simple (fast) case
-        if(priv->assigned_buffer){
-            result = write(this->fd,priv->assigned_buffer,len);
-            result += write(this->fd,"\n",1); //Hmmm don't like this...
+    if(unlikely(priv->escape)){
+        const camio_iovec_t line = { .buff = priv->assigned_buffer ? priv->assigned_buffer : priv->buffer, .len = len };
+        write_escaped(priv, &line, 1);
+    }
+    else if(priv->assigned_buffer){
+        //Someone else's buffer, add the newline without copying the line if it's a big one
+        struct iovec iovs[2] = {
+            { .iov_base = priv->assigned_buffer, .iov_len = len },
+            { .iov_base = "\n",                  .iov_len = 1   },
+        };
+        camio_write_buffer_writev(&priv->wbuf, iovs, 2, 1);
+    }
+    else if(likely(priv->in_wbuf != NULL)){ //The simple (fast) case
+        priv->in_wbuf[len] = '\n';
+        priv->in_wbuf = NULL;
+        camio_write_buffer_commit(&priv->wbuf, len + 1, 1);
+    }
+    else{
+        priv->buffer[len] = '\n';
+        struct iovec iov = { .iov_base = priv->buffer, .iov_len = len + 1 };
+        camio_write_buffer_writev(&priv->wbuf, &iov, 1, 1);
+    }
+
+    priv->assigned_buffer    = NULL;
+    priv->assigned_buffer_sz = 0;
+    return NULL;
+}
+
+
+//Carve up to count line buffers out of the write buffer (or the output buffer if they won't fit),
+//each with space for a newline
+int64_t camio_ostream_log_start_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_log_t* priv = this->priv;
+    count = MIN(count, CAMIO_OSTREAM_LOG_BATCH_MAX);
+
+    size_t total = 0;
+    size_t i = 0;
+    for(; i < count; i++){
+        total += slots[i].len + 1; //Add space for a newline
+    }
 
-            priv->assigned_buffer    = NULL;
-            priv->assigned_buffer_sz = 0;
-            return NULL;
+    uint8_t* buff = priv->escape ? NULL : camio_write_buffer_reserve(&priv->wbuf, total);
+    priv->in_wbuf = buff;
+    if(!buff){
+        if(total > priv->buffer_size){
+            priv->buffer = realloc(priv->buffer, total);
+            if(!priv->buffer){
+                eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not grow line buffer\n");
+            }
+            priv->buffer_size = total;
         }
+        buff = priv->buffer;
+    }
 
-        priv->buffer[len] = '\n';
-        result = write(this->fd,priv->buffer,len+1);
-        return NULL;
+    for(i = 0; i < count; i++){
+        slots[i].buff = buff;
+        buff += slots[i].len + 1;
+    }
+
+    return count;
+}
+
+
+//Write all of the lines out in one go
+int64_t camio_ostream_log_end_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_log_t* priv = this->priv;
+    count = MIN(count, CAMIO_OSTREAM_LOG_BATCH_MAX);
+
+    if(unlikely(priv->escape)){
+        write_escaped(priv, slots, count);
+        return count;
     }
 
-    const uint8_t* buffer = priv->assigned_buffer ? priv->assigned_buffer : priv->buffer;
     size_t i = 0;
-    size_t begin = 0;
-    char escaped_hex[5];
-    for(; i < len; i++){
-        if(buffer[i] < 0x20 || buffer[i] > 0x7E   ){
-            if( (i > 0) && (i - begin > 0) ){
-                result += write(this->fd,buffer + begin, i - begin);
+    //Lines may be shorter than reserved, so close up the gaps. Each one only ever moves backwards
+    if(likely(priv->in_wbuf != NULL)){
+        uint8_t* out = priv->in_wbuf;
+        for(; i < count; i++){
+            if(out != slots[i].buff){
+                memmove(out, slots[i].buff, slots[i].len);
             }
-            snprintf(escaped_hex,5,"\\x%02X",(uint8_t)buffer[i]);
-            result += write(this->fd,escaped_hex,4);
-            begin = i+1;
+            out += slots[i].len;
+            *out++ = '\n';
         }
+
+        camio_write_buffer_commit(&priv->wbuf, out - priv->in_wbuf, count);
+        priv->in_wbuf = NULL;
+        return count;
     }
-    result += write(this->fd,"\n",1);
 
-    if(priv->assigned_buffer){
-        priv->assigned_buffer    = NULL;
-        priv->assigned_buffer_sz = 0;
-        return NULL;
+    struct iovec iovs[CAMIO_OSTREAM_LOG_BATCH_MAX];
+    for(; i < count; i++){
+        slots[i].buff[slots[i].len] = '\n';
+        iovs[i].iov_base = slots[i].buff;
+        iovs[i].iov_len  = slots[i].len + 1;
     }
 
-    return NULL;
+    camio_write_buffer_writev(&priv->wbuf, iovs, count, count);
+    return count;
+}
+
 
+//Write out anything that's waiting in the write buffer
+void camio_ostream_log_flush(camio_ostream_t* this){
+    camio_ostream_log_t* priv = this->priv;
+    camio_write_buffer_flush(&priv->wbuf);
 }
 
 
 void camio_ostream_log_delete(camio_ostream_t* ostream){
     ostream->close(ostream);
     camio_ostream_log_t* priv = ostream->priv;
+    free(priv->escape_buffer);
     free(priv);
 }
 
@@ -182,9 +279,13 @@ camio_ostream_t* camio_ostream_log_construct(camio_ostream_log_t* priv, const ca
     }
     //Initialize the local variables
     priv->is_closed             = 1;
-    priv->escape                = 0; //Off for the moment until the istream works //Escape by default
+    priv->escape                = 0;
+    priv->escape_buffer         = NULL;
+    priv->escape_buffer_size    = 0;
     priv->buffer_size           = 0;
     priv->buffer                = NULL;
+    priv->in_wbuf               = NULL;
+    priv->wbuf.fd               = -1;
     priv->assigned_buffer       = NULL;
     priv->assigned_buffer_sz    = 0;
     priv->params                = params;
@@ -200,6 +301,9 @@ camio_ostream_t* camio_ostream_log_construct(camio_ostream_log_t* priv, const ca
     priv->ostream.delete            = camio_ostream_log_delete;
     priv->ostream.can_assign_write  = camio_ostream_log_can_assign_write;
     priv->ostream.assign_write      = camio_ostream_log_assign_write;
+    priv->ostream.start_write_batch = camio_ostream_log_start_write_batch;
+    priv->ostream.end_write_batch   = camio_ostream_log_end_write_batch;
+    priv->ostream.flush             = camio_ostream_log_flush;
     priv->ostream.fd                = -1;
 
     //Call open, because its the obvious thing to do now...
@@ -9,6 +9,7 @@
 #define CAMIO_OSTREAM_LOG_H_
 
 #include "camio_ostream.h"
+#include "camio_write_buffer.h"
 
 /********************************************************************
  *                  PRIVATE DEFS
@@ -23,8 +24,12 @@ typedef struct {
     camio_ostream_t ostream;
     int is_closed;                          //Has close be called?
     int escape;                             //Should binary be represented by escape sequences eg \x00)
-    uint8_t* buffer;                        //Space to build output
+    camio_write_buffer_t wbuf;              //Lines are combined here and written out together
+    uint8_t* in_wbuf;                       //Space handed out by start_write in the write buffer, if it fit
+    uint8_t* buffer;                        //Space to build output that doesn't fit in the write buffer
     size_t buffer_size;                     //Size of output buffer
+    uint8_t* escape_buffer;                 //Space to build escaped output
+    size_t escape_buffer_size;              //Size of escape buffer
     uint8_t* assigned_buffer;               //Assigned write buffer
     size_t assigned_buffer_sz;              //Assigned write buffer size
     camio_ostream_log_params_t* params;      //Parameters from the outside world
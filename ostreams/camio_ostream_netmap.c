@@ -483,6 +483,61 @@ void camio_ostream_netmap_flush(camio_ostream_t* this){
 
 
 
+//Reserve as many consecutive slots as are free on the next ring with space, up to count
+int64_t camio_ostream_netmap_start_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_netmap_t* priv = this->priv;
+
+    if(unlikely(!count)){
+        return 0;
+    }
+
+    get_free_slot(this);
+    struct netmap_ring *ring = NETMAP_TXRING(priv->nifp, priv->ring_num);
+    const size_t space = MIN(count, nm_ring_space(ring));
+
+    size_t i   = 0;
+    uint32_t idx = ring->cur;
+    for(; i < space; i++){
+        if(unlikely(slots[i].len > 2 * 1024)){
+            break;
+        }
+
+        slots[i].buff = (uint8_t*)NETMAP_BUF(ring, ring->slot[idx].buf_idx);
+        idx = nm_ring_next(ring, idx);
+    }
+
+    return i;
+}
+
+
+//Commit all of the slots with a single head update and a single sync
+int64_t camio_ostream_netmap_end_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_netmap_t* priv = this->priv;
+
+    if(unlikely(!count)){
+        return 0;
+    }
+
+    struct netmap_ring *ring = NETMAP_TXRING(priv->nifp, priv->ring_num);
+    uint32_t idx = ring->cur;
+    size_t i = 0;
+    for(; i < count; i++){
+        if(unlikely(slots[i].len > 2 * 1024)){
+            eprintf_exit(CAMIO_ERR_FILE_WRITE, "The supplied length %lu is greater than the buffer size %i\n", slots[i].len, 2 * 1024);
+        }
+        ring->slot[idx].len = slots[i].len;
+        idx = nm_ring_next(ring, idx);
+    }
+
+    ring->cur  = idx;
+    ring->head = ring->cur;
+    ioctl(this->fd, NIOCTXSYNC, NULL);
+
+    pcount += count;
+    return count;
+}
+
+
 void camio_ostream_netmap_delete(camio_ostream_t* ostream){
     ostream->close(ostream);
     camio_ostream_netmap_t* priv = ostream->priv;
@@ -548,6 +603,8 @@ camio_ostream_t* camio_ostream_netmap_construct(camio_ostream_netmap_t* priv, co
     priv->ostream.can_assign_write  = camio_ostream_netmap_can_assign_write;
     priv->ostream.assign_write      = camio_ostream_netmap_assign_write;
     priv->ostream.flush             = camio_ostream_netmap_flush;
+    priv->ostream.start_write_batch = camio_ostream_netmap_start_write_batch;
+    priv->ostream.end_write_batch   = camio_ostream_netmap_end_write_batch;
     priv->ostream.fd                = -1;
 
     //Call open, because its the obvious thing to do now...
@@ -0,0 +1,338 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ pcap file output stream
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+
+#include "../camio_util.h"
+#include "../camio_errors.h"
+
+#include "camio_ostream_pcap.h"
+
+#define CAMIO_OSTREAM_PCAP_INIT_BUFF_SIZE (4 * 1024ULL) //4kB initial buffer, only used for records that don't fit in the write buffer
+
+int camio_ostream_pcap_open(camio_ostream_t* this, const camio_descr_t* descr ){
+    camio_ostream_pcap_t* priv = this->priv;
+
+    const char* valid_opts[] = { "hdr", "nano", "snaplen", "linktype", CAMIO_WRITE_BUFFER_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+    priv->hdr     = camio_descr_get_opt_bool(descr, "hdr", 1);
+    priv->nano    = camio_descr_get_opt_bool(descr, "nano", 0);
+    priv->snaplen = camio_descr_get_opt_uint(descr, "snaplen", CAMIO_PCAP_DEFAULT_SNAPLEN);
+
+    priv->buffer = malloc(CAMIO_OSTREAM_PCAP_INIT_BUFF_SIZE);
+    if(!priv->buffer){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not allocate output buffer\n");
+    }
+    priv->buffer_size  = CAMIO_OSTREAM_PCAP_INIT_BUFF_SIZE;
+
+    //If we have a file descriptor from the outside world, then use it! Otherwise the write buffer
+    //opens the file, so that it can rotate it
+    const int fd = priv->params && priv->params->fd > -1 ? priv->params->fd : -1;
+    this->fd = camio_write_buffer_init(&priv->wbuf, fd, descr, 0);
+
+    const camio_pcap_file_hdr_t file_hdr = {
+        .magic          = priv->nano ? CAMIO_PCAP_MAGIC_NSEC : CAMIO_PCAP_MAGIC,
+        .version_major  = CAMIO_PCAP_VERSION_MAJOR,
+        .version_minor  = CAMIO_PCAP_VERSION_MINOR,
+        .thiszone       = 0,
+        .sigfigs        = 0,
+        .snaplen        = priv->snaplen,
+        .linktype       = camio_descr_get_opt_uint(descr, "linktype", CAMIO_PCAP_LINKTYPE_ETHERNET),
+    };
+    camio_write_buffer_set_file_header(&priv->wbuf, &file_hdr, sizeof(file_hdr));
+    struct iovec iov = { .iov_base = (void*)&file_hdr, .iov_len = sizeof(file_hdr) };
+    camio_write_buffer_writev(&priv->wbuf, &iov, 1, 0);
+
+    priv->is_closed = 0;
+    return CAMIO_ERR_NONE;
+}
+
+void camio_ostream_pcap_close(camio_ostream_t* this){
+    camio_ostream_pcap_t* priv = this->priv;
+    if(priv->is_closed){
+        return;
+    }
+    camio_write_buffer_destroy(&priv->wbuf);
+    close(this->fd);
+    free(priv->buffer);
+    priv->buffer = NULL;
+    priv->is_closed = 1;
+}
+
+
+//Fill in the record header for a bare packet of len bytes, returns how much of it to keep
+static inline uint32_t stamp(camio_ostream_pcap_t* priv, camio_pcap_rec_hdr_t* rec_hdr, size_t len, const struct timespec* now){
+    rec_hdr->ts_sec  = now->tv_sec;
+    rec_hdr->ts_frac = priv->nano ? now->tv_nsec : now->tv_nsec / 1000;
+    rec_hdr->caplen  = MIN(len, priv->snaplen);
+    rec_hdr->len     = len;
+    return rec_hdr->caplen;
+}
+
+
+//Whole records have to be exactly what their header says they are, or the file is ruined
+static inline void check_record(const uint8_t* rec, size_t len){
+    const camio_pcap_rec_hdr_t* rec_hdr = (const camio_pcap_rec_hdr_t*)rec;
+    if(unlikely(len < sizeof(camio_pcap_rec_hdr_t) || len != sizeof(camio_pcap_rec_hdr_t) + rec_hdr->caplen)){
+        eprintf_exit(CAMIO_ERR_FILE_WRITE, "Write of %lu bytes is not a pcap record. Use hdr=0 to write bare packets\n", len);
+    }
+}
+
+
+//Space in front of each write for the record header, if we're adding them
+static inline size_t hdr_space(camio_ostream_pcap_t* priv){
+    return priv->hdr ? 0 : sizeof(camio_pcap_rec_hdr_t);
+}
+
+
+static void grow_buffer(camio_ostream_pcap_t* priv, size_t len){
+    if(unlikely(len > priv->buffer_size)){
+        priv->buffer = realloc(priv->buffer, len);
+        if(!priv->buffer){
+            eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not grow output buffer\n");
+        }
+        priv->buffer_size = len;
+    }
+}
+
+
+//Returns a pointer to a space of size len, ready for data
+uint8_t* camio_ostream_pcap_start_write(camio_ostream_t* this, size_t len ){
+    camio_ostream_pcap_t* priv = this->priv;
+    const size_t extra = hdr_space(priv);
+
+    //Build straight into the write buffer if we can
+    priv->in_wbuf = camio_write_buffer_reserve(&priv->wbuf, len + extra);
+    if(likely(priv->in_wbuf != NULL)){
+        return priv->in_wbuf + extra;
+    }
+
+    grow_buffer(priv, len + extra);
+    return priv->buffer + extra;
+}
+
+//Returns non-zero if a call to start_write will be non-blocking
+int camio_ostream_pcap_ready(camio_ostream_t* this){
+    //Not implemented
+    eprintf_exit(CAMIO_ERR_NOT_IMPL, "\n");
+    return 0;
+}
+
+
+//Commit the data that's now in the buffer that was previously allocated
+//Len must be equal to or less than len called with start_write
+uint8_t* camio_ostream_pcap_end_write(camio_ostream_t* this, size_t len){
+    camio_ostream_pcap_t* priv = this->priv;
+    struct timespec now;
+    if(!priv->hdr){
+        clock_gettime(CLOCK_REALTIME, &now);
+    }
+
+    if(unlikely(priv->assigned_buffer != NULL)){
+        //Assigned buffers go out from where they are, without a copy
+        camio_pcap_rec_hdr_t rec_hdr;
+        struct iovec iovs[2];
+        int iov_count = 0;
+        size_t keep = len;
+        if(priv->hdr){
+            check_record(priv->assigned_buffer, len);
+        }
+        else{
+            keep = stamp(priv, &rec_hdr, len, &now);
+            iovs[iov_count].iov_base = &rec_hdr;
+            iovs[iov_count].iov_len  = sizeof(rec_hdr);
+            iov_count++;
+        }
+        iovs[iov_count].iov_base = priv->assigned_buffer;
+        iovs[iov_count].iov_len  = keep;
+        iov_count++;
+
+        camio_write_buffer_writev(&priv->wbuf, iovs, iov_count, 1);
+        priv->assigned_buffer    = NULL;
+        priv->assigned_buffer_sz = 0;
+        return NULL;
+    }
+
+    uint8_t* rec = priv->in_wbuf ? priv->in_wbuf : priv->buffer;
+    size_t rec_len = len;
+    if(priv->hdr){
+        check_record(rec, len);
+    }
+    else{
+        rec_len = sizeof(camio_pcap_rec_hdr_t) + stamp(priv, (camio_pcap_rec_hdr_t*)rec, len, &now);
+    }
+
+    if(likely(priv->in_wbuf != NULL)){
+        camio_write_buffer_commit(&priv->wbuf, rec_len, 1);
+        priv->in_wbuf = NULL;
+    }
+    else{
+        struct iovec iov = { .iov_base = rec, .iov_len = rec_len };
+        camio_write_buffer_writev(&priv->wbuf, &iov, 1, 1);
+    }
+
+    return NULL;
+}
+
+
+//Carve up to count records out of the write buffer. If they won't all fit, fall back to one at a time
+int64_t camio_ostream_pcap_start_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_pcap_t* priv = this->priv;
+    const size_t extra = hdr_space(priv);
+
+    size_t total = 0;
+    size_t i = 0;
+    for(; i < count; i++){
+        total += slots[i].len + extra;
+    }
+
+    uint8_t* buff = camio_write_buffer_reserve(&priv->wbuf, total);
+    priv->in_wbuf = buff;
+    if(!buff){
+        priv->batch_generic = 1;
+        return camio_ostream_start_write_batch_generic(this, slots, count);
+    }
+
+    for(i = 0; i < count; i++){
+        slots[i].buff = buff + extra;
+        buff += slots[i].len + extra;
+    }
+
+    return count;
+}
+
+
+//Write all of the records out in one go
+int64_t camio_ostream_pcap_end_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_pcap_t* priv = this->priv;
+    if(unlikely(priv->batch_generic)){
+        priv->batch_generic = 0;
+        return camio_ostream_end_write_batch_generic(this, slots, count);
+    }
+
+    struct timespec now;
+    if(!priv->hdr){
+        clock_gettime(CLOCK_REALTIME, &now);
+    }
+
+    //Slots may be shorter than reserved, so close up the gaps. Each one only ever moves backwards,
+    //and a header never reaches past the start of its own slot
+    uint8_t* out = priv->in_wbuf;
+    size_t i = 0;
+    for(; i < count; i++){
+        size_t keep = slots[i].len;
+        if(priv->hdr){
+            check_record(slots[i].buff, slots[i].len);
+        }
+        else{
+            keep = stamp(priv, (camio_pcap_rec_hdr_t*)out, slots[i].len, &now);
+            out += sizeof(camio_pcap_rec_hdr_t);
+        }
+
+        if(out != slots[i].buff){
+            memmove(out, slots[i].buff, keep);
+        }
+        out += keep;
+    }
+
+    camio_write_buffer_commit(&priv->wbuf, out - priv->in_wbuf, count);
+    priv->in_wbuf = NULL;
+    return count;
+}
+
+
+//Write out anything that's waiting in the write buffer
+void camio_ostream_pcap_flush(camio_ostream_t* this){
+    camio_ostream_pcap_t* priv = this->priv;
+    camio_write_buffer_flush(&priv->wbuf);
+}
+
+
+void camio_ostream_pcap_delete(camio_ostream_t* ostream){
+    ostream->close(ostream);
+    camio_ostream_pcap_t* priv = ostream->priv;
+    free(priv);
+}
+
+//Is this stream capable of taking over another stream buffer
+int camio_ostream_pcap_can_assign_write(camio_ostream_t* this){
+    return 1;
+}
+
+//Assign the write buffer to the stream
+int camio_ostream_pcap_assign_write(camio_ostream_t* this, uint8_t* buffer, size_t len){
+    camio_ostream_pcap_t* priv = this->priv;
+
+    if(unlikely(!buffer)){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"Assigned buffer is null.");
+    }
+
+    priv->assigned_buffer    = buffer;
+    priv->assigned_buffer_sz = len;
+
+    return 0;
+}
+
+
+/* ****************************************************
+ * Construction heavy lifting
+ */
+
+camio_ostream_t* camio_ostream_pcap_construct(camio_ostream_pcap_t* priv, const camio_descr_t* descr, camio_ostream_pcap_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"pcap stream supplied is null\n");
+    }
+    //Initialize the local variables
+    priv->is_closed             = 1;
+    priv->hdr                   = 1;
+    priv->nano                  = 0;
+    priv->snaplen               = CAMIO_PCAP_DEFAULT_SNAPLEN;
+    priv->buffer_size           = 0;
+    priv->buffer                = NULL;
+    priv->assigned_buffer       = NULL;
+    priv->assigned_buffer_sz    = 0;
+    priv->in_wbuf               = NULL;
+    priv->batch_generic         = 0;
+    priv->wbuf.fd               = -1;
+    priv->params                = params;
+
+
+    //Populate the function members
+    priv->ostream.priv              = priv; //Lets us access private members from public functions
+    priv->ostream.open              = camio_ostream_pcap_open;
+    priv->ostream.close             = camio_ostream_pcap_close;
+    priv->ostream.start_write       = camio_ostream_pcap_start_write;
+    priv->ostream.end_write         = camio_ostream_pcap_end_write;
+    priv->ostream.ready             = camio_ostream_pcap_ready;
+    priv->ostream.delete            = camio_ostream_pcap_delete;
+    priv->ostream.can_assign_write  = camio_ostream_pcap_can_assign_write;
+    priv->ostream.assign_write      = camio_ostream_pcap_assign_write;
+    priv->ostream.start_write_batch = camio_ostream_pcap_start_write_batch;
+    priv->ostream.end_write_batch   = camio_ostream_pcap_end_write_batch;
+    priv->ostream.flush             = camio_ostream_pcap_flush;
+    priv->ostream.fd                = -1;
+
+    //Call open, because its the obvious thing to do now...
+    priv->ostream.open(&priv->ostream, descr);
+
+    //Return the generic ostream interface for the outside world
+    return &priv->ostream;
+
+}
+
+camio_ostream_t* camio_ostream_pcap_new( const camio_descr_t* descr, camio_ostream_pcap_params_t* params){
+    camio_ostream_pcap_t* priv = malloc(sizeof(camio_ostream_pcap_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for ostream pcap creation\n");
+    }
+    return camio_ostream_pcap_construct(priv, descr, params);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ pcap file output stream
+ *
+ * Records are built straight into the write buffer (see camio_write_buffer.h), so the usual
+ * buffering, aio, direct I/O and rotation options all apply. Each rotated file gets its own pcap
+ * file header.
+ *
+ * Options:
+ * hdr=0       Each write is a bare packet, which is given a record header stamped with the current
+ *             time. By default each write is a whole record, header and all, as the pcap istream
+ *             hands them out, and is written as it is
+ * nano=1      Write a nanosecond pcap file. Records passed in whole have to have nanosecond
+ *             timestamps already
+ * snaplen=N   Bytes of each bare packet to keep, defaults to 65535
+ * linktype=N  Link type in the file header, defaults to 1 (Ethernet)
+ *
+ */
+
+#ifndef CAMIO_OSTREAM_PCAP_H_
+#define CAMIO_OSTREAM_PCAP_H_
+
+#include "camio_ostream.h"
+#include "camio_write_buffer.h"
+#include "../camio_pcap.h"
+
+/********************************************************************
+ *                  PRIVATE DEFS
+ ********************************************************************/
+
+
+typedef struct {
+    int fd; //Allow creator to bypass file open stage and supply their own FD;
+} camio_ostream_pcap_params_t;
+
+typedef struct {
+    camio_ostream_t ostream;
+    int is_closed;                          //Has close be called?
+    int hdr;                                //Writes come with their record headers
+    int nano;                               //Nanosecond timestamps
+    uint32_t snaplen;
+    camio_write_buffer_t wbuf;              //Records are combined here and written out together
+    uint8_t* in_wbuf;                       //Space handed out by start_write in the write buffer, if it fit
+    int batch_generic;                      //The last batch didn't fit in the write buffer
+    uint8_t* buffer;                        //Space to build records that don't fit in the write buffer
+    uint64_t buffer_size;                   //Size of output buffer
+    uint8_t* assigned_buffer;               //Assigned write buffer
+    uint64_t assigned_buffer_sz;            //Assigned write buffer size
+    camio_ostream_pcap_params_t* params;    //Parameters from the outside world
+
+} camio_ostream_pcap_t;
+
+
+
+/********************************************************************
+ *                  PUBLIC DEFS
+ ********************************************************************/
+
+camio_ostream_t* camio_ostream_pcap_new( const camio_descr_t* opts,  camio_ostream_pcap_params_t* params);
+
+
+
+#endif /* CAMIO_OSTREAM_PCAP_H_ */
@@ -0,0 +1,489 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ pcapng file output stream
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+
+#include "../camio_util.h"
+#include "../camio_errors.h"
+#include "../camio_erf.h"
+
+#include "camio_ostream_pcapng.h"
+
+#define CAMIO_OSTREAM_PCAPNG_INIT_BUFF_SIZE (4 * 1024ULL) //4kB initial buffer, only used for blocks that don't fit in the write buffer
+#define CAMIO_OSTREAM_PCAPNG_TAIL (3 + sizeof(uint32_t))  //Most padding after a packet, and the trailing length
+#define CAMIO_OSTREAM_PCAPNG_HDR_MAX 512                  //Section header and interface descriptions
+
+//Where a packet is in a write, and what to say about it
+typedef struct {
+    size_t offset;                      //Of the packet from the start of the write
+    uint32_t caplen;
+    uint32_t len;
+    uint32_t if_id;
+    uint64_t ts;                        //In the file's units
+} packet_t;
+
+
+static uint8_t* put_opt(uint8_t* out, uint16_t code, const void* value, uint16_t len){
+    const camio_pcapng_opt_t opt = { .code = code, .len = len };
+    memcpy(out, &opt, sizeof(opt));
+    out += sizeof(opt);
+    if(len){
+        memcpy(out, value, len);
+        bzero(out + len, CAMIO_PCAPNG_PAD(len) - len);
+    }
+    return out + CAMIO_PCAPNG_PAD(len);
+}
+
+
+static uint8_t* put_idb(camio_ostream_pcapng_t* priv, uint8_t* out, uint16_t linktype, const char* name){
+    camio_pcapng_idb_t* idb = (camio_pcapng_idb_t*)out;
+    idb->hdr.type = CAMIO_PCAPNG_BLOCK_IDB;
+    idb->linktype = linktype;
+    idb->reserved = 0;
+    idb->snaplen  = priv->snaplen;
+
+    uint8_t* opt_ptr = out + sizeof(camio_pcapng_idb_t);
+    if(name){
+        opt_ptr = put_opt(opt_ptr, CAMIO_PCAPNG_OPT_IF_NAME, name, strlen(name));
+    }
+    opt_ptr = put_opt(opt_ptr, CAMIO_PCAPNG_OPT_IF_TSRESOL, &priv->tsresol, sizeof(priv->tsresol));
+    if(priv->tsoffset){
+        const int64_t tsoffset = priv->tsoffset;
+        opt_ptr = put_opt(opt_ptr, CAMIO_PCAPNG_OPT_IF_TSOFFSET, &tsoffset, sizeof(tsoffset));
+    }
+    opt_ptr = put_opt(opt_ptr, CAMIO_PCAPNG_OPT_END, NULL, 0);
+
+    const uint32_t total_len = opt_ptr + sizeof(uint32_t) - out;
+    idb->hdr.total_len = total_len;
+    memcpy(opt_ptr, &total_len, sizeof(total_len));
+    return out + total_len;
+}
+
+
+//The section header and interface descriptions every file starts with
+static size_t make_file_header(camio_ostream_pcapng_t* priv, uint16_t linktype, uint8_t* out){
+    camio_pcapng_shb_t* shb = (camio_pcapng_shb_t*)out;
+    const uint32_t shb_len = sizeof(camio_pcapng_shb_t) + sizeof(uint32_t);
+    shb->hdr.type       = CAMIO_PCAPNG_BLOCK_SHB;
+    shb->hdr.total_len  = shb_len;
+    shb->bom            = CAMIO_PCAPNG_BOM;
+    shb->version_major  = CAMIO_PCAPNG_VERSION_MAJOR;
+    shb->version_minor  = CAMIO_PCAPNG_VERSION_MINOR;
+    shb->section_len    = -1;
+    memcpy(out + sizeof(camio_pcapng_shb_t), &shb_len, sizeof(shb_len));
+
+    uint8_t* end = out + shb_len;
+    if(!priv->erf){
+        end = put_idb(priv, end, linktype, NULL);
+        return end - out;
+    }
+
+    //Interface ids are the ERF port numbers
+    int port = 0;
+    for(; port < CAMIO_OSTREAM_PCAPNG_ERF_PORTS; port++){
+        char name[16];
+        snprintf(name, sizeof(name), "port%i", port);
+        end = put_idb(priv, end, CAMIO_PCAP_LINKTYPE_ETHERNET, name);
+    }
+    return end - out;
+}
+
+
+int camio_ostream_pcapng_open(camio_ostream_t* this, const camio_descr_t* descr ){
+    camio_ostream_pcapng_t* priv = this->priv;
+
+    const char* valid_opts[] = { "erf", "tsresol", "snaplen", "linktype", CAMIO_WRITE_BUFFER_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+    priv->erf     = camio_descr_get_opt_bool(descr, "erf", 0);
+    priv->snaplen = camio_descr_get_opt_uint(descr, "snaplen", CAMIO_PCAP_DEFAULT_SNAPLEN);
+    priv->lead    = sizeof(camio_pcapng_epb_t) - (priv->erf ? CAMIO_ERF_HDR_SIZE + CAMIO_ERF_ETH_PAD : 0);
+
+    const char* tsresol = camio_descr_get_opt(descr, "tsresol");
+    if(!tsresol || !strcmp(tsresol, "ns")){
+        priv->tsresol = CAMIO_PCAPNG_TSRESOL_NS;
+    }
+    else if(!strcmp(tsresol, "us")){
+        priv->tsresol = CAMIO_PCAPNG_TSRESOL_US;
+    }
+    else if(!strcmp(tsresol, "ps")){
+        priv->tsresol = CAMIO_PCAPNG_TSRESOL_PS;
+    }
+    else{
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Unknown timestamp resolution \"%s\", expected us, ns or ps\n", tsresol);
+    }
+
+    priv->ts_scale = 1;
+    uint8_t i = 0;
+    for(; i < priv->tsresol; i++){
+        priv->ts_scale *= 10;
+    }
+
+    //Picoseconds since 1970 don't fit in 64 bits, so count from now
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    priv->tsoffset = priv->tsresol > CAMIO_PCAPNG_TSRESOL_NS ? (uint64_t)now.tv_sec : 0;
+
+    priv->buffer = malloc(CAMIO_OSTREAM_PCAPNG_INIT_BUFF_SIZE);
+    if(!priv->buffer){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not allocate output buffer\n");
+    }
+    priv->buffer_size  = CAMIO_OSTREAM_PCAPNG_INIT_BUFF_SIZE;
+
+    //If we have a file descriptor from the outside world, then use it! Otherwise the write buffer
+    //opens the file, so that it can rotate it
+    const int fd = priv->params && priv->params->fd > -1 ? priv->params->fd : -1;
+    this->fd = camio_write_buffer_init(&priv->wbuf, fd, descr, 0);
+
+    uint8_t file_hdr[CAMIO_OSTREAM_PCAPNG_HDR_MAX];
+    const size_t file_hdr_len = make_file_header(priv, camio_descr_get_opt_uint(descr, "linktype", CAMIO_PCAP_LINKTYPE_ETHERNET), file_hdr);
+    camio_write_buffer_set_file_header(&priv->wbuf, file_hdr, file_hdr_len);
+    struct iovec iov = { .iov_base = file_hdr, .iov_len = file_hdr_len };
+    camio_write_buffer_writev(&priv->wbuf, &iov, 1, 0);
+
+    priv->is_closed = 0;
+    return CAMIO_ERR_NONE;
+}
+
+void camio_ostream_pcapng_close(camio_ostream_t* this){
+    camio_ostream_pcapng_t* priv = this->priv;
+    if(priv->is_closed){
+        return;
+    }
+    camio_write_buffer_destroy(&priv->wbuf);
+    close(this->fd);
+    free(priv->buffer);
+    priv->buffer = NULL;
+    priv->is_closed = 1;
+}
+
+
+//A bare packet of len bytes, arriving now
+static inline void describe_packet(camio_ostream_pcapng_t* priv, size_t len, const struct timespec* now, packet_t* pkt){
+    const uint64_t secs = (uint64_t)now->tv_sec > priv->tsoffset ? now->tv_sec - priv->tsoffset : 0;
+    const uint64_t frac = priv->tsresol > CAMIO_PCAPNG_TSRESOL_NS ?
+            now->tv_nsec * (priv->ts_scale / 1000000000ULL) : now->tv_nsec / (1000000000ULL / priv->ts_scale);
+
+    pkt->offset = 0;
+    pkt->caplen = MIN(len, priv->snaplen);
+    pkt->len    = len;
+    pkt->if_id  = 0;
+    pkt->ts     = secs * priv->ts_scale + frac;
+}
+
+
+//An ERF record of len bytes
+static inline void describe_erf(camio_ostream_pcapng_t* priv, const uint8_t* rec, size_t len, packet_t* pkt){
+    const dag_record_t* erf = (const dag_record_t*)rec;
+    if(unlikely(len < CAMIO_ERF_HDR_SIZE)){
+        eprintf_exit(CAMIO_ERR_NOT_AN_ERF, "Write of %lu bytes is too short to be an ERF record\n", len);
+    }
+    if(unlikely(!camio_erf_is_ethernet(erf))){
+        eprintf_exit(CAMIO_ERR_NOT_AN_ERF, "ERF record type %u can't be written to pcapng, only Ethernet records can\n", erf->type);
+    }
+
+    const size_t rlen = MIN(len, ntohs(erf->rlen));
+    pkt->offset = camio_erf_payload_offset(erf, rlen);
+    if(unlikely(!pkt->offset)){
+        eprintf_exit(CAMIO_ERR_NOT_AN_ERF, "ERF record headers are longer than the record (%lu bytes)\n", rlen);
+    }
+
+    //rlen includes padding, wlen doesn't
+    pkt->len    = ntohs(erf->wlen);
+    pkt->caplen = MIN(MIN(rlen - pkt->offset, pkt->len), priv->snaplen);
+    pkt->if_id  = erf->flags.iface;
+
+    if(unlikely((erf->ts >> 32) < priv->tsoffset)){
+        if(!priv->ts_warned){
+            wprintf(CAMIO_ERR_FILE_WRITE, "ERF records from before the file was opened can't have picosecond timestamps, using 0\n");
+            priv->ts_warned = 1;
+        }
+        pkt->ts = 0;
+        return;
+    }
+    pkt->ts = camio_erf_ts_to_units(erf->ts, priv->tsresol, priv->tsoffset);
+}
+
+
+static inline void describe(camio_ostream_pcapng_t* priv, const uint8_t* data, size_t len, const struct timespec* now, packet_t* pkt){
+    if(priv->erf){
+        describe_erf(priv, data, len, pkt);
+    }
+    else{
+        describe_packet(priv, len, now, pkt);
+    }
+}
+
+
+//Fill in the block header, returns the block's total length
+static inline uint32_t put_epb_hdr(camio_pcapng_epb_t* epb, const packet_t* pkt){
+    const uint32_t total_len = sizeof(camio_pcapng_epb_t) + CAMIO_PCAPNG_PAD(pkt->caplen) + sizeof(uint32_t);
+    epb->hdr.type       = CAMIO_PCAPNG_BLOCK_EPB;
+    epb->hdr.total_len  = total_len;
+    epb->if_id          = pkt->if_id;
+    epb->ts_high        = pkt->ts >> 32;
+    epb->ts_low         = pkt->ts;
+    epb->caplen         = pkt->caplen;
+    epb->len            = pkt->len;
+    return total_len;
+}
+
+
+//Padding and trailing length after the packet, returns how many bytes that is
+static inline size_t put_epb_tail(uint8_t* out, const packet_t* pkt, uint32_t total_len){
+    const size_t pad = CAMIO_PCAPNG_PAD(pkt->caplen) - pkt->caplen;
+    bzero(out, pad);
+    memcpy(out + pad, &total_len, sizeof(total_len));
+    return pad + sizeof(total_len);
+}
+
+
+//Turn a write of len bytes at rec + lead into a block starting at rec. Returns the block's length
+static inline size_t build_block(camio_ostream_pcapng_t* priv, uint8_t* rec, size_t len, const struct timespec* now){
+    uint8_t* data = rec + priv->lead;
+    packet_t pkt;
+    describe(priv, data, len, now, &pkt);
+
+    //Bare packets are already in place. ERF payloads move back over the ERF header
+    uint8_t* packet = rec + sizeof(camio_pcapng_epb_t);
+    if(data + pkt.offset != packet){
+        memmove(packet, data + pkt.offset, pkt.caplen);
+    }
+
+    const uint32_t total_len = put_epb_hdr((camio_pcapng_epb_t*)rec, &pkt);
+    put_epb_tail(packet + pkt.caplen, &pkt, total_len);
+    return total_len;
+}
+
+
+static void grow_buffer(camio_ostream_pcapng_t* priv, size_t len){
+    if(unlikely(len > priv->buffer_size)){
+        priv->buffer = realloc(priv->buffer, len);
+        if(!priv->buffer){
+            eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not grow output buffer\n");
+        }
+        priv->buffer_size = len;
+    }
+}
+
+
+//Returns a pointer to a space of size len, ready for data
+uint8_t* camio_ostream_pcapng_start_write(camio_ostream_t* this, size_t len ){
+    camio_ostream_pcapng_t* priv = this->priv;
+    const size_t space = priv->lead + len + CAMIO_OSTREAM_PCAPNG_TAIL;
+
+    //Build straight into the write buffer if we can
+    priv->in_wbuf = camio_write_buffer_reserve(&priv->wbuf, space);
+    if(likely(priv->in_wbuf != NULL)){
+        return priv->in_wbuf + priv->lead;
+    }
+
+    grow_buffer(priv, space);
+    return priv->buffer + priv->lead;
+}
+
+//Returns non-zero if a call to start_write will be non-blocking
+int camio_ostream_pcapng_ready(camio_ostream_t* this){
+    //Not implemented
+    eprintf_exit(CAMIO_ERR_NOT_IMPL, "\n");
+    return 0;
+}
+
+
+//Commit the data that's now in the buffer that was previously allocated
+//Len must be equal to or less than len called with start_write
+uint8_t* camio_ostream_pcapng_end_write(camio_ostream_t* this, size_t len){
+    camio_ostream_pcapng_t* priv = this->priv;
+    struct timespec now;
+    if(!priv->erf){
+        clock_gettime(CLOCK_REALTIME, &now);
+    }
+
+    if(unlikely(priv->assigned_buffer != NULL)){
+        //Assigned buffers go out from where they are, without a copy
+        packet_t pkt;
+        describe(priv, priv->assigned_buffer, len, &now, &pkt);
+
+        camio_pcapng_epb_t epb;
+        uint8_t tail[CAMIO_OSTREAM_PCAPNG_TAIL];
+        const uint32_t total_len = put_epb_hdr(&epb, &pkt);
+        struct iovec iovs[3] = {
+            { .iov_base = &epb,                                 .iov_len = sizeof(epb) },
+            { .iov_base = priv->assigned_buffer + pkt.offset,   .iov_len = pkt.caplen },
+            { .iov_base = tail,                                 .iov_len = put_epb_tail(tail, &pkt, total_len) },
+        };
+
+        camio_write_buffer_writev(&priv->wbuf, iovs, 3, 1);
+        priv->assigned_buffer    = NULL;
+        priv->assigned_buffer_sz = 0;
+        return NULL;
+    }
+
+    if(likely(priv->in_wbuf != NULL)){
+        camio_write_buffer_commit(&priv->wbuf, build_block(priv, priv->in_wbuf, len, &now), 1);
+        priv->in_wbuf = NULL;
+    }
+    else{
+        struct iovec iov = { .iov_base = priv->buffer, .iov_len = build_block(priv, priv->buffer, len, &now) };
+        camio_write_buffer_writev(&priv->wbuf, &iov, 1, 1);
+    }
+
+    return NULL;
+}
+
+
+//Carve up to count packets out of the write buffer. If they won't all fit, fall back to one at a time
+int64_t camio_ostream_pcapng_start_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_pcapng_t* priv = this->priv;
+
+    size_t total = 0;
+    size_t i = 0;
+    for(; i < count; i++){
+        total += priv->lead + slots[i].len + CAMIO_OSTREAM_PCAPNG_TAIL;
+    }
+
+    uint8_t* buff = camio_write_buffer_reserve(&priv->wbuf, total);
+    priv->in_wbuf = buff;
+    if(!buff){
+        priv->batch_generic = 1;
+        return camio_ostream_start_write_batch_generic(this, slots, count);
+    }
+
+    for(i = 0; i < count; i++){
+        slots[i].buff = buff + priv->lead;
+        buff += priv->lead + slots[i].len + CAMIO_OSTREAM_PCAPNG_TAIL;
+    }
+
+    return count;
+}
+
+
+//Write all of the packets out in one go
+int64_t camio_ostream_pcapng_end_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_pcapng_t* priv = this->priv;
+    if(unlikely(priv->batch_generic)){
+        priv->batch_generic = 0;
+        return camio_ostream_end_write_batch_generic(this, slots, count);
+    }
+
+    struct timespec now;
+    if(!priv->erf){
+        clock_gettime(CLOCK_REALTIME, &now);
+    }
+
+    //Build each block where its slot is, then close up the gaps. Each one only ever moves backwards
+    uint8_t* out = priv->in_wbuf;
+    size_t i = 0;
+    for(; i < count; i++){
+        uint8_t* rec = slots[i].buff - priv->lead;
+        const size_t block_len = build_block(priv, rec, slots[i].len, &now);
+        if(out != rec){
+            memmove(out, rec, block_len);
+        }
+        out += block_len;
+    }
+
+    camio_write_buffer_commit(&priv->wbuf, out - priv->in_wbuf, count);
+    priv->in_wbuf = NULL;
+    return count;
+}
+
+
+//Write out anything that's waiting in the write buffer
+void camio_ostream_pcapng_flush(camio_ostream_t* this){
+    camio_ostream_pcapng_t* priv = this->priv;
+    camio_write_buffer_flush(&priv->wbuf);
+}
+
+
+void camio_ostream_pcapng_delete(camio_ostream_t* ostream){
+    ostream->close(ostream);
+    camio_ostream_pcapng_t* priv = ostream->priv;
+    free(priv);
+}
+
+//Is this stream capable of taking over another stream buffer
+int camio_ostream_pcapng_can_assign_write(camio_ostream_t* this){
+    return 1;
+}
+
+//Assign the write buffer to the stream
+int camio_ostream_pcapng_assign_write(camio_ostream_t* this, uint8_t* buffer, size_t len){
+    camio_ostream_pcapng_t* priv = this->priv;
+
+    if(unlikely(!buffer)){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"Assigned buffer is null.");
+    }
+
+    priv->assigned_buffer    = buffer;
+    priv->assigned_buffer_sz = len;
+
+    return 0;
+}
+
+
+/* ****************************************************
+ * Construction heavy lifting
+ */
+
+camio_ostream_t* camio_ostream_pcapng_construct(camio_ostream_pcapng_t* priv, const camio_descr_t* descr, camio_ostream_pcapng_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"pcapng stream supplied is null\n");
+    }
+    //Initialize the local variables
+    priv->is_closed             = 1;
+    priv->erf                   = 0;
+    priv->tsresol               = CAMIO_PCAPNG_TSRESOL_NS;
+    priv->ts_scale              = 1000000000ULL;
+    priv->tsoffset              = 0;
+    priv->ts_warned             = 0;
+    priv->snaplen               = CAMIO_PCAP_DEFAULT_SNAPLEN;
+    priv->lead                  = sizeof(camio_pcapng_epb_t);
+    priv->buffer_size           = 0;
+    priv->buffer                = NULL;
+    priv->assigned_buffer       = NULL;
+    priv->assigned_buffer_sz    = 0;
+    priv->in_wbuf               = NULL;
+    priv->batch_generic         = 0;
+    priv->wbuf.fd               = -1;
+    priv->params                = params;
+
+
+    //Populate the function members
+    priv->ostream.priv              = priv; //Lets us access private members from public functions
+    priv->ostream.open              = camio_ostream_pcapng_open;
+    priv->ostream.close             = camio_ostream_pcapng_close;
+    priv->ostream.start_write       = camio_ostream_pcapng_start_write;
+    priv->ostream.end_write         = camio_ostream_pcapng_end_write;
+    priv->ostream.ready             = camio_ostream_pcapng_ready;
+    priv->ostream.delete            = camio_ostream_pcapng_delete;
+    priv->ostream.can_assign_write  = camio_ostream_pcapng_can_assign_write;
+    priv->ostream.assign_write      = camio_ostream_pcapng_assign_write;
+    priv->ostream.start_write_batch = camio_ostream_pcapng_start_write_batch;
+    priv->ostream.end_write_batch   = camio_ostream_pcapng_end_write_batch;
+    priv->ostream.flush             = camio_ostream_pcapng_flush;
+    priv->ostream.fd                = -1;
+
+    //Call open, because its the obvious thing to do now...
+    priv->ostream.open(&priv->ostream, descr);
+
+    //Return the generic ostream interface for the outside world
+    return &priv->ostream;
+
+}
+
+camio_ostream_t* camio_ostream_pcapng_new( const camio_descr_t* descr, camio_ostream_pcapng_params_t* params){
+    camio_ostream_pcapng_t* priv = malloc(sizeof(camio_ostream_pcapng_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for ostream pcapng creation\n");
+    }
+    return camio_ostream_pcapng_construct(priv, descr, params);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ pcapng file output stream
+ *
+ * Packets are built straight into the write buffer (see camio_write_buffer.h) as Enhanced Packet
+ * Blocks, so the usual buffering, aio, direct I/O and rotation options all apply. Each rotated file
+ * gets its own section header and interface descriptions.
+ *
+ * Options:
+ * erf=1       Each write is an ERF record, as the DAG and ExaNIC istreams hand them out. The file
+ *             describes one interface per ERF port (port0 to port3), and each packet goes on the
+ *             interface of the port in its flags.iface. Only Ethernet records can be written.
+ *             By default each write is a bare packet on a single interface, stamped with the
+ *             current time
+ * tsresol=X   Timestamp units, us, ns or ps, defaults to ns. Picosecond timestamps are relative to
+ *             the time the file was opened (if_tsoffset), 64 bits of them don't reach from 1970
+ * snaplen=N   Bytes of each packet to keep, defaults to 65535
+ * linktype=N  Link type of the interface for bare packets, defaults to 1 (Ethernet)
+ *
+ */
+
+#ifndef CAMIO_OSTREAM_PCAPNG_H_
+#define CAMIO_OSTREAM_PCAPNG_H_
+
+#include "camio_ostream.h"
+#include "camio_write_buffer.h"
+#include "../camio_pcapng.h"
+
+#define CAMIO_OSTREAM_PCAPNG_ERF_PORTS 4 //flags.iface is 2 bits
+
+/********************************************************************
+ *                  PRIVATE DEFS
+ ********************************************************************/
+
+
+typedef struct {
+    int fd; //Allow creator to bypass file open stage and supply their own FD;
+} camio_ostream_pcapng_params_t;
+
+typedef struct {
+    camio_ostream_t ostream;
+    int is_closed;                          //Has close be called?
+    int erf;                                //Writes are ERF records
+    uint8_t tsresol;                        //Timestamps are in 10^-tsresol seconds
+    uint64_t ts_scale;                      //10^tsresol
+    uint64_t tsoffset;                      //Seconds since the epoch timestamps are relative to
+    int ts_warned;                          //Have we complained about timestamps before tsoffset?
+    uint32_t snaplen;
+    size_t lead;                            //Bytes in front of each write to make room for the block header
+    camio_write_buffer_t wbuf;              //Blocks are combined here and written out together
+    uint8_t* in_wbuf;                       //Space handed out by start_write in the write buffer, if it fit
+    int batch_generic;                      //The last batch didn't fit in the write buffer
+    uint8_t* buffer;                        //Space to build blocks that don't fit in the write buffer
+    uint64_t buffer_size;                   //Size of output buffer
+    uint8_t* assigned_buffer;               //Assigned write buffer
+    uint64_t assigned_buffer_sz;            //Assigned write buffer size
+    camio_ostream_pcapng_params_t* params;  //Parameters from the outside world
+
+} camio_ostream_pcapng_t;
+
+
+
+/********************************************************************
+ *                  PUBLIC DEFS
+ ********************************************************************/
+
+camio_ostream_t* camio_ostream_pcapng_new( const camio_descr_t* opts,  camio_ostream_pcapng_params_t* params);
+
+
+
+#endif /* CAMIO_OSTREAM_PCAPNG_H_ */
@@ -19,6 +19,7 @@
 #include <fcntl.h>
 
 #include "../camio_errors.h"
+#include "../camio_util.h"
 
 #include "camio_ostream_raw.h"
 
@@ -155,6 +156,72 @@ uint8_t* camio_ostream_raw_end_write(camio_ostream_t* this, size_t len){
 }
 
 
+//Carve up to count buffers out of the output buffer, growing it if it's not big enough
+int64_t camio_ostream_raw_start_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_raw_t* priv = this->priv;
+    count = MIN(count, CAMIO_OSTREAM_RAW_BATCH_MAX);
+
+    size_t total = 0;
+    size_t i = 0;
+    for(; i < count; i++){
+        total += slots[i].len;
+    }
+
+    if(total > priv->buffer_size){
+        priv->buffer = realloc(priv->buffer, total);
+        if(!priv->buffer){
+            eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not grow message buffer\n");
+        }
+        priv->buffer_size = total;
+    }
+
+    uint8_t* buff = priv->buffer;
+    for(i = 0; i < count; i++){
+        slots[i].buff = buff;
+        buff += slots[i].len;
+    }
+
+    return count;
+}
+
+
+//Send all of the slots with as few sendmmsg() calls as the kernel will allow
+int64_t camio_ostream_raw_end_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_raw_t* priv = this->priv;
+    count = MIN(count, CAMIO_OSTREAM_RAW_BATCH_MAX);
+
+    size_t i = 0;
+    for(; i < count; i++){
+        priv->batch_iovs[i].iov_base            = slots[i].buff;
+        priv->batch_iovs[i].iov_len             = slots[i].len;
+        priv->batch_msgs[i].msg_hdr.msg_iov     = &priv->batch_iovs[i];
+        priv->batch_msgs[i].msg_hdr.msg_iovlen  = 1;
+        priv->batch_msgs[i].msg_hdr.msg_name    = NULL;
+        priv->batch_msgs[i].msg_hdr.msg_namelen = 0;
+        priv->batch_msgs[i].msg_hdr.msg_control = NULL;
+        priv->batch_msgs[i].msg_hdr.msg_controllen = 0;
+        priv->batch_msgs[i].msg_hdr.msg_flags   = 0;
+    }
+
+    set_fd_blocking(this->fd,1);
+    size_t sent = 0;
+    while(sent < count){
+        int result = sendmmsg(this->fd, priv->batch_msgs + sent, count - sent, 0);
+        if(result < 1){
+            eprintf_exit(CAMIO_ERR_SEND, "Could not send on raw socket. Error = %s\n", strerror(errno));
+        }
+        sent += result;
+    }
+
+    return count;
+}
+
+
+//Every write is sent straight away, so there's nothing to flush
+void camio_ostream_raw_flush(camio_ostream_t* this){
+}
+
+
 void camio_ostream_raw_delete(camio_ostream_t* ostream){
     ostream->close(ostream);
     camio_ostream_raw_t* priv = ostream->priv;
@@ -208,6 +275,9 @@ camio_ostream_t* camio_ostream_raw_construct(camio_ostream_raw_t* priv, const ca
     priv->ostream.delete            = camio_ostream_raw_delete;
     priv->ostream.can_assign_write  = camio_ostream_raw_can_assign_write;
     priv->ostream.assign_write      = camio_ostream_raw_assign_write;
+    priv->ostream.start_write_batch = camio_ostream_raw_start_write_batch;
+    priv->ostream.end_write_batch   = camio_ostream_raw_end_write_batch;
+    priv->ostream.flush             = camio_ostream_raw_flush;
     priv->ostream.fd                = -1;
 
     //Call open, because its the obvious thing to do now...
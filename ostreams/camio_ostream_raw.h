@@ -8,12 +8,15 @@
 #ifndef CAMIO_OSTREAM_RAW_H_
 #define CAMIO_OSTREAM_RAW_H_
 
+#include <sys/socket.h>
+
 #include "camio_ostream.h"
 
 /********************************************************************
  *                  PRIVATE DEFS
  ********************************************************************/
 
+#define CAMIO_OSTREAM_RAW_BATCH_MAX 64 //Most messages sent by a single batch call
 
 typedef struct {
     //No params at this stage
@@ -26,6 +29,8 @@ typedef struct {
     size_t buffer_size;                     //Size of output buffer
     uint8_t* assigned_buffer;               //Assigned write buffer
     size_t assigned_buffer_sz;              //Assigned write buffer size
+    struct mmsghdr batch_msgs[CAMIO_OSTREAM_RAW_BATCH_MAX]; //Message headers for batched sends
+    struct iovec batch_iovs[CAMIO_OSTREAM_RAW_BATCH_MAX];
     camio_ostream_raw_params_t* params;      //Parameters from the outside world
 
 } camio_ostream_raw_t;
@@ -18,18 +18,11 @@
 #include "camio_ostream_ring.h"
 
 
-//TODO XXX: These should be passed as options
-#define CAMIO_OSTREAM_RING_SIZE (4 * 1024 * 1024) //4MB
-#define CAMIO_OSTREAM_RING_SLOT_SIZE (4 * 1024)  //4K
-
 int camio_ostream_ring_open(camio_ostream_t* this, const camio_descr_t* descr ){
     camio_ostream_ring_t* priv = this->priv;
-    int ring_fd = -1;
-    volatile uint8_t* ring = NULL;
 
-    if(descr->opt_head){
-        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option(s) supplied, but none expected\n");
-    }
+    const char* valid_opts[] = { "size", "slot", "lossless", CAMIO_MMAP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
 
     if(!descr->query){
         eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
@@ -41,44 +34,27 @@ int camio_ostream_ring_open(camio_ostream_t* this, const camio_descr_t* descr ){
     memcpy(priv->filename,descr->query, filename_len);
     priv->filename[filename_len] = '\0'; //Make sure it's null terminated
 
+    camio_ring_open(&priv->ring, descr, CAMIO_RING_TYPE_SLOT, 1);
 
-    ring_fd = open(descr->query, O_RDWR);
-    //If that fails, try opening and creating the file
-    if(unlikely(ring_fd < 0)){
-        ring_fd = open(descr->query, O_RDWR | O_CREAT | O_TRUNC, (mode_t)(0666));
-        if(unlikely(ring_fd < 0)){
-            eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\". Error=%s\n", descr->query, strerror(errno));
-        }
-
-        //Resize the file
-        if(lseek(ring_fd, CAMIO_OSTREAM_RING_SIZE -1, SEEK_SET) < 0){
-            eprintf_exit(CAMIO_ERR_FILE_LSEEK, "Could not resize file for shared region \"%s\". Error=%s\n", descr->query, strerror(errno));
-        }
-
-        if(write(ring_fd, "", 1) < 0){
-            eprintf_exit(CAMIO_ERR_FILE_WRITE, "Could not resize file for shared region \"%s\". Error=%s\n", descr->query, strerror(errno));
-        }
+    //Pick up where any previous writer left off, so that readers see the sync counts keep going up
+    priv->sync_count = priv->ring.hdr->write_seq;
+    priv->index      = priv->sync_count % priv->ring.slot_count;
 
-        ring = mmap( NULL, CAMIO_OSTREAM_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
-        if(unlikely(ring == MAP_FAILED)){
-            eprintf_exit(CAMIO_ERR_MMAP, "Could not memory map ring file \"%s\". Error=%s\n", descr->query, strerror(errno));
+    priv->lossless = camio_descr_get_opt_bool(descr, "lossless", 0);
+    if(priv->lossless){
+        //Anything a previous lossless writer left unconsumed is still owed to the readers
+        if(!priv->ring.hdr->read_tail){
+            priv->ring.hdr->read_tail = priv->sync_count + 1;
         }
-
-        //Initialize the ring with 0
-        memset((uint8_t*)ring, 0, CAMIO_OSTREAM_RING_SIZE);
+        priv->slowest = priv->ring.hdr->read_tail;
+        priv->ring.hdr->flags |= CAMIO_RING_FLAG_LOSSLESS;
     }
     else{
-        ring = mmap( NULL, CAMIO_OSTREAM_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
-        if(unlikely(ring == MAP_FAILED)){
-            eprintf_exit(CAMIO_ERR_MMAP, "Could not memory map ring file \"%s\". Error=%s\n", descr->query, strerror(errno));
-        }
+        priv->ring.hdr->flags &= ~CAMIO_RING_FLAG_LOSSLESS;
     }
 
-
-    priv->ring_size = CAMIO_OSTREAM_RING_SIZE;
-    this->fd = ring_fd;
-    priv->ring = ring;
-    priv->curr = ring;
+    this->fd = priv->ring.fd;
+    priv->curr = camio_ring_slot(&priv->ring, priv->index);
     priv->is_closed = 0;
 
     return CAMIO_ERR_NONE;
@@ -86,20 +62,53 @@ int camio_ostream_ring_open(camio_ostream_t* this, const camio_descr_t* descr ){
 
 void camio_ostream_ring_close(camio_ostream_t* this){
     camio_ostream_ring_t* priv = this->priv;
-    munmap((void*)priv->ring, priv->ring_size);
-    close(this->fd);
+    camio_ring_close(&priv->ring);
     unlink(priv->filename); //Delete the file so reader can't get confused
     priv->is_closed = 1;
 }
 
 
+//How many slots can be written without overwriting something a reader hasn't consumed yet
+static inline uint64_t slots_free(camio_ostream_ring_t* priv){
+    if(likely(!priv->lossless)){
+        return priv->ring.slot_count;
+    }
+
+    //The next write overwrites sync count (next - slot_count), which the slowest reader must be past
+    const uint64_t next = priv->sync_count + 1;
+    if(likely(next < priv->slowest + priv->ring.slot_count)){
+        return priv->slowest + priv->ring.slot_count - next;
+    }
+
+    //Cached position says we're full, go and see where the readers really are. With no readers
+    //registered, hang on to what we've got until one turns up
+    const uint64_t slowest = camio_ring_slowest_reader(&priv->ring);
+    if(slowest == UINT64_MAX){
+        priv->slowest = MAX(priv->slowest, priv->ring.hdr->read_tail); //The last reader may have left us a note
+    }
+    else if(slowest > priv->slowest){
+        priv->slowest = slowest;
+        uint64_t tail = priv->ring.hdr->read_tail;
+        while(tail < slowest && !__sync_bool_compare_and_swap(&priv->ring.hdr->read_tail, tail, slowest)){
+            tail = priv->ring.hdr->read_tail;
+        }
+    }
+
+    return next < priv->slowest + priv->ring.slot_count ? priv->slowest + priv->ring.slot_count - next : 0;
+}
+
 
 //Returns a pointer to a space of size len, ready for data
 //Returns NULL if this is impossible
 uint8_t* camio_ostream_ring_start_write(camio_ostream_t* this, size_t len ){
     camio_ostream_ring_t* priv = this->priv;
-    if(len > CAMIO_OSTREAM_RING_SLOT_SIZE - 8){
-        wprintf(0, "Length supplied (%lu) is greater than slot size (%lu, corruption is likely if you proceed.\n", len, CAMIO_OSTREAM_RING_SIZE - 2 * sizeof(uint64_t) );
+
+    //Lossless mode, the readers haven't freed the slot yet
+    if(unlikely(!slots_free(priv))){
+        return NULL;
+    }
+    if(len > priv->ring.slot_size - CAMIO_RING_SLOT_TRAILER){
+        wprintf(0, "Length supplied (%lu) is greater than slot size (%lu), corruption is likely if you proceed.\n", len, priv->ring.slot_size - CAMIO_RING_SLOT_TRAILER );
         return NULL;
 
     }
@@ -109,9 +118,8 @@ uint8_t* camio_ostream_ring_start_write(camio_ostream_t* this, size_t len ){
 
 //Returns non-zero if a call to start_write will be non-blocking
 int camio_ostream_ring_ready(camio_ostream_t* this){
-    //Not implemented
-    eprintf_exit(CAMIO_ERR_NOT_IMPL, "\n");
-    return 0;
+    camio_ostream_ring_t* priv = this->priv;
+    return slots_free(priv) > 0;
 }
 
 
@@ -120,13 +128,17 @@ int camio_ostream_ring_ready(camio_ostream_t* this){
 uint8_t* camio_ostream_ring_end_write(camio_ostream_t* this, size_t len){
     camio_ostream_ring_t* priv = this->priv;
 
-    if(len > CAMIO_OSTREAM_RING_SLOT_SIZE - 2 * sizeof(uint64_t)){
-        eprintf_exit(0, "Length supplied (%lu) is greater than slot size (%lu, corruption is likely.\n", len, CAMIO_OSTREAM_RING_SIZE - 2 * sizeof(uint64_t) );
+    if(len > priv->ring.slot_size - CAMIO_RING_SLOT_TRAILER){
+        eprintf_exit(0, "Length supplied (%lu) is greater than slot size (%lu), corruption is likely.\n", len, priv->ring.slot_size - CAMIO_RING_SLOT_TRAILER );
         return NULL;
     }
 
     //Memory copy is done implicitly here
     if(priv->assigned_buffer){
+        //start_write() wasn't called, so nobody checked that the slot is free
+        while(unlikely(!slots_free(priv))){
+            __asm__ __volatile__("pause"); //Tell the CPU we're spinning
+        }
         memcpy((uint8_t*)priv->curr,priv->assigned_buffer,len);
         priv->assigned_buffer    = NULL;
         priv->assigned_buffer_sz = 0;
@@ -134,16 +146,70 @@ uint8_t* camio_ostream_ring_end_write(camio_ostream_t* this, size_t len){
 
 
     priv->sync_count++;
-    *(volatile uint64_t*)(priv->curr + CAMIO_OSTREAM_RING_SLOT_SIZE-2*sizeof(uint64_t)) = len;
-    *(volatile uint64_t*)(priv->curr + CAMIO_OSTREAM_RING_SLOT_SIZE-1*sizeof(uint64_t)) = priv->sync_count; //Write is now committed
+    *camio_ring_slot_len(&priv->ring, priv->curr)  = len;
+    *camio_ring_slot_sync(&priv->ring, priv->curr) = priv->sync_count; //Write is now committed
+    priv->ring.hdr->write_seq = priv->sync_count; //Where new readers will join
+    camio_ring_wake(&priv->ring);
 
-    priv->index = (priv->index + 1) % ( CAMIO_OSTREAM_RING_SIZE /  CAMIO_OSTREAM_RING_SLOT_SIZE);
-    priv->curr  = priv->ring + (priv->index * CAMIO_OSTREAM_RING_SLOT_SIZE);
+    priv->index = (priv->index + 1) % priv->ring.slot_count;
+    priv->curr  = camio_ring_slot(&priv->ring, priv->index);
 
     return NULL;
 }
 
 
+//Returns up to count consecutive slots, starting at the current one. Slots are handed out
+//round the whole ring so count is capped at the number of slots in the ring, or in lossless
+//mode, the number the readers have freed
+int64_t camio_ostream_ring_start_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_ring_t* priv = this->priv;
+    const size_t slot_count = priv->ring.slot_count;
+
+    count = MIN(count, slots_free(priv));
+    size_t i = 0;
+    for(; i < count; i++){
+        if(unlikely(slots[i].len > priv->ring.slot_size - CAMIO_RING_SLOT_TRAILER)){
+            wprintf(0, "Length supplied (%lu) is greater than slot size (%lu), corruption is likely if you proceed.\n", slots[i].len, priv->ring.slot_size - CAMIO_RING_SLOT_TRAILER );
+            break;
+        }
+
+        slots[i].buff = (uint8_t*)camio_ring_slot(&priv->ring, (priv->index + i) % slot_count);
+    }
+
+    return i;
+}
+
+
+//Commit the slots in order, each one becomes visible to the reader as its sync count is written
+int64_t camio_ostream_ring_end_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_ring_t* priv = this->priv;
+    const size_t slot_count = priv->ring.slot_count;
+
+    size_t i = 0;
+    for(; i < count; i++){
+        if(unlikely(slots[i].len > priv->ring.slot_size - CAMIO_RING_SLOT_TRAILER)){
+            eprintf_exit(0, "Length supplied (%lu) is greater than slot size (%lu), corruption is likely.\n", slots[i].len, priv->ring.slot_size - CAMIO_RING_SLOT_TRAILER );
+        }
+
+        priv->sync_count++;
+        *camio_ring_slot_len(&priv->ring, priv->curr)  = slots[i].len;
+        *camio_ring_slot_sync(&priv->ring, priv->curr) = priv->sync_count; //Write is now committed
+
+        priv->index = (priv->index + 1) % slot_count;
+        priv->curr  = camio_ring_slot(&priv->ring, priv->index);
+    }
+    priv->ring.hdr->write_seq = priv->sync_count; //Where new readers will join
+    camio_ring_wake(&priv->ring);
+
+    return count;
+}
+
+
+//Records are visible to readers as soon as they are committed, so there's nothing to flush
+void camio_ostream_ring_flush(camio_ostream_t* this){
+}
+
+
 void camio_ostream_ring_delete(camio_ostream_t* ostream){
     ostream->close(ostream);
     camio_ostream_ring_t* priv = ostream->priv;
@@ -180,11 +246,14 @@ camio_ostream_t* camio_ostream_ring_construct(camio_ostream_ring_t* priv, const
     }
     //Initialize the local variables
     priv->is_closed             = 1;
-    priv->ring                  = NULL;
-    priv->ring_size             = 0;
+    priv->ring.fd               = -1;
+    priv->ring.map              = NULL;
+    priv->filename              = NULL;
     priv->curr                  = NULL;
     priv->sync_count            = 0;
     priv->index                 = 0;
+    priv->lossless              = 0;
+    priv->slowest               = 0;
     priv->assigned_buffer       = NULL;
     priv->assigned_buffer_sz    = 0;
     priv->params                = params;
@@ -200,6 +269,9 @@ camio_ostream_t* camio_ostream_ring_construct(camio_ostream_ring_t* priv, const
     priv->ostream.delete            = camio_ostream_ring_delete;
     priv->ostream.can_assign_write  = camio_ostream_ring_can_assign_write;
     priv->ostream.assign_write      = camio_ostream_ring_assign_write;
+    priv->ostream.start_write_batch = camio_ostream_ring_start_write_batch;
+    priv->ostream.end_write_batch   = camio_ostream_ring_end_write_batch;
+    priv->ostream.flush             = camio_ostream_ring_flush;
     priv->ostream.fd                = -1;
 
     //Call open, because its the obvious thing to do now...
@@ -9,6 +9,7 @@
 #define CAMIO_OSTREAM_RING_H_
 
 #include "camio_ostream.h"
+#include "../camio_ring.h"
 
 /********************************************************************
  *                  PRIVATE DEFS
@@ -23,13 +24,14 @@ typedef struct {
     camio_ostream_t ostream;
     char* filename;                         //Keep the file name so we can delete it
     int is_closed;              			//Has close be called?
-    volatile uint8_t* ring;					//Pointer to the head of the ring
-    size_t ring_size;                       //Size of the ring buffer
+    camio_ring_t ring;                      //The shared ring
     volatile uint8_t* curr;                 //Current slot in the ring
     uint8_t* assigned_buffer;               //Assigned write buffer
     size_t assigned_buffer_sz;              //Assigned write buffer size
     uint64_t sync_count;                    //Synchronization counter
     uint64_t index;                         //Current slot in the ring
+    int lossless;                           //Wait for readers instead of overwriting slots they haven't read
+    uint64_t slowest;                       //Last known position of the slowest reader (lossless mode)
     camio_ostream_ring_params_t* params;     //Parameters from the outside world
 
 } camio_ostream_ring_t;
@@ -17,47 +17,106 @@
 #include <net/ethernet.h>
 #include <string.h>
 #include <arpa/inet.h>
+#include <netinet/udp.h>
 
 #include "../camio_errors.h"
 #include "../camio_util.h"
+#include "../parsing/addr_parser.h"
 
 #include "camio_ostream_udp.h"
 
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#define CAMIO_OSTREAM_UDP_QUEUE_INIT_SIZE (64 * 1024ULL) //64kB initial queue buffer, it grows to fit
+#define CAMIO_OSTREAM_UDP_CTRL_SIZE CMSG_SPACE(sizeof(uint16_t))
+
+static void queue_init(camio_ostream_udp_t* priv, size_t max);
+
+
+//Which interface multicast datagrams leave from, how far they go, and whether this host sees them too
+static void set_multicast(int sock_fd, const char* iface, int ttl, int loop){
+    if(iface){
+        struct ifreq if_idx;
+        memset(&if_idx, 0, sizeof(struct ifreq));
+        strncpy(if_idx.ifr_name, iface, IFNAMSIZ-1);
+        if (ioctl(sock_fd, SIOCGIFINDEX, &if_idx) < 0){
+            eprintf_exit(CAMIO_ERR_IOCTL,"Could not get interface \"%s\". Error = %s\n",iface,strerror(errno));
+        }
+
+        struct ip_mreqn mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.imr_ifindex = if_idx.ifr_ifindex;
+        if(setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof(mreq)) < 0){
+            eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not send from interface \"%s\". Error = %s\n",iface,strerror(errno));
+        }
+    }
+
+    if(setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+       setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0){
+        eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not set socket option. Error = %s\n",strerror(errno));
+    }
+}
+
+//Most bytes a datagram to addr can carry without being fragmented, from the MTU of the route to it.
+//Finding the route needs a connected socket, and connecting the stream's own would change how it
+//handles errors, so use a throwaway one
+static size_t path_payload(const struct sockaddr_in* addr, int multicast, const char* iface){
+    size_t payload = CAMIO_OSTREAM_UDP_GSO_SEG_DEFAULT;
+    const int sock_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock_fd < 0){
+        return payload;
+    }
+    if(multicast){
+        set_multicast(sock_fd, iface, 1, 0);
+    }
+
+    int mtu = 0;
+    socklen_t mtu_len = sizeof(mtu);
+    if(connect(sock_fd, (const struct sockaddr*)addr, sizeof(*addr)) == 0 &&
+       getsockopt(sock_fd, IPPROTO_IP, IP_MTU, &mtu, &mtu_len) == 0 && mtu > 20 + 8){
+        payload = mtu - 20 - 8;
+    }
+    else{
+        wprintf(CAMIO_ERR_SOCK_OPT, "Could not find the path MTU, only messages of %lu bytes or less will use GSO. Error = %s\n", payload, strerror(errno));
+    }
+
+    close(sock_fd);
+    return payload;
+}
+
 
 int camio_ostream_udp_open(camio_ostream_t* this, const camio_descr_t* descr ){
     camio_ostream_udp_t* priv = this->priv;
-    char ip_addr[17]; //IP addr is worst case, 16 bytes long (255.255.255.255)
-    char udp_port[6]; //UDP port is wost case, 5 bytes long (65536)
     int udp_sock_fd;
 
-    if(descr->opt_head){
-         eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option(s) supplied, but none expected\n");
-     }
+    const char* valid_opts[] = { "batch", "batch_bytes", "gso", "iface", "ttl", "loop", NULL };
+    camio_descr_check_opts(descr, valid_opts);
+    priv->batch       = camio_descr_get_opt_uint(descr, "batch", 0);
+    priv->batch_bytes = camio_descr_get_opt_uint(descr, "batch_bytes", 0);
+    priv->gso         = camio_descr_get_opt_bool(descr, "gso", 0);
+    if(priv->batch > CAMIO_OSTREAM_UDP_BATCH_LIMIT){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Batch size %lu is more than the most (%u) that can be sent at once\n", priv->batch, CAMIO_OSTREAM_UDP_BATCH_LIMIT);
+    }
 
     if(!descr->query){
         eprintf_exit(CAMIO_ERR_SOCKET, "No address supplied\n");
     }
 
-    const size_t query_len = strlen(descr->query);
-    if(query_len > 22){
-        eprintf_exit(CAMIO_ERR_SOCKET, "IP Address supplied is >22 chars \"%s\"\n", descr->query);
+    const addr_result_t addr = parse_ip_port(descr->query);
+    if(!addr.valid){
+        eprintf_exit(CAMIO_ERR_SOCKET, "Expected an address like ip:port but \"%s\" found\n", descr->query);
     }
 
-    //Find the IP:port
-    size_t i = 0;
-    for(; i < query_len; i++ ){
-        if(descr->query[i] == ':'){
-            memcpy(ip_addr,descr->query,i);
-            ip_addr[i] = '\0';
-            memcpy(udp_port,&descr->query[i+1],query_len - i -1);
-            udp_port[query_len - i -1] = '\0';
-            break;
-        }
+    const int multicast = IN_MULTICAST(ntohl(addr.addr.sin_addr.s_addr));
+    const char* iface = camio_descr_get_opt(descr, "iface");
+    const uint64_t ttl = camio_descr_get_opt_uint(descr, "ttl", 1);
+    if(ttl > 255){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Option \"ttl\" must be 255 or less\n");
     }
-
-
-    if(query_len > 22){
-        eprintf_exit(CAMIO_ERR_SOCKET, "IP Address supplied does not have a \":\" for the port number \"%s\"\n", descr->query);
+    if(!multicast && (iface || camio_descr_get_opt(descr, "ttl") || camio_descr_get_opt(descr, "loop"))){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Options \"iface\", \"ttl\" and \"loop\" only apply to multicast groups, not \"%s\"\n", descr->query);
     }
 
 
@@ -79,30 +138,211 @@ int camio_ostream_udp_open(camio_ostream_t* this, const camio_descr_t* descr ){
         eprintf_exit(CAMIO_ERR_SOCK_OPT,"Could not set socket option. Error = %s\n",strerror(errno));
     }
 
-    struct sockaddr_in addr;
-    memset(&addr,0,sizeof(addr));
-    addr.sin_family      = AF_INET;
-    addr.sin_addr.s_addr = inet_addr(ip_addr);
-    addr.sin_port        = htons(strtol(udp_port,NULL,10));
+    //Kernels that know about UDP GSO let us ask what the socket's default segment size is
+    if(priv->gso){
+        int seg_size = 0;
+        socklen_t seg_size_len = sizeof(seg_size);
+        if(getsockopt(udp_sock_fd, SOL_UDP, UDP_SEGMENT, &seg_size, &seg_size_len) < 0){
+            eprintf_exit(CAMIO_ERR_SOCK_OPT,"UDP GSO is not supported. Error = %s\n",strerror(errno));
+        }
+    }
+
+    if(multicast){
+        set_multicast(udp_sock_fd, iface, ttl, camio_descr_get_opt_bool(descr, "loop", 1));
+    }
+    if(priv->gso){
+        priv->gso_seg_max = path_payload(&addr.addr, multicast, iface);
+    }
+
+    if(priv->batch){
+        queue_init(priv, priv->batch);
+    }
 
-    priv->addr = addr;
+    priv->addr = addr.addr;
     this->fd = udp_sock_fd;
     priv->is_closed = 0;
     return CAMIO_ERR_NONE;
 }
 
+static void queue_send(camio_ostream_udp_t* priv);
+
 void camio_ostream_udp_close(camio_ostream_t* this){
     camio_ostream_udp_t* priv = this->priv;
+    if(priv->is_closed){
+        return;
+    }
+    queue_send(priv);
     close(this->fd);
+    free(priv->queue_buffer);
+    free(priv->queue_offs);
+    free(priv->batch_msgs);
+    free(priv->batch_iovs);
+    free(priv->batch_ctrl);
+    priv->queue_buffer = NULL;
     priv->is_closed = 1;
 }
 
 
+//Only streams that queue, or are written in batches, pay for the queue
+static void queue_init(camio_ostream_udp_t* priv, size_t max){
+    priv->queue_buffer  = malloc(CAMIO_OSTREAM_UDP_QUEUE_INIT_SIZE);
+    priv->queue_offs    = calloc(max, sizeof(size_t));
+    priv->batch_msgs    = calloc(max, sizeof(struct mmsghdr));
+    priv->batch_iovs    = calloc(max, sizeof(struct iovec));
+    priv->batch_ctrl    = calloc(max, CAMIO_OSTREAM_UDP_CTRL_SIZE);
+    if(!priv->queue_buffer || !priv->queue_offs || !priv->batch_msgs || !priv->batch_iovs || !priv->batch_ctrl){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Failed to allocate message queue\n");
+    }
+    priv->queue_buffer_size = CAMIO_OSTREAM_UDP_QUEUE_INIT_SIZE;
+    priv->queue_max         = max;
+}
+
+
+//Message headers for the queue. With GSO, a run of messages the same size (and one shorter one to
+//finish it) goes in one header, with the size to split it up at. Returns the number of headers
+static size_t queue_build(camio_ostream_udp_t* priv){
+    size_t msgs = 0;
+    size_t i = 0;
+    while(i < priv->queue_count){
+        const size_t seg_size = priv->batch_iovs[i].iov_len;
+        size_t segs = 1;
+        if(priv->gso && seg_size && seg_size <= priv->gso_seg_max){
+            size_t bytes = seg_size;
+            while(i + segs < priv->queue_count && segs < CAMIO_OSTREAM_UDP_GSO_SEGS){
+                const size_t len = priv->batch_iovs[i + segs].iov_len;
+                if(len > seg_size || !len || bytes + len > CAMIO_OSTREAM_UDP_GSO_BYTES){
+                    break;
+                }
+                bytes += len;
+                segs++;
+                if(len < seg_size){
+                    break;
+                }
+            }
+        }
+
+        struct msghdr* hdr = &priv->batch_msgs[msgs].msg_hdr;
+        hdr->msg_name       = (struct sockaddr*)&priv->addr;
+        hdr->msg_namelen    = sizeof(priv->addr);
+        hdr->msg_iov        = &priv->batch_iovs[i];
+        hdr->msg_iovlen     = segs;
+        hdr->msg_control    = NULL;
+        hdr->msg_controllen = 0;
+        hdr->msg_flags      = 0;
+        if(segs > 1){
+            hdr->msg_control    = priv->batch_ctrl + msgs * CAMIO_OSTREAM_UDP_CTRL_SIZE;
+            hdr->msg_controllen = CAMIO_OSTREAM_UDP_CTRL_SIZE;
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type  = UDP_SEGMENT;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+            *(uint16_t*)CMSG_DATA(cmsg) = seg_size;
+        }
+
+        msgs++;
+        i += segs;
+    }
+
+    return msgs;
+}
+
+
+//The kernel wouldn't take a GSO send (EINVAL or EMSGSIZE, depending on where it noticed), most
+//likely because the path MTU has shrunk. Send the messages in it one at a time, and don't try to
+//send messages this big together again
+static void gso_refused(camio_ostream_udp_t* priv, const struct msghdr* hdr){
+    const size_t seg_size = hdr->msg_iov[0].iov_len;
+    wprintf(CAMIO_ERR_SEND, "UDP GSO send of %lu byte messages was refused, they will be sent separately\n", seg_size);
+    priv->gso_seg_max = MIN(priv->gso_seg_max, seg_size - 1);
+
+    size_t i = 0;
+    for(; i < hdr->msg_iovlen; i++){
+        if(sendto(priv->ostream.fd, hdr->msg_iov[i].iov_base, hdr->msg_iov[i].iov_len, 0, hdr->msg_name, hdr->msg_namelen) < 0){
+            eprintf_exit(CAMIO_ERR_SEND, "Could not send on udp socket. Error = %s\n", strerror(errno));
+        }
+    }
+}
+
+
+//Send everything in the queue with as few sendmmsg() calls as the kernel will allow
+static void queue_send(camio_ostream_udp_t* priv){
+    if(!priv->queue_count){
+        return;
+    }
+
+    size_t i = 0;
+    for(; i < priv->queue_count; i++){
+        priv->batch_iovs[i].iov_base = priv->queue_buffer + priv->queue_offs[i];
+    }
+
+    const size_t msgs = queue_build(priv);
+    size_t sent = 0;
+    while(sent < msgs){
+        int result = sendmmsg(priv->ostream.fd, priv->batch_msgs + sent, msgs - sent, 0);
+        if(result < 1 && (errno == EINVAL || errno == EMSGSIZE) && priv->batch_msgs[sent].msg_hdr.msg_controllen){
+            gso_refused(priv, &priv->batch_msgs[sent].msg_hdr);
+            result = 1;
+        }
+        if(result < 1){
+            eprintf_exit(CAMIO_ERR_SEND, "Could not send on udp socket. Error = %s\n", strerror(errno));
+        }
+        sent += result;
+    }
+
+    priv->queue_count = 0;
+    priv->queue_bytes = 0;
+    priv->queue_used  = 0;
+}
+
+
+//Space for count more messages of total bytes, making room by sending the queue if need be
+static uint8_t* queue_reserve(camio_ostream_udp_t* priv, size_t count, size_t total){
+    if(priv->queue_count + count > priv->queue_max || priv->queue_used + total > priv->queue_buffer_size){
+        queue_send(priv);
+    }
+
+    if(unlikely(total > priv->queue_buffer_size)){
+        priv->queue_buffer = realloc(priv->queue_buffer, total);
+        if(!priv->queue_buffer){
+            eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not grow message queue\n");
+        }
+        priv->queue_buffer_size = total;
+    }
+
+    priv->queue_reserved = total;
+    return priv->queue_buffer + priv->queue_used;
+}
+
+
+//Add a message from the reserved space to the queue
+static inline void queue_push(camio_ostream_udp_t* priv, uint8_t* buff, size_t len){
+    priv->queue_offs[priv->queue_count]         = buff - priv->queue_buffer;
+    priv->batch_iovs[priv->queue_count].iov_len = len;
+    priv->queue_count++;
+    priv->queue_bytes += len;
+}
+
+
+//Done with the reserved space, send the queue if it's time
+static inline void queue_commit(camio_ostream_udp_t* priv){
+    priv->queue_used    += priv->queue_reserved;
+    priv->queue_reserved = 0;
+
+    if(!priv->batch || priv->queue_count >= priv->batch || (priv->batch_bytes && priv->queue_bytes >= priv->batch_bytes)){
+        queue_send(priv);
+    }
+}
+
+
 
 //Returns a pointer to a space of size len, ready for data
 uint8_t* camio_ostream_udp_start_write(camio_ostream_t* this, size_t len ){
     camio_ostream_udp_t* priv = this->priv;
 
+    if(priv->batch){
+        return queue_reserve(priv, 1, len);
+    }
+
     //Grow the buffer if it's not big enough
     if(len > priv->buffer_size){
         priv->buffer = realloc(priv->buffer, len);
@@ -129,6 +369,20 @@ uint8_t* camio_ostream_udp_end_write(camio_ostream_t* this, size_t len){
     camio_ostream_udp_t* priv = this->priv;
     int result = 0;
 
+    //Queued messages have to be copied in, the assigned buffer is only ours until we return
+    if(priv->batch){
+        uint8_t* buff = priv->queue_buffer + priv->queue_used;
+        if(priv->assigned_buffer){
+            buff = queue_reserve(priv, 1, len);
+            memcpy(buff, priv->assigned_buffer, len);
+            priv->assigned_buffer    = NULL;
+            priv->assigned_buffer_sz = 0;
+        }
+        queue_push(priv, buff, len);
+        queue_commit(priv);
+        return NULL;
+    }
+
     if(priv->assigned_buffer){
         result = sendto(this->fd,priv->assigned_buffer,len,0,(struct sockaddr*)&priv->addr, sizeof(priv->addr));
         if(result < 1){
@@ -148,6 +402,52 @@ uint8_t* camio_ostream_udp_end_write(camio_ostream_t* this, size_t len){
 }
 
 
+//Carve up to count buffers out of the queue buffer, growing it if it's not big enough
+int64_t camio_ostream_udp_start_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_udp_t* priv = this->priv;
+    if(unlikely(!priv->queue_buffer)){
+        queue_init(priv, CAMIO_OSTREAM_UDP_BATCH_MAX);
+    }
+    count = MIN(count, priv->queue_max);
+
+    size_t total = 0;
+    size_t i = 0;
+    for(; i < count; i++){
+        total += slots[i].len;
+    }
+
+    uint8_t* buff = queue_reserve(priv, count, total);
+    for(i = 0; i < count; i++){
+        slots[i].buff = buff;
+        buff += slots[i].len;
+    }
+
+    return count;
+}
+
+
+//Queue all of the slots, they're sent straight away unless the stream is queueing
+int64_t camio_ostream_udp_end_write_batch(camio_ostream_t* this, camio_iovec_t* slots, size_t count){
+    camio_ostream_udp_t* priv = this->priv;
+    count = MIN(count, priv->queue_max);
+
+    size_t i = 0;
+    for(; i < count; i++){
+        queue_push(priv, slots[i].buff, slots[i].len);
+    }
+    queue_commit(priv);
+
+    return count;
+}
+
+
+//Send anything that's waiting in the queue
+void camio_ostream_udp_flush(camio_ostream_t* this){
+    camio_ostream_udp_t* priv = this->priv;
+    queue_send(priv);
+}
+
+
 void camio_ostream_udp_delete(camio_ostream_t* ostream){
     ostream->close(ostream);
     camio_ostream_udp_t* priv = ostream->priv;
@@ -188,6 +488,21 @@ camio_ostream_t* camio_ostream_udp_construct(camio_ostream_udp_t* priv, const ca
     priv->buffer                = NULL;
     priv->assigned_buffer       = NULL;
     priv->assigned_buffer_sz    = 0;
+    priv->batch                 = 0;
+    priv->batch_bytes           = 0;
+    priv->gso                   = 0;
+    priv->gso_seg_max           = 0;
+    priv->queue_max             = 0;
+    priv->queue_count           = 0;
+    priv->queue_bytes           = 0;
+    priv->queue_used            = 0;
+    priv->queue_reserved        = 0;
+    priv->queue_buffer          = NULL;
+    priv->queue_buffer_size     = 0;
+    priv->queue_offs            = NULL;
+    priv->batch_msgs            = NULL;
+    priv->batch_iovs            = NULL;
+    priv->batch_ctrl            = NULL;
     priv->params                = params;
 
 
@@ -201,6 +516,9 @@ camio_ostream_t* camio_ostream_udp_construct(camio_ostream_udp_t* priv, const ca
     priv->ostream.delete            = camio_ostream_udp_delete;
     priv->ostream.can_assign_write  = camio_ostream_udp_can_assign_write;
     priv->ostream.assign_write      = camio_ostream_udp_assign_write;
+    priv->ostream.start_write_batch = camio_ostream_udp_start_write_batch;
+    priv->ostream.end_write_batch   = camio_ostream_udp_end_write_batch;
+    priv->ostream.flush             = camio_ostream_udp_flush;
     priv->ostream.fd                = -1;
 
     //Call open, because its the obvious thing to do now...
@@ -3,12 +3,27 @@
  *
  *  Created on: Nov 15, 2012
  *      Author: root
+ *
+ * Options:
+ * batch=N          Queue up to N messages and send them together with sendmmsg, when the queue is
+ *                  full, when batch_bytes is reached, or on flush(). By default each write is sent
+ *                  straight away, and only batched writes use sendmmsg
+ * batch_bytes=N    Also send the queue once it holds this many bytes
+ * gso=1            Send runs of messages of the same size (the last of a run may be shorter) as
+ *                  a single UDP GSO (UDP_SEGMENT) send, which the kernel or NIC splits up again.
+ *                  Only messages that fit in the path MTU are sent this way, bigger ones are sent
+ *                  on their own. Needs Linux 4.18 or later
+ * For multicast groups:
+ * iface=name       Send from this interface, by default the kernel picks from the routing table
+ * ttl=N            Multicast TTL, defaults to 1 which keeps datagrams on the local network
+ * loop=0           Don't loop datagrams back to listeners on this host, by default they are
  */
 
 #ifndef CAMIO_OSTREAM_UDP_H_
 #define CAMIO_OSTREAM_UDP_H_
 
 #include <netinet/in.h>
+#include <sys/socket.h>
 
 #include "camio_ostream.h"
 
@@ -16,6 +31,11 @@
  *                  PRIVATE DEFS
  ********************************************************************/
 
+#define CAMIO_OSTREAM_UDP_BATCH_MAX 64 //Most messages sent by a single batch call, unless batch= says otherwise
+#define CAMIO_OSTREAM_UDP_BATCH_LIMIT 1024 //The kernel won't take more than this (UIO_MAXIOV) per call
+#define CAMIO_OSTREAM_UDP_GSO_SEGS 64   //Most messages in one GSO send (UDP_MAX_SEGMENTS on older kernels)
+#define CAMIO_OSTREAM_UDP_GSO_BYTES (0xFFFF - 20 - 8) //Most bytes in one GSO send, it has to fit in one IP packet
+#define CAMIO_OSTREAM_UDP_GSO_SEG_DEFAULT (1500 - 20 - 8) //Largest GSO message if the path MTU can't be found, for Ethernet
 
 typedef struct {
     //No params at this stage
@@ -29,6 +49,21 @@ typedef struct {
     size_t buffer_size;                     //Size of output buffer
     uint8_t* assigned_buffer;                  //Assigned write buffer
     size_t assigned_buffer_sz;              //Assigned write buffer size
+    size_t batch;                           //Messages to queue before sending, or 0 to send each write as it comes
+    size_t batch_bytes;                     //Bytes to queue before sending, or 0 for no limit
+    int gso;                                //Send runs of same sized messages as one
+    size_t gso_seg_max;                     //Largest message that can go in a GSO send, it has to fit in the path MTU
+    size_t queue_max;                       //Most messages the queue holds
+    size_t queue_count;                     //Messages in the queue
+    size_t queue_bytes;                     //Bytes of queued messages
+    size_t queue_used;                      //Space used in the queue buffer, messages may leave gaps
+    size_t queue_reserved;                  //Space handed out by start_write(_batch), after queue_used
+    uint8_t* queue_buffer;                  //Queued messages, and space handed out for new ones
+    size_t queue_buffer_size;
+    size_t* queue_offs;                     //Offset of each queued message in the queue buffer
+    struct mmsghdr* batch_msgs;             //Message headers for batched sends
+    struct iovec* batch_iovs;
+    uint8_t* batch_ctrl;                    //UDP_SEGMENT control messages, one per message header
     camio_ostream_udp_params_t* params;      //Parameters from the outside world
 
 } camio_ostream_udp_t;
@@ -0,0 +1,225 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ variable length record ring output stream
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "../camio_util.h"
+#include "../camio_errors.h"
+
+#include "camio_ostream_vring.h"
+
+
+int camio_ostream_vring_open(camio_ostream_t* this, const camio_descr_t* descr ){
+    camio_ostream_vring_t* priv = this->priv;
+
+    const char* valid_opts[] = { "size", CAMIO_MMAP_OPTS, NULL };
+    camio_descr_check_opts(descr, valid_opts);
+
+    if(!descr->query){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
+    }
+
+    //Make a local copy of the filename in case the descr pointer goes away (probable)
+    size_t filename_len = strlen(descr->query);
+    priv->filename = malloc(filename_len + 1);
+    memcpy(priv->filename,descr->query, filename_len);
+    priv->filename[filename_len] = '\0'; //Make sure it's null terminated
+
+    camio_ring_open(&priv->ring, descr, CAMIO_RING_TYPE_VAR, 1);
+
+    //Pick up where any previous writer left off, so that readers never see write_pos go backwards
+    priv->pos = priv->ring.hdr->write_pos;
+    priv->seq = priv->ring.hdr->write_seq ? priv->ring.hdr->write_seq : 1;
+
+    this->fd = priv->ring.fd;
+    priv->is_closed = 0;
+
+    return CAMIO_ERR_NONE;
+}
+
+void camio_ostream_vring_close(camio_ostream_t* this){
+    camio_ostream_vring_t* priv = this->priv;
+    camio_ring_close(&priv->ring);
+    unlink(priv->filename); //Delete the file so reader can't get confused
+    priv->is_closed = 1;
+}
+
+
+//Find space for a record of len bytes. If it won't fit before the end of the ring, it goes at the
+//start and the gap is filled with a padding record when it's committed
+static inline int reserve(camio_ostream_vring_t* priv, size_t len){
+    const uint64_t rec_size = camio_vring_rec_size(len);
+    if(unlikely(rec_size > priv->ring.ring_size / 2 || len > UINT32_MAX)){
+        wprintf(0, "Length supplied (%lu) is too big for a ring of size (%lu), records must be less than half the ring\n", len, priv->ring.ring_size );
+        return -1;
+    }
+
+    const uint64_t offset = priv->pos % priv->ring.ring_size;
+    priv->rec_pos = priv->pos;
+    if(offset + rec_size > priv->ring.ring_size){
+        priv->rec_pos += priv->ring.ring_size - offset;
+    }
+    priv->rec_len = len;
+
+    return 0;
+}
+
+
+static inline volatile camio_vring_rec_t* get_rec(camio_ostream_vring_t* priv, uint64_t pos){
+    return (volatile camio_vring_rec_t*)(priv->ring.slots + pos % priv->ring.ring_size);
+}
+
+
+//Returns a pointer to a space of size len, ready for data
+//Returns NULL if this is impossible
+uint8_t* camio_ostream_vring_start_write(camio_ostream_t* this, size_t len ){
+    camio_ostream_vring_t* priv = this->priv;
+
+    if(unlikely(reserve(priv, len))){
+        return NULL;
+    }
+
+    return (uint8_t*)get_rec(priv, priv->rec_pos) + sizeof(camio_vring_rec_t);
+}
+
+//Returns non-zero if a call to start_write will be non-blocking
+int camio_ostream_vring_ready(camio_ostream_t* this){
+    return 1; //The writer never waits for readers
+}
+
+
+//Commit the data to the buffer previously allocated
+//Len must be equal to or less than len called with start_write
+uint8_t* camio_ostream_vring_end_write(camio_ostream_t* this, size_t len){
+    camio_ostream_vring_t* priv = this->priv;
+
+    //Memory copy is done implicitly here
+    if(priv->assigned_buffer){
+        if(unlikely(reserve(priv, len))){
+            eprintf_exit(CAMIO_ERR_BUFFER_OVERRUN, "Assigned buffer length (%lu) is too big for the ring\n", len);
+        }
+        memcpy((uint8_t*)get_rec(priv, priv->rec_pos) + sizeof(camio_vring_rec_t), priv->assigned_buffer, len);
+        priv->assigned_buffer    = NULL;
+        priv->assigned_buffer_sz = 0;
+    }
+
+    if(unlikely(len > priv->rec_len)){
+        eprintf_exit(CAMIO_ERR_BUFFER_OVERRUN, "Length supplied (%lu) is greater than the length reserved (%lu)\n", len, priv->rec_len);
+    }
+
+    //Fill the gap at the end of the ring. Padding shares the next record's sequence number so
+    //that readers can count lost records exactly
+    if(unlikely(priv->rec_pos != priv->pos)){
+        volatile camio_vring_rec_t* pad = get_rec(priv, priv->pos);
+        pad->len   = priv->rec_pos - priv->pos - sizeof(camio_vring_rec_t);
+        pad->flags = CAMIO_VRING_REC_PAD;
+        pad->seq   = priv->seq;
+    }
+
+    volatile camio_vring_rec_t* rec = get_rec(priv, priv->rec_pos);
+    rec->len   = len;
+    rec->flags = 0;
+    rec->seq   = priv->seq++;
+
+    priv->pos     = priv->rec_pos + camio_vring_rec_size(len);
+    priv->rec_len = 0;
+
+    //Write is now committed, everything above must be visible before the new position is
+    priv->ring.hdr->write_seq = priv->seq;
+    __atomic_store_n(&priv->ring.hdr->write_pos, priv->pos, __ATOMIC_RELEASE);
+    camio_ring_wake(&priv->ring);
+
+    return NULL;
+}
+
+
+//Records are visible to readers as soon as they are committed, so there's nothing to flush
+void camio_ostream_vring_flush(camio_ostream_t* this){
+}
+
+
+void camio_ostream_vring_delete(camio_ostream_t* ostream){
+    ostream->close(ostream);
+    camio_ostream_vring_t* priv = ostream->priv;
+    free(priv->filename);
+    free(priv);
+}
+
+//Is this stream capable of taking over another stream buffer
+int camio_ostream_vring_can_assign_write(camio_ostream_t* this){
+    return 1;
+}
+
+//Assign the write buffer to the stream
+int camio_ostream_vring_assign_write(camio_ostream_t* this, uint8_t* buffer, size_t len){
+    camio_ostream_vring_t* priv = this->priv;
+
+    if(!buffer){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"Assigned buffer is null.");
+    }
+
+    priv->assigned_buffer    = buffer;
+    priv->assigned_buffer_sz = len;
+
+    return 0;
+}
+
+
+/* ****************************************************
+ * Construction heavy lifting
+ */
+
+camio_ostream_t* camio_ostream_vring_construct(camio_ostream_vring_t* priv, const camio_descr_t* descr,  camio_ostream_vring_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"vring stream supplied is null\n");
+    }
+    //Initialize the local variables
+    priv->is_closed             = 1;
+    priv->filename              = NULL;
+    priv->ring.fd               = -1;
+    priv->ring.map              = NULL;
+    priv->pos                   = 0;
+    priv->seq                   = 1;
+    priv->rec_pos               = 0;
+    priv->rec_len               = 0;
+    priv->assigned_buffer       = NULL;
+    priv->assigned_buffer_sz    = 0;
+    priv->params                = params;
+
+
+    //Populate the function members
+    priv->ostream.priv              = priv; //Lets us access private members from public functions
+    priv->ostream.open              = camio_ostream_vring_open;
+    priv->ostream.close             = camio_ostream_vring_close;
+    priv->ostream.start_write       = camio_ostream_vring_start_write;
+    priv->ostream.end_write         = camio_ostream_vring_end_write;
+    priv->ostream.ready             = camio_ostream_vring_ready;
+    priv->ostream.delete            = camio_ostream_vring_delete;
+    priv->ostream.can_assign_write  = camio_ostream_vring_can_assign_write;
+    priv->ostream.assign_write      = camio_ostream_vring_assign_write;
+    priv->ostream.start_write_batch = camio_ostream_start_write_batch_generic;
+    priv->ostream.end_write_batch   = camio_ostream_end_write_batch_generic;
+    priv->ostream.flush             = camio_ostream_vring_flush;
+    priv->ostream.fd                = -1;
+
+    //Call open, because its the obvious thing to do now...
+    priv->ostream.open(&priv->ostream, descr);
+
+    //Return the generic ostream interface for the outside world
+    return &priv->ostream;
+
+}
+
+camio_ostream_t* camio_ostream_vring_new( const camio_descr_t* descr,  camio_ostream_vring_params_t* params){
+    camio_ostream_vring_t* priv = malloc(sizeof(camio_ostream_vring_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for ostream vring creation\n");
+    }
+    return camio_ostream_vring_construct(priv, descr,  params);
+}
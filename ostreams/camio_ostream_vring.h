@@ -0,0 +1,48 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ variable length record ring output stream
+ *
+ */
+
+#ifndef CAMIO_OSTREAM_VRING_H_
+#define CAMIO_OSTREAM_VRING_H_
+
+#include "camio_ostream.h"
+#include "../camio_ring.h"
+
+/********************************************************************
+ *                  PRIVATE DEFS
+ ********************************************************************/
+
+
+typedef struct {
+    //No params at this stage
+} camio_ostream_vring_params_t;
+
+typedef struct {
+    camio_ostream_t ostream;
+    char* filename;                         //Keep the file name so we can delete it
+    int is_closed;                          //Has close be called?
+    camio_ring_t ring;                      //The shared ring
+    uint64_t pos;                           //Bytes committed so far (not wrapped)
+    uint64_t seq;                           //Sequence number of the next record
+    uint64_t rec_pos;                       //Where the reserved record starts, past pos if we have to wrap
+    uint64_t rec_len;                       //Bytes reserved by start_write
+    uint8_t* assigned_buffer;               //Assigned write buffer
+    size_t assigned_buffer_sz;              //Assigned write buffer size
+    camio_ostream_vring_params_t* params;   //Parameters from the outside world
+
+} camio_ostream_vring_t;
+
+
+
+/********************************************************************
+ *                  PUBLIC DEFS
+ ********************************************************************/
+
+camio_ostream_t* camio_ostream_vring_new( const camio_descr_t* opts,  camio_ostream_vring_params_t* params);
+
+
+
+#endif /* CAMIO_OSTREAM_VRING_H_ */
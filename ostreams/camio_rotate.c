@@ -0,0 +1,238 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ output file rotation, used by the write buffer of the file based output streams
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "../camio_util.h"
+#include "../camio_errors.h"
+
+#include "camio_rotate.h"
+
+
+int camio_rotate_wanted(const camio_descr_t* descr){
+    return camio_descr_get_opt_uint(descr, "rotate_bytes", 0) || camio_descr_get_opt_uint(descr, "rotate_secs", 0);
+}
+
+
+//Work out the name of file number index, started at time start
+static void format_name(const camio_rotate_t* rot, uint64_t index, time_t start, char* out){
+    char with_index[PATH_MAX];
+    size_t len = 0;
+    int has_index = 0;
+    const char* in = rot->name_template;
+    for(; *in && len < sizeof(with_index) - 32; in++){
+        if(in[0] == '%' && in[1] == 'i'){
+            len += snprintf(with_index + len, sizeof(with_index) - len, "%lu", index);
+            has_index = 1;
+            in++;
+            continue;
+        }
+        if(in[0] == '%' && in[1]){
+            with_index[len++] = *in++; //Leave it (and %%) for strftime
+        }
+        with_index[len++] = *in;
+    }
+    with_index[len] = '\0';
+
+    char name[PATH_MAX];
+    struct tm tm;
+    localtime_r(&start, &tm);
+    if(!strftime(name, sizeof(name) - 32, with_index, &tm)){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not make a file name from \"%s\"\n", rot->name_template);
+    }
+
+    //Times can come round again (eg %H every day, or any of them when rotating on size), so only
+    //the index is sure to make the name unique. Without it, number them
+    if(!has_index){
+        if(snprintf(out, PATH_MAX, "%s.%lu", name, index) >= PATH_MAX){
+            eprintf_exit(CAMIO_ERR_FILE_OPEN, "File name made from \"%s\" is too long\n", rot->name_template);
+        }
+        return;
+    }
+    strcpy(out, name);
+}
+
+
+int camio_rotate_open(const char* name, int flags, uint64_t prealloc){
+    const int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | flags, (mode_t)(0666));
+    if(fd < 0){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not open file \"%s\". Error=%s%s\n", name, strerror(errno),
+                (flags & O_DIRECT) && errno == EINVAL ? " (the file system may not support direct I/O)" : "");
+    }
+
+    if(prealloc){
+        const int err = posix_fallocate(fd, 0, prealloc);
+        if(err){
+            wprintf(CAMIO_ERR_FILE_WRITE, "Could not preallocate %lu bytes for \"%s\". Error=%s\n", prealloc, name, strerror(err));
+        }
+    }
+
+    return fd;
+}
+
+
+static time_t next_deadline(const camio_rotate_t* rot, time_t now){
+    if(!rot->rotate_secs){
+        return 0;
+    }
+
+    return (now / rot->rotate_secs + 1) * rot->rotate_secs;
+}
+
+
+static void* thread_run(void* arg){
+    camio_rotate_t* rot = arg;
+
+    pthread_mutex_lock(&rot->lock);
+    while(!rot->stop){
+        //Tidy up after a switch first, then get the next file ready
+        if(rot->old_fd >= 0){
+            const int fd = rot->old_fd;
+            const int64_t length = rot->old_length;
+            rot->old_fd = -1;
+            pthread_mutex_unlock(&rot->lock);
+
+            if(length >= 0 && ftruncate(fd, length) < 0){
+                wprintf(CAMIO_ERR_FILE_WRITE, "Could not trim rotated file to %li bytes. Error=%s\n", length, strerror(errno));
+            }
+            close(fd);
+
+            pthread_mutex_lock(&rot->lock);
+            pthread_cond_broadcast(&rot->cond);
+            continue;
+        }
+
+        if(rot->rename_pending){
+            rot->rename_pending = 0;
+            pthread_mutex_unlock(&rot->lock);
+
+            if(rename(rot->rename_from, rot->rename_to) < 0){
+                wprintf(CAMIO_ERR_FILE_OPEN, "Could not rename \"%s\" to \"%s\". Error=%s\n", rot->rename_from, rot->rename_to, strerror(errno));
+            }
+
+            pthread_mutex_lock(&rot->lock);
+            pthread_cond_broadcast(&rot->cond);
+            continue;
+        }
+
+        if(rot->next_fd < 0){
+            //The real name depends on when the switch happens, so use a temporary one until then
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            format_name(rot, rot->index + 1, now.tv_sec, rot->next_name);
+            strncat(rot->next_name, ".next", PATH_MAX - strlen(rot->next_name) - 1);
+            pthread_mutex_unlock(&rot->lock);
+
+            const int fd = camio_rotate_open(rot->next_name, rot->flags, rot->prealloc);
+
+            pthread_mutex_lock(&rot->lock);
+            rot->next_fd = fd;
+            pthread_cond_broadcast(&rot->cond);
+            continue;
+        }
+
+        pthread_cond_wait(&rot->cond, &rot->lock);
+    }
+    pthread_mutex_unlock(&rot->lock);
+
+    return NULL;
+}
+
+
+int camio_rotate_init(camio_rotate_t* rot, const camio_descr_t* descr, int flags, uint64_t prealloc){
+    if(!descr->query){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
+    }
+
+    if(strlen(descr->query) >= sizeof(rot->name_template)){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "File name \"%s\" is too long\n", descr->query);
+    }
+
+    strcpy(rot->name_template, descr->query);
+    rot->flags          = flags;
+    rot->prealloc       = prealloc;
+    rot->rotate_bytes   = camio_descr_get_opt_uint(descr, "rotate_bytes", 0);
+    rot->rotate_secs    = camio_descr_get_opt_uint(descr, "rotate_secs", 0);
+    rot->index          = 0;
+    rot->name[0]        = '\0';
+    rot->stop           = 0;
+    rot->next_fd        = -1;
+    rot->rename_pending = 0;
+    rot->old_fd         = -1;
+    rot->old_length     = -1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    rot->deadline = next_deadline(rot, now.tv_sec);
+    format_name(rot, rot->index, now.tv_sec, rot->name);
+    const int fd = camio_rotate_open(rot->name, rot->flags, rot->prealloc);
+
+    pthread_mutex_init(&rot->lock, NULL);
+    pthread_cond_init(&rot->cond, NULL);
+    const int err = pthread_create(&rot->thread, NULL, thread_run, rot);
+    if(err){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not start file rotation thread. Error=%s\n", strerror(err));
+    }
+
+    return fd;
+}
+
+
+void camio_rotate_destroy(camio_rotate_t* rot){
+    //Let any outstanding renames and closes finish, we don't care about the next file
+    pthread_mutex_lock(&rot->lock);
+    while(rot->old_fd >= 0 || rot->rename_pending){
+        pthread_cond_wait(&rot->cond, &rot->lock);
+    }
+    rot->stop = 1;
+    pthread_cond_broadcast(&rot->cond);
+    pthread_mutex_unlock(&rot->lock);
+    pthread_join(rot->thread, NULL);
+
+    if(rot->next_fd >= 0){
+        close(rot->next_fd);
+        unlink(rot->next_name);
+        rot->next_fd = -1;
+    }
+
+    pthread_cond_destroy(&rot->cond);
+    pthread_mutex_destroy(&rot->lock);
+}
+
+
+void camio_rotate_switch(camio_rotate_t* rot, int fd, int64_t length){
+    pthread_mutex_lock(&rot->lock);
+    while(unlikely(rot->next_fd < 0)){
+        pthread_cond_wait(&rot->cond, &rot->lock); //Rotating faster than files can be created
+    }
+
+    //Keep a reference to the old file for the helper to close, so dup2() doesn't do the last close
+    const int old_fd = dup(fd);
+    if(old_fd < 0 || dup2(rot->next_fd, fd) < 0){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not switch to file \"%s\". Error=%s\n", rot->next_name, strerror(errno));
+    }
+    close(rot->next_fd);
+    rot->next_fd = -1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    rot->index++;
+    rot->deadline = next_deadline(rot, now.tv_sec);
+    strcpy(rot->rename_from, rot->next_name);
+    format_name(rot, rot->index, now.tv_sec, rot->rename_to);
+    strcpy(rot->name, rot->rename_to);
+    rot->rename_pending = 1;
+    rot->old_fd         = old_fd;
+    rot->old_length     = length;
+
+    pthread_cond_broadcast(&rot->cond);
+    pthread_mutex_unlock(&rot->lock);
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ output file rotation, used by the write buffer of the file based output streams
+ *
+ * The output moves on to a new file once the current one has rotate_bytes in it, or once the wall
+ * clock passes the next multiple of rotate_secs (so rotate_secs=3600 rotates on the hour). Files
+ * only change between records, and the check is made as records are written, so a time based
+ * rotation happens with the first record after the boundary.
+ *
+ * File names come from the stream's file name, which is passed through strftime() with the time
+ * the file was started, after replacing %i with the file's sequence number. If there is no %i, the
+ * name might not be unique (times repeat, and don't change at all when rotating on size), so ".N"
+ * is added to the end of every file's name.
+ *
+ * A helper thread does all of the slow file system work. It creates the next file (under a
+ * temporary name, and preallocated if asked) ahead of time, so switching is just a dup2(). After
+ * the switch it renames the new file to its real name and trims and closes the old one.
+ *
+ * Options:
+ * rotate_bytes=N  Start a new file after N bytes
+ * rotate_secs=N   Start a new file every N seconds
+ *
+ */
+
+#ifndef CAMIO_ROTATE_H_
+#define CAMIO_ROTATE_H_
+
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../camio_descr.h"
+
+#define CAMIO_ROTATE_OPTS "rotate_bytes", "rotate_secs"
+
+typedef struct {
+    char name_template[PATH_MAX];       //The stream's file name, copied as the description doesn't outlive the stream's construction
+    int flags;                          //Extra flags to open each file with, eg O_DIRECT
+    uint64_t prealloc;                  //Bytes to preallocate in each file
+    uint64_t rotate_bytes;              //0 for no size limit
+    uint64_t rotate_secs;               //0 for no time limit
+    uint64_t index;                     //Sequence number of the file being written
+    time_t deadline;                    //Wall clock time the current file is due to be rotated, 0 for never
+    char name[PATH_MAX];                //Name of the file being written
+
+    //Work for the helper thread, protected by lock
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int stop;
+    int next_fd;                        //Next file, created and waiting, or -1
+    char next_name[PATH_MAX];           //Its temporary name
+    int rename_pending;                 //The current file still has its temporary name
+    char rename_from[PATH_MAX];
+    char rename_to[PATH_MAX];
+    int old_fd;                         //Last file, waiting to be trimmed and closed, or -1
+    int64_t old_length;                 //Length to trim it to, -1 to leave it as it is
+} camio_rotate_t;
+
+
+//Open (creating or truncating) one output file, with flags added, and preallocate it
+int camio_rotate_open(const char* name, int flags, uint64_t prealloc);
+
+//Returns non-zero if the rotation options are set
+int camio_rotate_wanted(const camio_descr_t* descr);
+
+//Open the first file and start the helper thread. Returns the fd of the first file
+int camio_rotate_init(camio_rotate_t* rot, const camio_descr_t* descr, int flags, uint64_t prealloc);
+
+//Stop the helper thread and remove the file it had ready. The current file is left to the caller
+void camio_rotate_destroy(camio_rotate_t* rot);
+
+//Put the next file behind fd, which must have nothing in flight. The old file is trimmed to length
+//(unless it's negative) and closed in the background
+void camio_rotate_switch(camio_rotate_t* rot, int fd, int64_t length);
+
+//Is it time to move on, with bytes in the current file?
+static inline int camio_rotate_due(const camio_rotate_t* rot, uint64_t bytes){
+    if(rot->rotate_bytes && bytes >= rot->rotate_bytes){
+        return 1;
+    }
+
+    if(rot->deadline){
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        return now.tv_sec >= rot->deadline;
+    }
+
+    return 0;
+}
+
+#endif /* CAMIO_ROTATE_H_ */
@@ -0,0 +1,354 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ write combining buffer, common to the file based output streams
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "../camio_util.h"
+#include "../camio_errors.h"
+
+#include "camio_write_buffer.h"
+
+
+void camio_writev_all(int fd, struct iovec* iovs, int iov_count){
+    while(iov_count > 0){
+        ssize_t written = writev(fd, iovs, iov_count);
+        if(unlikely(written < 0)){
+            if(errno == EINTR){
+                continue;
+            }
+            eprintf_exit(CAMIO_ERR_FILE_WRITE, "Could not write to file. Error=%s\n", strerror(errno));
+        }
+
+        while(iov_count > 0 && (size_t)written >= iovs->iov_len){
+            written -= iovs->iov_len;
+            iovs++;
+            iov_count--;
+        }
+
+        if(iov_count > 0){
+            iovs->iov_base  = (uint8_t*)iovs->iov_base + written;
+            iovs->iov_len  -= written;
+        }
+    }
+}
+
+
+int camio_write_buffer_init(camio_write_buffer_t* wbuf, int fd, const camio_descr_t* descr, int flags){
+    wbuf->prealloc = camio_descr_get_opt_uint(descr, "prealloc", 0);
+    wbuf->rotating = 0;
+    wbuf->file_hdr     = NULL;
+    wbuf->file_hdr_len = 0;
+
+    //Open the file ourselves, so that it can be rotated
+    if(fd < 0){
+        if(camio_rotate_wanted(descr)){
+            fd = camio_rotate_init(&wbuf->rotate, descr, flags, wbuf->prealloc);
+            wbuf->rotating = 1;
+        }
+        else{
+            if(!descr->query){
+                eprintf_exit(CAMIO_ERR_NULL_PTR, "No filename supplied\n");
+            }
+            fd = camio_rotate_open(descr->query, flags, wbuf->prealloc);
+        }
+    }
+    else if(camio_rotate_wanted(descr)){
+        eprintf_exit(CAMIO_ERR_UNKNOWN_OPT, "Cannot rotate a file descriptor supplied from outside\n");
+    }
+    else if(wbuf->prealloc){
+        const int err = posix_fallocate(fd, 0, wbuf->prealloc);
+        if(err){
+            wprintf(CAMIO_ERR_FILE_WRITE, "Could not preallocate %lu bytes. Error=%s\n", wbuf->prealloc, strerror(err));
+        }
+    }
+
+    wbuf->fd          = fd;
+    wbuf->used        = 0;
+    wbuf->records     = 0;
+    wbuf->file_bytes  = 0;
+
+    //O_DIRECT writes have to be whole, aligned blocks, which only the aio buffers are. They also
+    //want to be big, there's no page cache to combine them
+    const int fd_flags = fcntl(fd, F_GETFL);
+    const int direct = fd_flags >= 0 && (fd_flags & O_DIRECT);
+    wbuf->size        = camio_descr_get_opt_uint(descr, "buffer", direct ? CAMIO_WRITE_BUFFER_DIRECT_SIZE : CAMIO_WRITE_BUFFER_DEFAULT_SIZE);
+    wbuf->flush_count = camio_descr_get_opt_uint(descr, "flush_count", isatty(fd) ? 1 : 0);
+    wbuf->buffer      = NULL;
+    wbuf->async       = 0;
+    wbuf->direct      = 0;
+
+    camio_aio_opts_t aio_opts;
+    camio_aio_get_opts(descr, &aio_opts);
+
+    if(direct){
+        if(!wbuf->size){
+            eprintf_exit(CAMIO_ERR_FILE_WRITE, "Direct I/O needs a write buffer, buffer=0 is not allowed\n");
+        }
+        wbuf->size   = (wbuf->size + CAMIO_AIO_ALIGN - 1) & ~(size_t)(CAMIO_AIO_ALIGN - 1);
+        wbuf->direct = 1;
+        aio_opts.aio = 1;
+    }
+
+    if(aio_opts.aio && wbuf->size){
+        struct stat st;
+        if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)){
+            //Buffers are written at explicit offsets, starting from wherever the fd is now
+            const off_t offset = lseek(fd, 0, SEEK_CUR);
+            camio_aio_init(&wbuf->aio, fd, 1, aio_opts.depth, wbuf->size, offset < 0 ? 0 : offset);
+            wbuf->buffer = camio_aio_write_buffer(&wbuf->aio);
+            wbuf->async  = 1;
+            return fd;
+        }
+        wprintf(CAMIO_ERR_FILE_WRITE, "Asynchronous I/O only works with regular files, writing synchronously\n");
+    }
+
+    if(wbuf->size){
+        wbuf->buffer = malloc(wbuf->size);
+        if(!wbuf->buffer){
+            eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not allocate write buffer of %lu bytes\n", wbuf->size);
+        }
+    }
+
+    return fd;
+}
+
+
+void camio_write_buffer_flush(camio_write_buffer_t* wbuf){
+    if(!wbuf->used){
+        return;
+    }
+
+    //Direct I/O can only write whole blocks. Whatever is left over is carried into the next buffer
+    if(wbuf->direct){
+        const size_t aligned = wbuf->used & ~(size_t)(CAMIO_AIO_ALIGN - 1);
+        const size_t tail    = wbuf->used - aligned;
+        if(!aligned){
+            return;
+        }
+
+        const uint8_t* last = wbuf->buffer;
+        camio_aio_write_submit(&wbuf->aio, aligned);
+        wbuf->buffer = camio_aio_write_buffer(&wbuf->aio);
+        memcpy(wbuf->buffer, last + aligned, tail);
+        wbuf->used    = tail;
+        wbuf->records = 0;
+        return;
+    }
+
+    //Asynchronous buffers are sent off to be written, and we move on to the next one
+    if(wbuf->async){
+        camio_aio_write_submit(&wbuf->aio, wbuf->used);
+        wbuf->buffer = camio_aio_write_buffer(&wbuf->aio);
+    }
+    else{
+        struct iovec iov = { .iov_base = wbuf->buffer, .iov_len = wbuf->used };
+        camio_writev_all(wbuf->fd, &iov, 1);
+    }
+    wbuf->used    = 0;
+    wbuf->records = 0;
+}
+
+
+//Get everything buffered for the current file written out, and return how long the file is. Direct
+//I/O pads out the last partial block, so the file has to be trimmed back to that length afterwards
+static uint64_t finish_file(camio_write_buffer_t* wbuf){
+    camio_write_buffer_flush(wbuf);
+    if(!wbuf->async){
+        const off_t end = lseek(wbuf->fd, 0, SEEK_CUR);
+        return end < 0 ? 0 : end;
+    }
+
+    const uint64_t length = wbuf->aio.offset + wbuf->used;
+    if(wbuf->direct && wbuf->used){
+        bzero(wbuf->buffer + wbuf->used, CAMIO_AIO_ALIGN - wbuf->used);
+        camio_aio_write_submit(&wbuf->aio, CAMIO_AIO_ALIGN);
+        wbuf->buffer = camio_aio_write_buffer(&wbuf->aio);
+        wbuf->used   = 0;
+    }
+
+    camio_aio_drain(&wbuf->aio);
+    return length;
+}
+
+
+//Copy bytes into the buffer, flushing it as often as it takes
+static void copy_through(camio_write_buffer_t* wbuf, const uint8_t* in, size_t left){
+    while(left){
+        if(wbuf->used == wbuf->size){
+            camio_write_buffer_flush(wbuf);
+        }
+        const size_t amount = MIN(left, wbuf->size - wbuf->used);
+        memcpy(wbuf->buffer + wbuf->used, in, amount);
+        wbuf->used += amount;
+        in         += amount;
+        left       -= amount;
+    }
+}
+
+
+void camio_write_buffer_set_file_header(camio_write_buffer_t* wbuf, const void* hdr, size_t len){
+    wbuf->file_hdr = realloc(wbuf->file_hdr, len);
+    if(len && !wbuf->file_hdr){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not allocate file header of %lu bytes\n", len);
+    }
+    memcpy(wbuf->file_hdr, hdr, len);
+    wbuf->file_hdr_len = len;
+}
+
+
+//Move on to the next file, between records
+static void rotate(camio_write_buffer_t* wbuf){
+    const uint64_t length = finish_file(wbuf);
+    camio_rotate_switch(&wbuf->rotate, wbuf->fd, wbuf->direct || wbuf->prealloc ? (int64_t)length : -1);
+    if(wbuf->async){
+        wbuf->aio.offset = 0;
+    }
+    wbuf->file_bytes = 0;
+
+    if(wbuf->file_hdr_len){
+        //Not through records_done(), which could decide to rotate again
+        if(wbuf->size){
+            copy_through(wbuf, wbuf->file_hdr, wbuf->file_hdr_len);
+        }
+        else{
+            struct iovec iov = { .iov_base = wbuf->file_hdr, .iov_len = wbuf->file_hdr_len };
+            camio_writev_all(wbuf->fd, &iov, 1);
+        }
+        wbuf->file_bytes = wbuf->file_hdr_len;
+    }
+}
+
+
+static inline void check_rotate(camio_write_buffer_t* wbuf){
+    if(unlikely(wbuf->rotating) && camio_rotate_due(&wbuf->rotate, wbuf->file_bytes)){
+        rotate(wbuf);
+    }
+}
+
+
+void camio_write_buffer_destroy(camio_write_buffer_t* wbuf){
+    if(wbuf->fd < 0){
+        return; //Already done
+    }
+
+    const uint64_t length = finish_file(wbuf);
+    if(wbuf->async){
+        camio_aio_destroy(&wbuf->aio); //Owns the buffer
+        wbuf->buffer = NULL;
+        wbuf->async  = 0;
+    }
+
+    //Direct I/O padding and preallocated space shouldn't be left on the end of the file
+    if(wbuf->direct || wbuf->prealloc){
+        if(ftruncate(wbuf->fd, length) < 0){
+            wprintf(CAMIO_ERR_FILE_WRITE, "Could not trim file to %lu bytes. Error=%s\n", length, strerror(errno));
+        }
+        lseek(wbuf->fd, length, SEEK_SET);
+    }
+
+    if(wbuf->rotating){
+        camio_rotate_destroy(&wbuf->rotate);
+        wbuf->rotating = 0;
+    }
+    free(wbuf->file_hdr);
+    wbuf->file_hdr     = NULL;
+    wbuf->file_hdr_len = 0;
+
+    free(wbuf->buffer);
+    wbuf->buffer   = NULL;
+    wbuf->size     = 0;
+    wbuf->direct   = 0;
+    wbuf->prealloc = 0;
+    wbuf->fd       = -1;
+}
+
+
+uint8_t* camio_write_buffer_reserve(camio_write_buffer_t* wbuf, size_t len){
+    if(unlikely(len > wbuf->size)){
+        return NULL;
+    }
+
+    if(unlikely(wbuf->used + len > wbuf->size)){
+        camio_write_buffer_flush(wbuf);
+
+        //Direct I/O may have carried part of a block over
+        if(unlikely(wbuf->used + len > wbuf->size)){
+            return NULL;
+        }
+    }
+
+    return wbuf->buffer + wbuf->used;
+}
+
+
+static inline void records_done(camio_write_buffer_t* wbuf, size_t len, uint64_t records){
+    wbuf->records    += records;
+    wbuf->file_bytes += len;
+    if(unlikely(wbuf->flush_count && wbuf->records >= wbuf->flush_count)){
+        camio_write_buffer_flush(wbuf);
+    }
+    check_rotate(wbuf);
+}
+
+
+void camio_write_buffer_commit(camio_write_buffer_t* wbuf, size_t len, uint64_t records){
+    wbuf->used += len;
+    records_done(wbuf, len, records);
+}
+
+
+void camio_write_buffer_writev(camio_write_buffer_t* wbuf, const struct iovec* iovs, int iov_count, uint64_t records){
+    size_t len = 0;
+    int i = 0;
+    for(; i < iov_count; i++){
+        len += iovs[i].iov_len;
+    }
+
+    //Copying is cheaper than a syscall for anything small enough to fit in with everything else
+    uint8_t* out = wbuf->size && len <= wbuf->size / 4 ? camio_write_buffer_reserve(wbuf, len) : NULL;
+    if(out){
+        for(i = 0; i < iov_count; i++){
+            memcpy(out, iovs[i].iov_base, iovs[i].iov_len);
+            out += iovs[i].iov_len;
+        }
+        camio_write_buffer_commit(wbuf, len, records);
+        return;
+    }
+
+    //Asynchronous writes only come from the aio buffers, so big records are copied through them
+    if(wbuf->async){
+        for(i = 0; i < iov_count; i++){
+            copy_through(wbuf, iovs[i].iov_base, iovs[i].iov_len);
+        }
+        records_done(wbuf, len, records);
+        return;
+    }
+
+    //Too big, send it straight from where it is, along with what's buffered so the order is kept
+    struct iovec iov_out[CAMIO_WRITE_BUFFER_IOV_MAX + 1];
+    int out_count = 0;
+    if(wbuf->used){
+        iov_out[out_count].iov_base = wbuf->buffer;
+        iov_out[out_count].iov_len  = wbuf->used;
+        out_count++;
+    }
+    iov_count = MIN(iov_count, CAMIO_WRITE_BUFFER_IOV_MAX);
+    for(i = 0; i < iov_count; i++){
+        iov_out[out_count++] = iovs[i];
+    }
+
+    camio_writev_all(wbuf->fd, iov_out, out_count);
+    wbuf->used        = 0;
+    wbuf->records     = 0;
+    wbuf->file_bytes += len;
+    check_rotate(wbuf);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ write combining buffer, common to the file based output streams
+ *
+ * Records are built up in a user space buffer and written out with one syscall when it fills up,
+ * or sooner depending on the flush policy. Streams can hand out space in the buffer directly from
+ * start_write so that most records are never copied. Records that are too big to buffer, or that
+ * live in someone else's (assigned) buffer, are written out with writev() along with whatever is
+ * already buffered, rather than being copied in.
+ *
+ * Options:
+ * buffer=N       Buffer size in bytes, 0 turns buffering off. Defaults to 64Ki, or 1Mi for O_DIRECT
+ * flush_count=N  Flush after this many records, 0 to only flush when the buffer is full. Defaults
+ *                to 1 for terminals so they behave like stdio, 0 otherwise
+ * prealloc=N     Reserve N bytes of disk for the file when it's opened. Whatever isn't used is
+ *                trimmed off again when it's closed
+ * The owner can also call flush() at any time, eg on a timer.
+ *
+ * Regular files can also be written asynchronously (see camio_aio.h). The write buffer is then one
+ * of the aio buffers, and flushing sends it off to be written while the next one is filled. Big
+ * records are copied through the aio buffers rather than being written from where they are.
+ *
+ * If the fd was opened with O_DIRECT, writes always go through the aio buffers (with the buffer
+ * size rounded up to a whole number of blocks), and only whole blocks are written. A flush carries
+ * any partial block over to the next buffer. The last block is padded out when the buffer is
+ * destroyed, and the file trimmed back to the length actually written.
+ *
+ * Files opened by the write buffer can be rotated (see camio_rotate.h). Each new file is swapped in
+ * behind the same fd, so the owner never sees it change. Formats that need a header at the start of
+ * every file can give it to camio_write_buffer_set_file_header() to have it written to each new one.
+ *
+ */
+
+#ifndef CAMIO_WRITE_BUFFER_H_
+#define CAMIO_WRITE_BUFFER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "../camio_descr.h"
+#include "../camio_aio.h"
+#include "camio_rotate.h"
+
+#define CAMIO_WRITE_BUFFER_OPTS "buffer", "flush_count", "prealloc", CAMIO_AIO_OPTS, CAMIO_ROTATE_OPTS
+#define CAMIO_WRITE_BUFFER_DEFAULT_SIZE (64 * 1024)     //64kB
+#define CAMIO_WRITE_BUFFER_DIRECT_SIZE (1024 * 1024)    //1MB default for O_DIRECT files
+#define CAMIO_WRITE_BUFFER_IOV_MAX 64                   //Most iovecs passed to camio_write_buffer_writev()
+
+typedef struct {
+    int fd;
+    uint8_t* buffer;
+    size_t size;                        //Zero if buffering is off
+    size_t used;
+    uint64_t records;                   //Records waiting in the buffer
+    uint64_t flush_count;               //Flush once there are this many, 0 to wait until the buffer is full
+    int async;                          //aio=1, buffers are written out asynchronously
+    int direct;                         //The fd is O_DIRECT, only whole blocks can be written
+    uint64_t prealloc;                  //Bytes preallocated in each file
+    uint64_t file_bytes;                //Bytes written to the current file
+    int rotating;                       //rotate_bytes= or rotate_secs= were given
+    uint8_t* file_hdr;                  //Written at the start of each file rotated to, if set
+    size_t file_hdr_len;
+    camio_rotate_t rotate;
+    camio_aio_t aio;
+} camio_write_buffer_t;
+
+
+//Set up a write buffer for fd. If fd is negative, the file named in the description is opened
+//(with flags added to O_WRONLY | O_CREAT | O_TRUNC) and may be rotated. Returns the fd
+int camio_write_buffer_init(camio_write_buffer_t* wbuf, int fd, const camio_descr_t* descr, int flags);
+void camio_write_buffer_destroy(camio_write_buffer_t* wbuf);            //Flushes first
+
+//Space for len bytes at the end of the buffer, flushing to make room if needed. Returns NULL if
+//the buffer is off or too small, in which case the caller has to find its own space
+uint8_t* camio_write_buffer_reserve(camio_write_buffer_t* wbuf, size_t len);
+
+//Commit len bytes, holding the given number of records, at the space returned by reserve()
+void camio_write_buffer_commit(camio_write_buffer_t* wbuf, size_t len, uint64_t records);
+
+//Write out records made up of iov_count (at most CAMIO_WRITE_BUFFER_IOV_MAX) pieces. Small writes
+//are copied into the buffer, anything else goes straight out with writev(), along with what's
+//already buffered
+void camio_write_buffer_writev(camio_write_buffer_t* wbuf, const struct iovec* iovs, int iov_count, uint64_t records);
+
+void camio_write_buffer_flush(camio_write_buffer_t* wbuf);
+
+//Set (or replace) the bytes each new file starts with when the output is rotated. They're copied,
+//and not written now, the owner writes the first file's header itself
+void camio_write_buffer_set_file_header(camio_write_buffer_t* wbuf, const void* hdr, size_t len);
+
+//Write out a whole vector of buffers, picking up where writev() left off after a short write
+void camio_writev_all(int fd, struct iovec* iovs, int iov_count);
+
+#endif /* CAMIO_WRITE_BUFFER_H_ */
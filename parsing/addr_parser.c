@@ -0,0 +1,77 @@
+/*
+ * addr_parser.c
+ *
+ * Parse IPv4 addresses, with or without a port, as they're given to the socket streams
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "addr_parser.h"
+
+#define ADDR_PARSER_MAX_PORT 65535
+
+
+//Just the address part, up to len chars of c
+static int parse_addr(const char* c, size_t len, struct in_addr* out){
+    char ip[INET_ADDRSTRLEN];
+    if(len == 0 || (len == 1 && c[0] == '*')){
+        out->s_addr = htonl(INADDR_ANY);
+        return len == 1; //A bare ip must say "*", an ip:port may leave it out
+    }
+    if(len >= sizeof(ip)){
+        return 0;
+    }
+
+    memcpy(ip, c, len);
+    ip[len] = '\0';
+    return inet_pton(AF_INET, ip, out) == 1;
+}
+
+
+addr_result_t parse_ip(const char* c){
+    addr_result_t result;
+    memset(&result, 0, sizeof(result));
+    result.addr.sin_family = AF_INET;
+
+    result.valid = parse_addr(c, strlen(c), &result.addr.sin_addr);
+    return result;
+}
+
+
+addr_result_t parse_ip_port(const char* c){
+    addr_result_t result;
+    memset(&result, 0, sizeof(result));
+    result.addr.sin_family = AF_INET;
+
+    const char* colon = strrchr(c, ':');
+    if(!colon){
+        return result;
+    }
+
+    const size_t ip_len = colon - c;
+    if(ip_len && !parse_addr(c, ip_len, &result.addr.sin_addr)){
+        return result;
+    }
+    if(!ip_len){
+        result.addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+
+    //Digits only, no signs, suffixes or white space
+    const char* port = colon + 1;
+    uint32_t value = 0;
+    size_t i = 0;
+    for(; port[i] != '\0'; i++){
+        if(port[i] < '0' || port[i] > '9' || i >= 5){
+            return result;
+        }
+        value = value * 10 + (port[i] - '0');
+    }
+    if(i == 0 || value > ADDR_PARSER_MAX_PORT){
+        return result;
+    }
+
+    result.addr.sin_port = htons(value);
+    result.valid = 1;
+    return result;
+}
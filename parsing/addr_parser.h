@@ -0,0 +1,22 @@
+/*
+ * addr_parser.h
+ *
+ * Parse IPv4 addresses, with or without a port, as they're given to the socket streams
+ */
+
+#ifndef ADDR_PARSER_H_
+#define ADDR_PARSER_H_
+
+#include <netinet/in.h>
+
+typedef struct{
+    int valid;
+    struct sockaddr_in addr;            //Address and port in network byte order
+} addr_result_t;
+
+
+addr_result_t parse_ip(const char* c);          //"a.b.c.d", or "*" for any address
+addr_result_t parse_ip_port(const char* c);     //"a.b.c.d:port", or "*:port" / ":port" for any address
+
+
+#endif /* ADDR_PARSER_H_ */
@@ -0,0 +1,108 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * \xHH escaping, so that binary data can be carried in newline separated text
+ *
+ */
+
+#include <string.h>
+#ifdef __x86_64__
+#include <emmintrin.h>
+#endif
+
+#include "escape.h"
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+
+static inline int needs_escape(uint8_t c){
+    return c < 0x20 || c > 0x7E || c == '\\';
+}
+
+
+static inline int hex_value(uint8_t c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+
+//How many bytes from the start of in can be copied without escaping
+static size_t plain_run(const uint8_t* in, size_t len){
+    size_t i = 0;
+
+#ifdef __x86_64__
+    //Signed compare, so everything from 0x80 up counts as less than 0x20 too
+    const __m128i low   = _mm_set1_epi8(0x20);
+    const __m128i del   = _mm_set1_epi8(0x7F);
+    const __m128i slash = _mm_set1_epi8('\\');
+    for(; i + sizeof(__m128i) <= len; i += sizeof(__m128i)){
+        const __m128i data = _mm_loadu_si128((const __m128i*)(in + i));
+        const __m128i bad  = _mm_or_si128(_mm_cmplt_epi8(data, low), _mm_or_si128(_mm_cmpeq_epi8(data, del), _mm_cmpeq_epi8(data, slash)));
+        const uint32_t mask = _mm_movemask_epi8(bad);
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for(; i < len && !needs_escape(in[i]); i++){}
+    return i;
+}
+
+
+size_t escape_hex(const uint8_t* in, size_t len, uint8_t* out){
+    uint8_t* const start = out;
+
+    while(len){
+        const size_t run = plain_run(in, len);
+        memcpy(out, in, run);
+        out += run;
+        in  += run;
+        len -= run;
+
+        //Escape everything up to the next printable character
+        for(; len && needs_escape(*in); in++, len--){
+            out[0] = '\\';
+            out[1] = 'x';
+            out[2] = hex_digits[*in >> 4];
+            out[3] = hex_digits[*in & 0xF];
+            out += 4;
+        }
+    }
+
+    return out - start;
+}
+
+
+size_t unescape_hex(const uint8_t* in, size_t len, uint8_t* out){
+    uint8_t* const start = out;
+
+    while(len){
+        const uint8_t* slash = memchr(in, '\\', len);
+        const size_t run = slash ? (size_t)(slash - in) : len;
+        memmove(out, in, run); //Might be in place
+        out += run;
+        in  += run;
+        len -= run;
+        if(!len){
+            break;
+        }
+
+        //Found a '\', is it the start of a valid sequence?
+        const int hi = len >= 4 && (in[1] == 'x' || in[1] == 'X') ? hex_value(in[2]) : -1;
+        const int lo = hi >= 0 ? hex_value(in[3]) : -1;
+        if(lo < 0){
+            *out++ = *in++;
+            len--;
+            continue;
+        }
+
+        *out++ = (uint8_t)(hi << 4 | lo);
+        in  += 4;
+        len -= 4;
+    }
+
+    return out - start;
+}
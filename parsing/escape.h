@@ -0,0 +1,27 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * \xHH escaping, so that binary data can be carried in newline separated text. Anything that
+ * isn't printable ASCII is escaped, as is '\' itself so that escaping is always reversible.
+ *
+ */
+
+#ifndef ESCAPE_H_
+#define ESCAPE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+//Worst case size of len bytes once escaped
+#define ESCAPE_HEX_MAX_LEN(len) ((len) * 4)
+
+//Escape len bytes from in to out, which must have space for ESCAPE_HEX_MAX_LEN(len) bytes.
+//Returns the number of bytes written to out
+size_t escape_hex(const uint8_t* in, size_t len, uint8_t* out);
+
+//Unescape len bytes from in to out. out may be the same as in. Anything that isn't a valid
+//escape sequence is copied as is. Returns the number of bytes written to out
+size_t unescape_hex(const uint8_t* in, size_t len, uint8_t* out);
+
+
+#endif /* ESCAPE_H_ */
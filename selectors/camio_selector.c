@@ -13,26 +13,38 @@
 #include "camio_selector_spin.h"
 #include "camio_selector_seq.h"
 #include "camio_selector_poll.h"
+#include "camio_selector_epoll.h"
+#include "camio_selector_adaptive.h"
 
 
 
 camio_selector_t* camio_selector_new(const char* description,  void* parameters){
     camio_selector_t* result = NULL;
+    camio_descr_t descr;
+    camio_descr_construct(&descr);
+    camio_descr_parse(description,&descr);
 
-    if(strcmp(description,"spin") == 0 ){
+    if(strcmp(descr.protocol,"spin") == 0 ){
         result = camio_selector_spin_new( parameters);
     }
-    else if(strcmp(description,"seq") == 0 ){
+    else if(strcmp(descr.protocol,"seq") == 0 ){
         result = camio_selector_seq_new( parameters);
     }
-    else if(strcmp(description,"poll") == 0 ){
+    else if(strcmp(descr.protocol,"poll") == 0 ){
         result = camio_selector_poll_new( parameters);
     }
+    else if(strcmp(descr.protocol,"epoll") == 0 ){
+        result = camio_selector_epoll_new( parameters);
+    }
+    else if(strcmp(descr.protocol,"adaptive") == 0 ){
+        result = camio_selector_adaptive_new(&descr, parameters);
+    }
 
     else{
         eprintf_exit(CAMIO_ERR_UNKNOWN_SELECTOR,"Could not create selector from description \"%s\" \n", description);
     }
 
+    camio_descr_destroy(&descr);
     return result;
 
 }
@@ -0,0 +1,200 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ adaptive selector
+ *
+ * Spins over ready() for a fixed budget, measured with the TSC, then falls back to blocking in
+ * poll() on the fds of streams that have one. Streams that can't be blocked on (eg rings) cap the
+ * time spent blocked so that they are still checked regularly.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+
+
+#include "../camio_errors.h"
+#include "../camio_util.h"
+#include "../clocks/camio_tsc.h"
+
+#include "camio_selector_adaptive.h"
+
+
+int camio_selector_adaptive_init(camio_selector_t* this){
+    //camio_selector_adaptive_t* priv = this->priv;
+    return 0;
+}
+
+//Insert an istream at index specified
+int camio_selector_adaptive_insert(camio_selector_t* this, camio_istream_t* istream, size_t index){
+    camio_selector_adaptive_t* priv = this->priv;
+    if(!istream){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No istream supplied\n");
+    }
+
+    if(priv->stream_count >= CAMIO_SELECTOR_ADAPTIVE_MAX_STREAMS){
+        wprintf(CAMIO_ERR_STREAMS_OVERRUN, "Cannot insert more than %u streams in this selector\n", CAMIO_SELECTOR_ADAPTIVE_MAX_STREAMS);
+        return -1;
+    }
+
+    //Regular files always poll as readable, so they are no use for blocking on
+    struct stat st;
+    int blocking = istream->fd >= 0 && fstat(istream->fd, &st) == 0 && !S_ISREG(st.st_mode);
+
+    priv->streams[priv->stream_count].index    = index;
+    priv->streams[priv->stream_count].istream  = istream;
+    priv->streams[priv->stream_count].blocking = blocking;
+    priv->fds[priv->stream_count].fd           = blocking ? istream->fd : -1;
+    priv->fds[priv->stream_count].events       = POLLIN;
+
+    priv->stream_count++;
+    priv->stream_avail++;
+    priv->spin_only += !blocking;
+
+    return 0;
+}
+
+
+
+size_t camio_selector_adaptive_count(camio_selector_t* this){
+    camio_selector_adaptive_t* priv = this->priv;
+    return priv->stream_avail;
+}
+
+
+//Remove the istream at index specified
+int camio_selector_adaptive_remove(camio_selector_t* this, size_t index){
+    camio_selector_adaptive_t* priv = this->priv;
+
+    size_t i = 0;
+    for(i = 0; i < priv->stream_count; i++ ){
+        if(priv->streams[i].istream && priv->streams[i].index == index){
+            priv->spin_only -= !priv->streams[i].blocking;
+            priv->streams[i].istream = NULL;
+            priv->fds[i].fd          = -1;
+            priv->stream_avail--;
+            return 0;
+        }
+    }
+
+    wprintf(CAMIO_ERR_STREAMS_OVERRUN, "Cannot remove this stream (%lu) from this selector. The index could not be found.\n", index);
+    return -1;
+}
+
+
+//Block waiting for a change on a given istream
+//return the stream number that changed
+size_t camio_selector_adaptive_select(camio_selector_t* this){
+    camio_selector_adaptive_t* priv = this->priv;
+    int blocked = 0;
+
+    priv->stats.selects++;
+    uint64_t start = camio_tsc_read();
+    uint64_t now   = start;
+
+    while(1){
+        //Spin until we find something or the budget runs out
+        do{
+            size_t n = 0;
+            for(; n < priv->stream_count; n++){
+                const size_t i = (priv->last + 1 + n) % priv->stream_count; //Start from the next stream to avoid starvation
+                camio_istream_t* istream = priv->streams[i].istream;
+                if(likely(istream != NULL) && istream->ready(istream)){
+                    priv->last = i;
+                    priv->stats.spin_cycles += camio_tsc_read() - start;
+                    priv->stats.spin_hits   += !blocked;
+                    return priv->streams[i].index;
+                }
+            }
+            now = camio_tsc_read();
+        } while(now - start < priv->spin_cycles);
+
+        priv->stats.spin_cycles += now - start;
+
+        //Out of budget, go to sleep
+        priv->stats.blocks++;
+        blocked = 1;
+        int result = poll(priv->fds, priv->stream_count, priv->spin_only ? CAMIO_SELECTOR_ADAPTIVE_BLOCK_MS : -1);
+        if(result < 0 && errno != EINTR){
+            eprintf_exit(CAMIO_ERR_FILE_READ, "Poll failed with error =%s", strerror(errno));
+        }
+        if(result == 0){
+            priv->stats.block_timeouts++;
+        }
+
+        start = camio_tsc_read();
+    }
+
+    return ~0; //Unreachable
+}
+
+
+void camio_selector_adaptive_delete(camio_selector_t* this){
+    camio_selector_adaptive_t* priv = this->priv;
+    free(priv);
+}
+
+
+const camio_selector_adaptive_stats_t* camio_selector_adaptive_stats(camio_selector_t* this){
+    camio_selector_adaptive_t* priv = this->priv;
+    return &priv->stats;
+}
+
+/* ****************************************************
+ * Construction
+ */
+
+camio_selector_t* camio_selector_adaptive_construct(camio_selector_adaptive_t* priv, const camio_descr_t* descr, camio_selector_adaptive_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"adaptive stream supplied is null\n");
+    }
+
+    const char* valid_opts[] = { "spin_ns", "spin_cycles", NULL };
+    camio_descr_check_opts(descr, valid_opts);
+
+    //Initialize the local variables
+    priv->params           = params;
+    priv->stream_count     = 0;
+    priv->stream_avail     = 0;
+    priv->spin_only        = 0;
+    priv->last             = 0;
+    bzero(&priv->streams,sizeof(camio_selector_adaptive_stream_t) * CAMIO_SELECTOR_ADAPTIVE_MAX_STREAMS) ;
+    bzero(&priv->stats,sizeof(camio_selector_adaptive_stats_t));
+
+    //The budget can be given in cycles directly, or in ns and converted
+    if(params && params->spin_ns){
+        priv->spin_cycles = camio_tsc_ns_to_cycles(params->spin_ns);
+    }
+    else if(camio_descr_get_opt(descr, "spin_cycles")){
+        priv->spin_cycles = camio_descr_get_opt_uint(descr, "spin_cycles", 0);
+    }
+    else{
+        priv->spin_cycles = camio_tsc_ns_to_cycles(camio_descr_get_opt_uint(descr, "spin_ns", CAMIO_SELECTOR_ADAPTIVE_SPIN_NS));
+    }
+
+
+    //Populate the function members
+    priv->selector.priv          = priv; //Lets us access private members
+    priv->selector.init          = camio_selector_adaptive_init;
+    priv->selector.insert        = camio_selector_adaptive_insert;
+    priv->selector.remove        = camio_selector_adaptive_remove;
+    priv->selector.select        = camio_selector_adaptive_select;
+    priv->selector.delete        = camio_selector_adaptive_delete;
+    priv->selector.count         = camio_selector_adaptive_count;
+
+    //Call init, because its the obvious thing to do now...
+    priv->selector.init(&priv->selector);
+
+    //Return the generic selector interface for the outside world to use
+    return &priv->selector;
+
+}
+
+camio_selector_t* camio_selector_adaptive_new(const camio_descr_t* descr, camio_selector_adaptive_params_t* params){
+    camio_selector_adaptive_t* priv = malloc(sizeof(camio_selector_adaptive_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for adaptive selector creation\n");
+    }
+    return camio_selector_adaptive_construct(priv, descr, params);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ adaptive spin-then-block selector
+ *
+ */
+
+#ifndef CAMIO_SELECTOR_ADAPTIVE_H_
+#define CAMIO_SELECTOR_ADAPTIVE_H_
+
+#include <sys/poll.h>
+
+#include "camio_selector.h"
+#include "../camio_descr.h"
+#include "../istreams/camio_istream.h"
+
+/********************************************************************
+ *                  PRIVATE DEFS
+ ********************************************************************/
+
+typedef struct {
+    uint64_t spin_ns;       //Spin budget before blocking, overrides the spin_ns option if non-zero
+} camio_selector_adaptive_params_t;
+
+
+typedef struct {
+    camio_istream_t* istream;
+    size_t index;
+    int blocking;           //Can we block on this stream's fd?
+} camio_selector_adaptive_stream_t;
+
+
+typedef struct {
+    uint64_t selects;           //Total calls to select
+    uint64_t spin_hits;         //Selects satisfied within the spin budget, the rest had to block
+    uint64_t blocks;            //Times the spin budget ran out and we fell back to blocking
+    uint64_t block_timeouts;    //Blocks that timed out (only when there are streams we can't block on)
+    uint64_t spin_cycles;       //Total cycles spent spinning
+} camio_selector_adaptive_stats_t;
+
+
+#define CAMIO_SELECTOR_ADAPTIVE_MAX_STREAMS 32
+#define CAMIO_SELECTOR_ADAPTIVE_SPIN_NS (50 * 1000)     //Default spin budget, 50us
+#define CAMIO_SELECTOR_ADAPTIVE_BLOCK_MS 1              //Longest we'll block when there are streams we can't block on
+
+typedef struct {
+    camio_selector_t selector;                         //Underlying selector interface
+    camio_selector_adaptive_params_t* params;          //Parameters passed in from the outside
+    camio_selector_adaptive_stream_t streams[CAMIO_SELECTOR_ADAPTIVE_MAX_STREAMS]; //Statically allow up to n streams on this (simple) selector
+    size_t stream_count;                               //Number of streams added to the slector
+    size_t stream_avail;                               //Number of streams that are non null in the selector
+    size_t spin_only;                                  //Number of streams that we can't block on
+    size_t last;
+    uint64_t spin_cycles;                              //Spin budget in TSC cycles
+    struct pollfd fds[CAMIO_SELECTOR_ADAPTIVE_MAX_STREAMS];
+    camio_selector_adaptive_stats_t stats;
+} camio_selector_adaptive_t;
+
+
+
+/********************************************************************
+ *                  PUBLIC DEFS
+ ********************************************************************/
+
+camio_selector_t* camio_selector_adaptive_new( const camio_descr_t* descr, camio_selector_adaptive_params_t* params);
+const camio_selector_adaptive_stats_t* camio_selector_adaptive_stats(camio_selector_t* this);
+
+
+#endif /* CAMIO_SELECTOR_ADAPTIVE_H_ */
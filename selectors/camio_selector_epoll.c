@@ -0,0 +1,273 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ epoll selector
+ *
+ * Streams are registered edge triggered. An edge puts the stream on the ready list, where it
+ * stays (round robin with the others) until its ready() function says it has been drained. Streams
+ * that have no pollable fd (eg rings, regular files) are checked by spinning instead.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+
+
+#include "../camio_errors.h"
+#include "../camio_util.h"
+
+#include "camio_selector_epoll.h"
+
+
+int camio_selector_epoll_init(camio_selector_t* this){
+    camio_selector_epoll_t* priv = this->priv;
+
+    priv->epoll_fd = epoll_create1(0);
+    if(priv->epoll_fd < 0){
+        eprintf_exit(CAMIO_ERR_FILE_OPEN, "Could not create epoll instance. Error=%s\n", strerror(errno));
+    }
+
+    priv->streams   = malloc(sizeof(camio_selector_epoll_stream_t) * CAMIO_SELECTOR_EPOLL_INIT_STREAMS);
+    priv->spin_list = malloc(sizeof(size_t) * CAMIO_SELECTOR_EPOLL_INIT_STREAMS);
+    if(!priv->streams || !priv->spin_list){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "No memory available for epoll selector stream table\n");
+    }
+    bzero(priv->streams, sizeof(camio_selector_epoll_stream_t) * CAMIO_SELECTOR_EPOLL_INIT_STREAMS);
+    priv->stream_size = CAMIO_SELECTOR_EPOLL_INIT_STREAMS;
+
+    return 0;
+}
+
+
+//Make sure there is an entry for index in the stream table
+static void grow_streams(camio_selector_epoll_t* priv, size_t index){
+    if(likely(index < priv->stream_size)){
+        return;
+    }
+
+    size_t new_size = priv->stream_size * 2;
+    while(new_size <= index){
+        new_size *= 2;
+    }
+
+    priv->streams   = realloc(priv->streams, sizeof(camio_selector_epoll_stream_t) * new_size);
+    priv->spin_list = realloc(priv->spin_list, sizeof(size_t) * new_size);
+    if(!priv->streams || !priv->spin_list){
+        eprintf_exit(CAMIO_ERR_NULL_PTR, "Could not grow epoll selector stream table\n");
+    }
+    bzero(priv->streams + priv->stream_size, sizeof(camio_selector_epoll_stream_t) * (new_size - priv->stream_size));
+    priv->stream_size = new_size;
+}
+
+
+static inline void ready_push(camio_selector_epoll_t* priv, size_t index){
+    camio_selector_epoll_stream_t* stream = &priv->streams[index];
+    if(stream->queued){
+        return;
+    }
+
+    stream->queued     = 1;
+    stream->ready_next = CAMIO_SELECTOR_EPOLL_NONE;
+    if(priv->ready_head == CAMIO_SELECTOR_EPOLL_NONE){
+        priv->ready_head = index;
+    }
+    else{
+        priv->streams[priv->ready_tail].ready_next = index;
+    }
+    priv->ready_tail = index;
+}
+
+
+static inline size_t ready_pop(camio_selector_epoll_t* priv){
+    const size_t index = priv->ready_head;
+    camio_selector_epoll_stream_t* stream = &priv->streams[index];
+
+    priv->ready_head = stream->ready_next;
+    stream->queued   = 0;
+    return index;
+}
+
+
+//Insert an istream at index specified
+int camio_selector_epoll_insert(camio_selector_t* this, camio_istream_t* istream, size_t index){
+    camio_selector_epoll_t* priv = this->priv;
+    if(!istream){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No istream supplied\n");
+    }
+
+    grow_streams(priv, index);
+    camio_selector_epoll_stream_t* stream = &priv->streams[index];
+    if(stream->istream){
+        wprintf(CAMIO_ERR_STREAMS_OVERRUN, "Cannot insert stream at index %lu, it is already in use\n", index);
+        return -1;
+    }
+
+    stream->istream = istream;
+    stream->index   = index;
+    stream->spin    = 0;
+
+    struct epoll_event ev;
+    ev.events   = EPOLLIN | EPOLLET;
+    ev.data.u64 = index;
+    if(istream->fd < 0 || epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD, istream->fd, &ev) < 0){
+        //EPERM means the fd doesn't support polling (eg a regular file), so treat it like a stream without one
+        if(istream->fd >= 0 && errno != EPERM){
+            eprintf_exit(CAMIO_ERR_FILE_FLAGS, "Could not add stream %lu to epoll set. Error=%s\n", index, strerror(errno));
+        }
+
+        stream->spin     = 1;
+        stream->spin_pos = priv->spin_count;
+        priv->spin_list[priv->spin_count] = index;
+        priv->spin_count++;
+    }
+
+    //The stream may already have data buffered, which will never generate an edge
+    ready_push(priv, index);
+    priv->stream_avail++;
+
+    return 0;
+}
+
+
+
+size_t camio_selector_epoll_count(camio_selector_t* this){
+    camio_selector_epoll_t* priv = this->priv;
+    return priv->stream_avail;
+}
+
+
+//Remove the istream at index specified
+int camio_selector_epoll_remove(camio_selector_t* this, size_t index){
+    camio_selector_epoll_t* priv = this->priv;
+
+    if(index >= priv->stream_size || !priv->streams[index].istream){
+        wprintf(CAMIO_ERR_STREAMS_OVERRUN, "Cannot remove this stream (%lu) from this selector. The index could not be found.\n", index);
+        return -1;
+    }
+
+    camio_selector_epoll_stream_t* stream = &priv->streams[index];
+    if(stream->spin){
+        const size_t last = priv->spin_list[priv->spin_count - 1];
+        priv->spin_list[stream->spin_pos] = last;
+        priv->streams[last].spin_pos      = stream->spin_pos;
+        priv->spin_count--;
+    }
+    else{
+        //The stream may have closed its fd already, in which case the kernel has dropped it for us
+        epoll_ctl(priv->epoll_fd, EPOLL_CTL_DEL, stream->istream->fd, NULL);
+    }
+
+    //Stale entries on the ready list are skipped when they are popped
+    stream->istream = NULL;
+    stream->spin    = 0;
+    priv->stream_avail--;
+
+    return 0;
+}
+
+
+//Block waiting for a change on a given istream
+//return the stream number that changed
+size_t camio_selector_epoll_select(camio_selector_t* this){
+    camio_selector_epoll_t* priv = this->priv;
+
+    while(1){
+        //Drain the ready list first. Streams that are still ready go to the back, so nobody starves
+        while(priv->ready_head != CAMIO_SELECTOR_EPOLL_NONE){
+            const size_t index = ready_pop(priv);
+            camio_selector_epoll_stream_t* stream = &priv->streams[index];
+            if(unlikely(!stream->istream)){
+                continue;
+            }
+
+            if(likely(stream->istream->ready(stream->istream))){
+                ready_push(priv, index);
+                return stream->index;
+            }
+            //Not ready, the next edge will put it back on the list
+        }
+
+        size_t i = 0;
+        for(; i < priv->spin_count; i++){
+            camio_selector_epoll_stream_t* stream = &priv->streams[priv->spin_list[i]];
+            if(stream->istream->ready(stream->istream)){
+                ready_push(priv, priv->spin_list[i]);
+            }
+        }
+
+        //Only block if there is nothing to spin on
+        const int timeout = priv->spin_count || priv->ready_head != CAMIO_SELECTOR_EPOLL_NONE ? 0 : -1;
+        const int result = epoll_wait(priv->epoll_fd, priv->events, CAMIO_SELECTOR_EPOLL_MAX_EVENTS, timeout);
+        if(unlikely(result < 0)){
+            if(errno == EINTR){
+                continue;
+            }
+            eprintf_exit(CAMIO_ERR_FILE_READ, "Epoll failed with error =%s", strerror(errno));
+        }
+
+        int j = 0;
+        for(; j < result; j++){
+            const size_t index = priv->events[j].data.u64;
+            if(likely(index < priv->stream_size && priv->streams[index].istream)){
+                ready_push(priv, index);
+            }
+        }
+    }
+
+    return ~0; //Unreachable
+}
+
+
+void camio_selector_epoll_delete(camio_selector_t* this){
+    camio_selector_epoll_t* priv = this->priv;
+    close(priv->epoll_fd);
+    free(priv->streams);
+    free(priv->spin_list);
+    free(priv);
+}
+
+/* ****************************************************
+ * Construction
+ */
+
+camio_selector_t* camio_selector_epoll_construct(camio_selector_epoll_t* priv, camio_selector_epoll_params_t* params){
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"epoll stream supplied is null\n");
+    }
+    //Initialize the local variables
+    priv->params           = params;
+    priv->epoll_fd         = -1;
+    priv->streams          = NULL;
+    priv->stream_size      = 0;
+    priv->stream_avail     = 0;
+    priv->ready_head       = CAMIO_SELECTOR_EPOLL_NONE;
+    priv->ready_tail       = CAMIO_SELECTOR_EPOLL_NONE;
+    priv->spin_list        = NULL;
+    priv->spin_count       = 0;
+
+
+
+    //Populate the function members
+    priv->selector.priv          = priv; //Lets us access private members
+    priv->selector.init          = camio_selector_epoll_init;
+    priv->selector.insert        = camio_selector_epoll_insert;
+    priv->selector.remove        = camio_selector_epoll_remove;
+    priv->selector.select        = camio_selector_epoll_select;
+    priv->selector.delete        = camio_selector_epoll_delete;
+    priv->selector.count         = camio_selector_epoll_count;
+
+    //Call init, because its the obvious thing to do now...
+    priv->selector.init(&priv->selector);
+
+    //Return the generic selector interface for the outside world to use
+    return &priv->selector;
+
+}
+
+camio_selector_t* camio_selector_epoll_new(camio_selector_epoll_params_t* params){
+    camio_selector_epoll_t* priv = malloc(sizeof(camio_selector_epoll_t));
+    if(!priv){
+        eprintf_exit(CAMIO_ERR_NULL_PTR,"No memory available for epoll selector creation\n");
+    }
+    return camio_selector_epoll_construct(priv,  params);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright  (C) Matthew P. Grosvenor, 2012, All Rights Reserved
+ *
+ * Fe2+ epoll selector
+ *
+ */
+
+#ifndef CAMIO_SELECTOR_EPOLL_H_
+#define CAMIO_SELECTOR_EPOLL_H_
+
+#include <sys/epoll.h>
+
+#include "camio_selector.h"
+#include "../istreams/camio_istream.h"
+
+/********************************************************************
+ *                  PRIVATE DEFS
+ ********************************************************************/
+
+typedef struct {
+    //No params at this stage
+} camio_selector_epoll_params_t;
+
+
+#define CAMIO_SELECTOR_EPOLL_NONE (~0ULL)       //End of list marker
+#define CAMIO_SELECTOR_EPOLL_INIT_STREAMS 32    //Initial size of the stream table, it grows as needed
+#define CAMIO_SELECTOR_EPOLL_MAX_EVENTS 64      //Most events collected by a single epoll_wait() call
+
+typedef struct {
+    camio_istream_t* istream;
+    size_t index;
+    int queued;                                 //Is this stream on the ready list?
+    size_t ready_next;                          //Next stream on the ready list
+    int spin;                                   //Stream has no pollable fd and must be checked by spinning
+    size_t spin_pos;                            //Position in the spin list
+} camio_selector_epoll_stream_t;
+
+
+typedef struct {
+    camio_selector_t selector;                         //Underlying selector interface
+    camio_selector_epoll_params_t* params;             //Parameters passed in from the outside
+    int epoll_fd;
+    camio_selector_epoll_stream_t* streams;            //Streams, indexed by their selector index
+    size_t stream_size;                                //Number of entries allocated in the stream table
+    size_t stream_avail;                               //Number of streams that are non null in the selector
+    size_t ready_head;                                 //Streams that may have data waiting, in the order they became ready
+    size_t ready_tail;
+    size_t* spin_list;                                 //Streams without a pollable fd
+    size_t spin_count;
+    struct epoll_event events[CAMIO_SELECTOR_EPOLL_MAX_EVENTS];
+} camio_selector_epoll_t;
+
+
+
+/********************************************************************
+ *                  PUBLIC DEFS
+ ********************************************************************/
+
+camio_selector_t* camio_selector_epoll_new(  camio_selector_epoll_params_t* params);
+
+
+#endif /* CAMIO_SELECTOR_EPOLL_H_ */
@@ -0,0 +1,54 @@
+/*
+ * test_addr_parser.c
+ *
+ * Tests for the ip and ip:port parsers used by the socket streams
+ */
+
+#include "../parsing/addr_parser.h"
+#include <stdio.h>
+#include <arpa/inet.h>
+
+static int check(const char* in, int valid, const char* ip, uint16_t port){
+    addr_result_t result = parse_ip_port(in);
+    if(result.valid != valid){
+        return 0;
+    }
+    if(!valid){
+        return 1;
+    }
+
+    return result.addr.sin_family == AF_INET && result.addr.sin_addr.s_addr == inet_addr(ip) && ntohs(result.addr.sin_port) == port;
+}
+
+
+void test_addr_parser() {
+    int test = 0;
+    printf("Test %i:%s\n", test++, check("127.0.0.1:2000", 1, "127.0.0.1", 2000)                   ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("255.255.255.255:65535", 1, "255.255.255.255", 65535)     ? "Pass" : "Fail"); //Longest there is
+    printf("Test %i:%s\n", test++, check("239.1.2.3:0", 1, "239.1.2.3", 0)                         ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("*:53", 1, "0.0.0.0", 53)                                 ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check(":53", 1, "0.0.0.0", 53)                                  ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("10.0.0.1", 0, NULL, 0)                                   ? "Pass" : "Fail"); //No port
+    printf("Test %i:%s\n", test++, check("10.0.0.1:", 0, NULL, 0)                                  ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("10.0.0.1:65536", 0, NULL, 0)                             ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("10.0.0.1:100000", 0, NULL, 0)                            ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("10.0.0.1:+80", 0, NULL, 0)                              ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("10.0.0.1:80 ", 0, NULL, 0)                              ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("10.0.0.256:80", 0, NULL, 0)                              ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("10.0.0:80", 0, NULL, 0)                                  ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("0010.000.000.001:80", 0, NULL, 0)                        ? "Pass" : "Fail"); //Too long to be an address
+    printf("Test %i:%s\n", test++, check("localhost:80", 0, NULL, 0)                               ? "Pass" : "Fail"); //Names aren't resolved
+
+    //Bare addresses
+    addr_result_t result = parse_ip("192.168.1.10");
+    printf("Test %i:%s\n", test++, result.valid && result.addr.sin_addr.s_addr == inet_addr("192.168.1.10") ? "Pass" : "Fail");
+    result = parse_ip("*");
+    printf("Test %i:%s\n", test++, result.valid && result.addr.sin_addr.s_addr == htonl(INADDR_ANY)        ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, !parse_ip("").valid && !parse_ip("1.2.3.4:5").valid                     ? "Pass" : "Fail");
+}
+
+
+int main(int argc, char** argv){
+    test_addr_parser();
+    return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * test_escape.c
+ *
+ * Round trip tests for the \xHH escape codec used by the log streams
+ */
+
+#include "../parsing/escape.h"
+#include <stdio.h>
+#include <string.h>
+
+static int check(const char* in, size_t len, const char* expected){
+    uint8_t escaped[ESCAPE_HEX_MAX_LEN(256)];
+    uint8_t unescaped[256];
+
+    const size_t escaped_len = escape_hex((const uint8_t*)in, len, escaped);
+    if(escaped_len != strlen(expected) || memcmp(escaped, expected, escaped_len)){
+        return 0;
+    }
+
+    //Must come back exactly as it went in, both into a new buffer and in place
+    const size_t unescaped_len = unescape_hex(escaped, escaped_len, unescaped);
+    if(unescaped_len != len || memcmp(unescaped, in, len)){
+        return 0;
+    }
+
+    return unescape_hex(escaped, escaped_len, escaped) == len && !memcmp(escaped, in, len);
+}
+
+
+void test_escape() {
+    uint8_t all[256];
+    uint8_t escaped[ESCAPE_HEX_MAX_LEN(256)];
+    size_t i = 0;
+    for(; i < 256; i++){
+        all[i] = i;
+    }
+
+    int test = 0;
+    printf("Test %i:%s\n", test++, check("", 0, "")                                                  ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("hello world", 11, "hello world")                           ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("a\nb\r", 4, "a\\x0Ab\\x0D")                                ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("\x00\xFF\x7F", 3, "\\x00\\xFF\\x7F")                       ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check("\\x41", 4, "\\x5Cx41")                                     ? "Pass" : "Fail"); //A literal \x41 must survive
+    printf("Test %i:%s\n", test++, check("0123456789abcdef0123456789abcdef\x01", 33,
+                                         "0123456789abcdef0123456789abcdef\\x01")                   ? "Pass" : "Fail"); //Crosses a vector boundary
+
+    //Every byte value round trips
+    const size_t escaped_len = escape_hex(all, 256, escaped);
+    printf("Test %i:%s\n", test++, unescape_hex(escaped, escaped_len, escaped) == 256 && !memcmp(escaped, all, 256) ? "Pass" : "Fail");
+
+    //Upper nibble must end up on top (0x1A, not 0xA1 or 0x1 & 0xA)
+    uint8_t out[4];
+    printf("Test %i:%s\n", test++, unescape_hex((const uint8_t*)"\\x1a", 4, out) == 1 && out[0] == 0x1A      ? "Pass" : "Fail");
+
+    //Broken and truncated sequences are left alone
+    printf("Test %i:%s\n", test++, unescape_hex((const uint8_t*)"\\xZZ", 4, out) == 4 && !memcmp(out, "\\xZZ", 4) ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, unescape_hex((const uint8_t*)"a\\x4", 4, out) == 4 && !memcmp(out, "a\\x4", 4) ? "Pass" : "Fail");
+}
+
+
+int main(int argc, char** argv){
+    test_escape();
+    return 0;
+}
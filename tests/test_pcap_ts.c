@@ -0,0 +1,48 @@
+/*
+ * test_pcap_ts.c
+ *
+ * Tests for the conversion of pcap and pcapng record timestamps to nanoseconds since the epoch,
+ * with the sort of times that real captures have in them
+ */
+
+#include "../camio_pcap.h"
+#include "../camio_pcapng.h"
+#include <stdio.h>
+
+static int check_pcap(uint32_t sec, uint32_t frac, int nano, uint64_t expected){
+    const camio_pcap_rec_hdr_t rec_hdr = { .ts_sec = sec, .ts_frac = frac, .caplen = 0, .len = 0 };
+    return camio_pcap_ts_to_ns(&rec_hdr, nano) == expected;
+}
+
+
+static int check_pcapng(uint8_t tsresol, int64_t tsoffset, uint64_t ts, uint64_t expected){
+    const camio_pcapng_if_t iface = { .linktype = 1, .snaplen = 0, .tsresol = tsresol, .tsoffset = tsoffset };
+    return camio_pcapng_ts_to_ns(&iface, ts) == expected;
+}
+
+
+void test_pcap_ts() {
+    int test = 0;
+    printf("Test %i:%s\n", test++, check_pcap(0, 1, 0, 1000ULL)                                           ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check_pcap(1700000000, 0, 0, 1700000000000000000ULL)                   ? "Pass" : "Fail"); //Nov 2023
+    printf("Test %i:%s\n", test++, check_pcap(1700000000, 999999, 0, 1700000000999999000ULL)              ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check_pcap(1700000000, 999999999, 1, 1700000000999999999ULL)           ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check_pcap(4294967295U, 0, 1, 4294967295000000000ULL)                  ? "Pass" : "Fail"); //Last second there is
+
+    //An hour and a half apart, the difference must come out right and never go backwards
+    const camio_pcap_rec_hdr_t first = { .ts_sec = 1700000000, .ts_frac = 0, .caplen = 0, .len = 0 };
+    const camio_pcap_rec_hdr_t later = { .ts_sec = 1700005400, .ts_frac = 0, .caplen = 0, .len = 0 };
+    printf("Test %i:%s\n", test++, camio_pcap_ts_to_ns(&later, 0) - camio_pcap_ts_to_ns(&first, 0) == 5400000000000ULL ? "Pass" : "Fail");
+
+    //pcapng, in microseconds (the default), nanoseconds and binary fractions
+    printf("Test %i:%s\n", test++, check_pcapng(6, 0, 1700000000123456ULL, 1700000000123456000ULL)        ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check_pcapng(9, 0, 1700000000123456789ULL, 1700000000123456789ULL)    ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check_pcapng(CAMIO_PCAPNG_TSRESOL_BINARY | 30, 0, 1700000000ULL << 30, 1700000000000000000ULL) ? "Pass" : "Fail");
+    printf("Test %i:%s\n", test++, check_pcapng(6, 3600, 1700000000000000ULL, 1700003600000000000ULL)     ? "Pass" : "Fail");
+}
+
+
+int main(int argc, char** argv){
+    test_pcap_ts();
+    return 0;
+}
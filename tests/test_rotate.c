@@ -0,0 +1,103 @@
+/*
+ * test_rotate.c
+ *
+ * Rotate a blob stream through several files and check that each one gets the right name
+ */
+
+#include "../ostreams/camio_ostream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define TEST_ROTATE_RECORDS 100
+#define TEST_ROTATE_RECORD_SIZE 60
+#define TEST_ROTATE_BYTES 2000
+
+
+//Write the records out through a stream made from template, then look for files named by
+//name_format (with the file's index) in dir. Returns non-zero if there were at least 3 files, with
+//nothing else in dir, holding all of the records in order
+static int rotate_through(const char* dir, const char* template, const char* name_format){
+    //The stream is made from a description that is freed straight away, so later files must not
+    //depend on it
+    char descr[512];
+    snprintf(descr, sizeof(descr), "blob:%s/%s,rotate_bytes=%u", dir, template, TEST_ROTATE_BYTES);
+    camio_ostream_t* out = camio_ostream_new(descr, NULL);
+
+    int i = 0;
+    for(; i < TEST_ROTATE_RECORDS; i++){
+        uint8_t* buff = out->start_write(out, TEST_ROTATE_RECORD_SIZE);
+        memset(buff, i, TEST_ROTATE_RECORD_SIZE);
+        out->end_write(out, TEST_ROTATE_RECORD_SIZE);
+    }
+    out->delete(out);
+
+    int entries = 0;
+    DIR* d = opendir(dir);
+    struct dirent* ent;
+    while(d && (ent = readdir(d))){
+        entries += ent->d_name[0] != '.';
+    }
+    if(d){
+        closedir(d);
+    }
+
+    //Files are numbered from 0 with no gaps, and hold all of the records between them, in order
+    size_t total = 0;
+    int in_order = 1;
+    int expected = 0;
+    int files = 0;
+    for(;; files++){
+        char name[1024];
+        int len = snprintf(name, sizeof(name), "%s/", dir);
+        snprintf(name + len, sizeof(name) - len, name_format, files);
+        FILE* file = fopen(name, "r");
+        if(!file){
+            break;
+        }
+        uint8_t rec[TEST_ROTATE_RECORD_SIZE];
+        while(fread(rec, 1, sizeof(rec), file) == sizeof(rec)){
+            in_order &= rec[0] == (uint8_t)expected && rec[sizeof(rec) - 1] == (uint8_t)expected;
+            expected++;
+            total += sizeof(rec);
+        }
+        fclose(file);
+        unlink(name);
+    }
+
+    return files >= 3 && files == entries && in_order && total == TEST_ROTATE_RECORDS * TEST_ROTATE_RECORD_SIZE;
+}
+
+
+void test_rotate() {
+    char dir[] = "/tmp/camio_test_rotate_XXXXXX";
+    if(!mkdtemp(dir)){
+        printf("Test 0:Fail\n");
+        return;
+    }
+
+    int test = 0;
+    printf("Test %i:%s\n", test++, rotate_through(dir, "b_%i.bin", "b_%d.bin")                  ? "Pass" : "Fail");
+
+    //Only a time in the name, which is the same for every file as they're rotated on size. Every
+    //file must be numbered, or later ones would land on top of earlier ones
+    char year[16];
+    const time_t now = time(NULL);
+    struct tm tm;
+    strftime(year, sizeof(year), "%Y", localtime_r(&now, &tm));
+    char name_format[64];
+    snprintf(name_format, sizeof(name_format), "c-%s.bin.%%d", year);
+    printf("Test %i:%s\n", test++, rotate_through(dir, "c-%Y.bin", name_format)                 ? "Pass" : "Fail");
+
+    rmdir(dir);
+}
+
+
+int main(int argc, char** argv){
+    test_rotate();
+    return 0;
+}